@@ -1,3 +1,8 @@
+//compile with BONES_BUFFER to read the bones from the SkinningBuffer, add INSTANCED to render a crowd in one draw
+#ifdef BONES_BUFFER
+	#extension GL_EXT_gpu_shader4 : enable
+#endif
+
 attribute vec3 a_vertex;
 attribute vec3 a_normal;
 attribute vec2 a_uv;
@@ -8,10 +13,31 @@ attribute vec4 a_weights;
 
 uniform vec3 u_camera_pos;
 
-uniform mat4 u_model;
 uniform mat4 u_viewprojection;
 
-uniform mat4 u_bones[128];
+#ifdef INSTANCED
+	attribute mat4 u_model;
+	attribute float a_bones_offset; //attributes are floats here, exact up to 2^24
+	#define BONES_OFFSET int(a_bones_offset)
+#else
+	uniform mat4 u_model;
+	uniform int u_bones_offset;
+	#define BONES_OFFSET u_bones_offset
+#endif
+
+#ifdef BONES_BUFFER
+	uniform samplerBuffer u_bones_buffer; //every matrix is 4 texels (columns)
+
+	mat4 getBone(float index)
+	{
+		int i = (BONES_OFFSET + int(index)) * 4;
+		return mat4(texelFetchBuffer(u_bones_buffer, i), texelFetchBuffer(u_bones_buffer, i + 1),
+			texelFetchBuffer(u_bones_buffer, i + 2), texelFetchBuffer(u_bones_buffer, i + 3));
+	}
+#else
+	uniform mat4 u_bones[128];
+	#define getBone(index) u_bones[int(index)]
+#endif
 
 //this will store the color for the pixel shader
 varying vec3 v_position;
@@ -26,15 +52,15 @@ void main()
 	vec4 v = vec4(a_vertex, 1.0);
 	vec4 n = vec4(a_normal, 0.0);
 
-	mat4 skin = (u_bones[int(a_bones.x)] * a_weights.x +
-			u_bones[int(a_bones.y)] * a_weights.y +
-			u_bones[int(a_bones.z)] * a_weights.z +
-			u_bones[int(a_bones.w)] * a_weights.w);
+	mat4 skin = (getBone(a_bones.x) * a_weights.x +
+			getBone(a_bones.y) * a_weights.y +
+			getBone(a_bones.z) * a_weights.z +
+			getBone(a_bones.w) * a_weights.w);
 
 	v = skin * v;
 	n = skin * n;
 
-	v_position = v;
+	v_position = v.xyz;
 	v_normal = normalize(n.xyz);
 
 	//calcule the normal in world space
@@ -1,3 +1,6 @@
+#ifdef TEXTURE_ARRAY
+#extension GL_EXT_texture_array : enable
+#endif
 
 varying vec3 v_position;
 varying vec3 v_world_position;
@@ -6,11 +9,20 @@ varying vec2 v_uv;
 varying vec4 v_color;
 
 uniform vec4 u_color;
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray u_texture;
+uniform float u_texture_layer;
+#else
 uniform sampler2D u_texture;
+#endif
 uniform float u_time;
 
 void main()
 {
 	vec2 uv = v_uv;
+#ifdef TEXTURE_ARRAY
+	gl_FragColor = u_color * texture2DArray( u_texture, vec3(uv, u_texture_layer) );
+#else
 	gl_FragColor = u_color * texture2D( u_texture, uv );
+#endif
 }
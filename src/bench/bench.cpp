@@ -0,0 +1,263 @@
+#include "bench.h"
+#include "framework/includes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#define BENCH_SAMPLES 5 //the median is reported
+#define BENCH_DEFAULT_MIN_TIME 500 //ms per benchmark (all the samples)
+
+struct sBenchResult {
+	std::string name;
+	double ns = 0; //median per iteration
+	double min_ns = 0;
+	long iterations = 0; //per sample
+	double mb_per_second = 0;
+	double items_per_us = 0;
+	std::string skipped;
+};
+
+static std::chrono::high_resolution_clock::time_point s_start;
+
+std::vector<sBenchInfo>& getBenchmarks()
+{
+	static std::vector<sBenchInfo> benchmarks; //static inside a function, the registrars run before main in any order
+	return benchmarks;
+}
+
+std::vector<sCheckInfo>& getChecks()
+{
+	static std::vector<sCheckInfo> checks;
+	return checks;
+}
+
+//returns the number of checks that failed
+static int runChecks(const char* filter)
+{
+	std::vector<sCheckInfo> checks = getChecks();
+	std::sort(checks.begin(), checks.end(), [](const sCheckInfo& a, const sCheckInfo& b) { return strcmp(a.name, b.name) < 0; });
+
+	int failed = 0;
+	for (const sCheckInfo& info : checks)
+	{
+		if (filter && !strstr(info.name, filter))
+			continue;
+		std::string error;
+		bool ok = info.function(error);
+		if (ok)
+			printf("%-40s ok\n", info.name);
+		else
+		{
+			printf("%-40s FAILED: %s\n", info.name, error.c_str());
+			failed++;
+		}
+		fflush(stdout);
+	}
+	return failed;
+}
+
+void sBenchState::start()
+{
+	count = 0;
+	s_start = std::chrono::high_resolution_clock::now();
+}
+
+void sBenchState::stop()
+{
+	elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - s_start).count();
+}
+
+static sBenchResult runBenchmark(const sBenchInfo& info, double min_time)
+{
+	sBenchResult result;
+	result.name = info.name;
+	double sample_time = min_time / BENCH_SAMPLES;
+
+	//grow the iterations until one sample fills its time
+	sBenchState state;
+	while (true)
+	{
+		state.elapsed = 0;
+		info.function(state);
+		if (state.skipped.size())
+		{
+			result.skipped = state.skipped;
+			return result;
+		}
+		if (state.elapsed >= sample_time || state.iterations >= 1000000000)
+			break;
+		double scale = state.elapsed > 0 ? 1.2 * sample_time / state.elapsed : 10;
+		state.iterations = (long)std::max(state.iterations + 1.0, std::min(state.iterations * scale, state.iterations * 10.0));
+	}
+
+	std::vector<double> samples;
+	for (int i = 0; i < BENCH_SAMPLES; ++i)
+	{
+		info.function(state);
+		samples.push_back(state.elapsed * 1000000.0 / state.iterations);
+	}
+	std::sort(samples.begin(), samples.end());
+	result.ns = samples[BENCH_SAMPLES / 2];
+	result.min_ns = samples[0];
+	result.iterations = state.iterations;
+	if (state.bytes > 0)
+		result.mb_per_second = state.bytes * 1000.0 / result.ns; //bytes per ns are GB/s
+	if (state.items > 0)
+		result.items_per_us = state.items * 1000.0 / result.ns;
+	return result;
+}
+
+//reads the results written by writeJSON (one per line)
+static bool readJSON(const char* filename, std::map<std::string, double>& results)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+	{
+		std::cout << "[ERROR] Baseline not found: " << filename << std::endl;
+		return false;
+	}
+	char line[1024];
+	char name[256];
+	double ns;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, " { \"name\": \"%255[^\"]\", \"ns\": %lf", name, &ns) == 2)
+			results[name] = ns;
+	fclose(f);
+	return true;
+}
+
+static bool writeJSON(const char* filename, const std::vector<sBenchResult>& results)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] Cannot write the results: " << filename << std::endl;
+		return false;
+	}
+	fprintf(f, "{\n\t\"samples\": %d,\n\t\"results\": [\n", BENCH_SAMPLES);
+	bool first = true;
+	for (const sBenchResult& result : results)
+	{
+		if (result.skipped.size())
+			continue;
+		fprintf(f, "%s\t\t{ \"name\": \"%s\", \"ns\": %.3f, \"min_ns\": %.3f, \"iterations\": %ld, \"mb_s\": %.1f, \"items_us\": %.2f }", first ? "" : ",\n",
+			result.name.c_str(), result.ns, result.min_ns, result.iterations, result.mb_per_second, result.items_per_us);
+		first = false;
+	}
+	fprintf(f, "\n\t]\n}\n");
+	fclose(f);
+	std::cout << " + Results saved: " << filename << std::endl;
+	return true;
+}
+
+//hidden window, only to have a context for the benchmarks that use GL
+static bool createGLContext()
+{
+	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+		return false;
+	SDL_Window* window = SDL_CreateWindow("tje_bench", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (!window || !SDL_GL_CreateContext(window))
+		return false;
+	#ifdef USE_GLEW
+		glewInit();
+	#endif
+	std::cout << " * GL: " << glGetString(GL_RENDERER) << std::endl;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = NULL;
+	const char* json = NULL;
+	const char* baseline = NULL;
+	double min_time = BENCH_DEFAULT_MIN_TIME;
+	bool use_gl = true;
+	bool only_checks = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+			min_time = std::max(1.0, atof(argv[++i]));
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			json = argv[++i];
+		else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+			baseline = argv[++i];
+		else if (strcmp(argv[i], "--no-gl") == 0)
+			use_gl = false;
+		else if (strcmp(argv[i], "--check") == 0)
+			only_checks = true;
+		else
+		{
+			std::cout << "usage: tje_bench [--filter name] [--min-time ms] [--json results.json] [--compare baseline.json] [--no-gl] [--check]" << std::endl;
+			return 1;
+		}
+	}
+
+	//the results of a broken build are not worth measuring
+	int failed = runChecks(filter);
+	if (failed)
+	{
+		std::cout << "[ERROR] " << failed << " checks failed" << std::endl;
+		return 1;
+	}
+	if (only_checks)
+		return 0;
+
+	std::map<std::string, double> baseline_results;
+	if (baseline && !readJSON(baseline, baseline_results))
+		return 1;
+
+	bool has_gl = use_gl && createGLContext();
+	if (use_gl && !has_gl)
+		std::cout << "[WARN] No GL context, the GL benchmarks are skipped" << std::endl;
+
+	//sorted by name so the output is the same in every build
+	std::vector<sBenchInfo> benchmarks = getBenchmarks();
+	std::sort(benchmarks.begin(), benchmarks.end(), [](const sBenchInfo& a, const sBenchInfo& b) { return strcmp(a.name, b.name) < 0; });
+
+	printf("%-40s %14s %14s %12s %10s %10s\n", "benchmark", "ns/iter", "min ns", "iterations", "MB/s", "items/us");
+	std::vector<sBenchResult> results;
+	for (const sBenchInfo& info : benchmarks)
+	{
+		if (filter && !strstr(info.name, filter))
+			continue;
+		sBenchResult result;
+		if (info.needs_gl && !has_gl)
+		{
+			result.name = info.name;
+			result.skipped = "no GL context";
+		}
+		else
+			result = runBenchmark(info, min_time);
+		results.push_back(result);
+
+		if (result.skipped.size())
+		{
+			printf("%-40s skipped: %s\n", result.name.c_str(), result.skipped.c_str());
+			continue;
+		}
+		printf("%-40s %14.2f %14.2f %12ld ", result.name.c_str(), result.ns, result.min_ns, result.iterations);
+		if (result.mb_per_second > 0)
+			printf("%10.1f", result.mb_per_second);
+		else
+			printf("%10s", "");
+		if (result.items_per_us > 0)
+			printf(" %10.2f", result.items_per_us);
+		else
+			printf(" %10s", "");
+		auto it = baseline_results.find(result.name);
+		if (it != baseline_results.end() && it->second > 0)
+			printf("  %+.1f%%", (result.ns / it->second - 1.0) * 100.0); //negative is faster
+		printf("\n");
+		fflush(stdout);
+	}
+
+	if (json && !writeJSON(json, results))
+		return 1;
+	return 0;
+}
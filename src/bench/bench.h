@@ -0,0 +1,110 @@
+/*  Micro benchmarks (tje_bench)
+	Small in-tree harness to measure the hot functions of the framework and compare them between commits:
+
+		tje_bench [--filter name] [--min-time ms] [--json results.json] [--compare baseline.json] [--no-gl] [--check]
+
+	Every benchmark is a function registered with BENCH, the setup goes before BENCH_LOOP and only the loop is timed.
+	The runner finds how many iterations fill the minimum time and takes the median of several samples, so the
+	results are stable enough to compare a change against the json of a baseline build.
+
+		BENCH(math_matrix_multiply)
+		{
+			Matrix44 a, b;
+			BENCH_LOOP(state)
+				benchDoNotOptimize(a * b);
+		}
+
+	If the benchmark calls state.setBytesPerIteration or state.setItemsPerIteration the report also shows the MB/s
+	or the items per microsecond, which can be compared between benchmarks of different sizes.
+
+	The ones that need files from data/ or a GL context call state.skip() when they are not available.
+
+	Correctness checks are registered apart with BENCH_CHECK, they run before the benchmarks (only them with --check)
+	and if any fails the exit code is not zero, so a broken optimization is caught in CI:
+
+		BENCH_CHECK(math_inverse)
+		{
+			if (!works())
+			{
+				error = "what went wrong";
+				return false;
+			}
+			return true;
+		}
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+struct sBenchState {
+	long iterations = 1; //of the current sample
+	long count = 0;
+	double elapsed = 0; //ms of the last loop
+	double bytes = 0; //processed per iteration, to show the throughput
+	double items = 0; //processed per iteration (bones, vertices...), to show the items per microsecond
+	std::string skipped; //reason
+
+	void start();
+	bool next() { if (count++ < iterations) return true; stop(); return false; }
+	void stop();
+	void skip(const std::string& reason) { skipped = reason; }
+	void setBytesPerIteration(double bytes) { this->bytes = bytes; }
+	void setItemsPerIteration(double items) { this->items = items; }
+};
+
+typedef void (*BenchFunction)(sBenchState& state);
+
+struct sBenchInfo {
+	const char* name;
+	BenchFunction function;
+	bool needs_gl;
+};
+
+std::vector<sBenchInfo>& getBenchmarks();
+
+typedef bool (*CheckFunction)(std::string& error);
+
+struct sCheckInfo {
+	const char* name;
+	CheckFunction function;
+};
+
+std::vector<sCheckInfo>& getChecks();
+
+struct BenchRegistrar {
+	BenchRegistrar(const char* name, BenchFunction function, bool needs_gl) { getBenchmarks().push_back({ name, function, needs_gl }); }
+	BenchRegistrar(const char* name, CheckFunction function) { getChecks().push_back({ name, function }); }
+};
+
+#define BENCH_LOOP(state) for ((state).start(); (state).next(); )
+
+#define BENCH_REGISTER(name, needs_gl) \
+	static void bench_##name(sBenchState& state); \
+	static BenchRegistrar bench_registrar_##name(#name, bench_##name, needs_gl); \
+	static void bench_##name(sBenchState& state)
+
+#define BENCH(name) BENCH_REGISTER(name, false)
+#define BENCH_GL(name) BENCH_REGISTER(name, true) //skipped if there is no GL context
+
+#define BENCH_CHECK(name) \
+	static bool check_##name(std::string& error); \
+	static BenchRegistrar check_registrar_##name(#name, check_##name); \
+	static bool check_##name(std::string& error)
+
+// Keeps the compiler from removing the computation of a value that is not used
+template<class T> inline void benchDoNotOptimize(const T& value)
+{
+#ifdef _MSC_VER
+	static volatile const void* sink;
+	sink = &value;
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
@@ -0,0 +1,359 @@
+#include "bench.h"
+#include "framework/animation.h"
+#include "framework/animation_system.h"
+#include "framework/job_system.h"
+#include "framework/resource_manager.h"
+#include "graphics/mesh.h"
+#include "graphics/skinning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#define BENCH_NUM_BONES 64 //like a mixamo character
+#define BENCH_NUM_KEYFRAMES 120
+
+//there are no animations in data/, this one is built in memory and compressed like a loaded .skanim
+static Animation* createAnimation(float phase, bool compress = true, int num_bones = BENCH_NUM_BONES)
+{
+	Animation* anim = new Animation();
+	anim->samples_per_second = 30.0f;
+	anim->num_keyframes = BENCH_NUM_KEYFRAMES;
+	anim->duration = (BENCH_NUM_KEYFRAMES - 1) / anim->samples_per_second;
+
+	Skeleton& skeleton = anim->skeleton;
+	memset(&skeleton.bones, 0, sizeof(skeleton.bones));
+	skeleton.num_bones = num_bones;
+	for (int i = 0; i < num_bones; ++i)
+	{
+		Skeleton::Bone& bone = skeleton.bones[i];
+		snprintf(bone.name, sizeof(bone.name), "bone%d", i);
+		bone.parent = i ? (i - 1) / 2 : -1; //binary tree
+		if (bone.parent != -1)
+		{
+			Skeleton::Bone& parent = skeleton.bones[(int)bone.parent];
+			parent.children[parent.num_children++] = i;
+		}
+		bone.model.setTranslation(0.0f, 10.0f, 0.0f);
+		bone.layer = BODY | (i % 2 ? UPPER_BODY : LOWER_BODY);
+		anim->bones_map[i] = i;
+	}
+	skeleton.updateLayout();
+
+	anim->num_animated_bones = num_bones;
+	anim->keyframes = new Matrix44[num_bones * BENCH_NUM_KEYFRAMES];
+	for (int k = 0; k < BENCH_NUM_KEYFRAMES; ++k)
+		for (int i = 0; i < num_bones; ++i)
+		{
+			Matrix44& m = anim->keyframes[k * num_bones + i];
+			m.setRotation(sin(k * 0.1f + i + phase) * 0.5f, Vector3(i % 3 == 0, i % 3 == 1, i % 3 == 2));
+			m.translate(0.0f, 10.0f + sin(k * 0.05f) * (i == 0), 0.0f);
+		}
+	anim->buildTracks();
+	if (!compress)
+		return anim; //only the raw tracks (see sampleRawTracks)
+	anim->compress();
+	skeleton.updatePose();
+	anim->assignTime(0);
+	return anim;
+}
+
+static Animation* getAnimation(int index)
+{
+	static Animation* animations[2] = { createAnimation(0.0f), createAnimation(1.0f) };
+	return animations[index];
+}
+
+//the biggest skeleton supported (Skeleton::bones)
+static Animation* getBigAnimation(int index)
+{
+	static Animation* animations[2] = { createAnimation(0.0f, true, 128), createAnimation(1.0f, true, 128) };
+	return animations[index];
+}
+
+//skinned mesh with the bones of the animations (no geometry, only what the skinning needs)
+static Mesh* getSkinnedMesh()
+{
+	static Mesh* mesh = NULL;
+	if (mesh)
+		return mesh;
+	mesh = new Mesh();
+	mesh->bones_info.resize(BENCH_NUM_BONES);
+	for (int i = 0; i < BENCH_NUM_BONES; ++i)
+	{
+		snprintf(mesh->bones_info[i].name, sizeof(mesh->bones_info[i].name), "bone%d", BENCH_NUM_BONES - 1 - i); //another order
+		mesh->bones_info[i].bind_pose.setTranslation(0.0f, -10.0f * i, 0.0f);
+	}
+	return mesh;
+}
+
+//the animators get them with Animation::Get
+static const char* getAnimationName(int index)
+{
+	static bool registered = false;
+	if (!registered)
+	{
+		ResourceManager::add(RESOURCE_ANIMATION, "bench/anim0.skanim", getAnimation(0));
+		ResourceManager::add(RESOURCE_ANIMATION, "bench/anim1.skanim", getAnimation(1));
+		registered = true;
+	}
+	return index ? "bench/anim1.skanim" : "bench/anim0.skanim";
+}
+
+static void setupAnimator(Animator* animator, int index)
+{
+	animator->setMesh(getSkinnedMesh());
+	animator->playAnimation(getAnimationName(index % 2), true, 0.0f);
+	if (index % 3 == 0)
+		animator->playAnimation(getAnimationName((index + 1) % 2), true, 0.5f); //in a transition
+}
+
+//the animators created register themselves, the system updates them in parallel and the skinning buffer packs their bones
+BENCH_CHECK(animation_system_updates_animators)
+{
+	const int num = 16;
+	JobSystem::Init();
+	std::vector<std::unique_ptr<Animator>> managed, reference;
+	for (int i = 0; i < num; ++i)
+	{
+		managed.push_back(std::make_unique<Animator>());
+		reference.push_back(std::make_unique<Animator>(false));
+		setupAnimator(managed[i].get(), i);
+		setupAnimator(reference[i].get(), i);
+	}
+	if (AnimationSystem::getAnimators().size() != num)
+	{
+		error = "registered " + std::to_string(AnimationSystem::getAnimators().size()) + " animators of " + std::to_string(num);
+		return false;
+	}
+
+	for (int frame = 0; frame < 10; ++frame)
+	{
+		float dt = 0.016f + frame * 0.003f;
+		AnimationSystem::Update(dt);
+		for (auto& animator : reference)
+			animator->update(dt);
+	}
+
+	SkinningBuffer skinning;
+	skinning.addAnimators(AnimationSystem::getAnimators());
+	if (skinning.num_matrices != num * BENCH_NUM_BONES)
+	{
+		error = "the skinning buffer has " + std::to_string(skinning.num_matrices) + " bones";
+		return false;
+	}
+	for (int i = 0; i < num; ++i)
+	{
+		std::vector<Matrix44>& bones = reference[i]->getBoneMatrices();
+		int offset = managed[i]->getBonesOffset();
+		if ((int)bones.size() != BENCH_NUM_BONES || offset < 0 || memcmp(&skinning.matrices[offset], &bones[0], sizeof(Matrix44) * BENCH_NUM_BONES))
+		{
+			error = "the bones of animator " + std::to_string(i) + " do not match the serial update";
+			return false;
+		}
+	}
+
+	managed.clear();
+	if (!AnimationSystem::getAnimators().empty())
+	{
+		error = "the deleted animators are still registered";
+		return false;
+	}
+	return true;
+}
+
+//the callbacks run while the system iterates its animators, they can create and delete others
+BENCH_CHECK(animation_system_callbacks_add_and_remove)
+{
+	std::unique_ptr<Animator> owner = std::make_unique<Animator>();
+	std::unique_ptr<Animator> victim = std::make_unique<Animator>();
+	std::unique_ptr<Animator> created;
+	setupAnimator(owner.get(), 1);
+	setupAnimator(victim.get(), 1);
+	int calls = 0;
+	owner->addCallback(getAnimation(1)->name, [&](float) {
+		calls++;
+		created = std::make_unique<Animator>();
+		setupAnimator(created.get(), 0);
+		victim.reset();
+	}, 0.1f);
+
+	for (int frame = 0; frame < 20; ++frame)
+		AnimationSystem::Update(0.016f);
+
+	std::vector<Animator*>& animators = AnimationSystem::getAnimators();
+	if (calls != 1 || animators.size() != 2 || std::find(animators.begin(), animators.end(), created.get()) == animators.end())
+	{
+		error = "the animators changed by the callback are not registered (" + std::to_string(calls) + " calls, " + std::to_string(animators.size()) + " animators)";
+		return false;
+	}
+	return true;
+}
+
+static void benchSystemUpdate(sBenchState& state, int num)
+{
+	std::vector<std::unique_ptr<Animator>> animators;
+	for (int i = 0; i < num; ++i)
+	{
+		animators.push_back(std::make_unique<Animator>());
+		setupAnimator(animators[i].get(), i);
+	}
+	BENCH_LOOP(state)
+	{
+		AnimationSystem::Update(0.016f);
+		benchDoNotOptimize(animators[0]->getBoneMatrices()[0]);
+	}
+}
+
+BENCH(animation_system_update_64_animators)
+{
+	benchSystemUpdate(state, 64);
+}
+
+//the target is 200 NPCs in 2 ms
+BENCH(animation_system_update_200_animators)
+{
+	benchSystemUpdate(state, 200);
+}
+
+//the sampler before the keys were compressed: every frame of the float tracks is stored, so the two frames around t are
+//found by index and blended (the new one searches the keys of every track and decodes them)
+static void sampleRawTracks(Animation* anim, float t, Skeleton* result)
+{
+	t = fmod(t, anim->duration);
+	float v = anim->samples_per_second * t;
+	int index = (int)clamp(floor(v), 0.0f, (float)(anim->num_keyframes - 1));
+	int index2 = index + 1 < anim->num_keyframes ? index + 1 : 0;
+
+	const float* ka[sSkeletonPose::NUM_CHANNELS];
+	const float* kb[sSkeletonPose::NUM_CHANNELS];
+	float* out[sSkeletonPose::NUM_CHANNELS];
+	static sSkeletonPose sampled;
+	for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
+	{
+		ka[c] = anim->tracks + (index * sSkeletonPose::NUM_CHANNELS + c) * anim->tracks_stride;
+		kb[c] = anim->tracks + (index2 * sSkeletonPose::NUM_CHANNELS + c) * anim->tracks_stride;
+		out[c] = sampled.channels[c];
+	}
+	float weights[128];
+	std::fill(weights, weights + anim->tracks_stride, v - floor(v));
+	const float* w[] = { weights, weights, weights };
+	blendPoseChannels(ka, kb, w, out, anim->tracks_stride, false);
+
+	for (int i = 0; i < anim->num_animated_bones; ++i)
+		for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
+			result->pose.channels[c][(int)anim->bones_map[i]] = out[c][i];
+	result->matrices_dirty = true;
+}
+
+BENCH(animation_sample_raw_tracks)
+{
+	static Animation* anim = createAnimation(0.0f, false);
+	static Skeleton result;
+	result = getAnimation(0)->skeleton;
+	state.setItemsPerIteration(anim->num_animated_bones);
+	float time = 0;
+	BENCH_LOOP(state)
+	{
+		time += 0.0137f;
+		sampleRawTracks(anim, time, &result);
+		benchDoNotOptimize(result.pose);
+	}
+}
+
+BENCH(animation_sample_compressed)
+{
+	Animation* anim = getAnimation(0);
+	static Skeleton result;
+	result = anim->skeleton;
+	state.setItemsPerIteration(anim->num_animated_bones);
+	float time = 0;
+	BENCH_LOOP(state)
+	{
+		time += 0.0137f;
+		anim->sample(time, &result);
+		benchDoNotOptimize(result.pose);
+	}
+}
+
+BENCH(animation_assign_time)
+{
+	Animation* anim = getAnimation(0);
+	state.setItemsPerIteration(anim->num_animated_bones);
+	float time = 0;
+	BENCH_LOOP(state)
+	{
+		time += 0.0137f;
+		anim->assignTime(time);
+		benchDoNotOptimize(anim->skeleton.pose);
+	}
+}
+
+BENCH(animation_assign_time_global_matrices)
+{
+	Animation* anim = getAnimation(0);
+	state.setItemsPerIteration(anim->num_animated_bones);
+	float time = 0;
+	BENCH_LOOP(state)
+	{
+		time += 0.0137f;
+		anim->assignTime(time);
+		anim->skeleton.updateGlobalMatrices();
+		benchDoNotOptimize(anim->skeleton.global_bone_matrices);
+	}
+}
+
+BENCH(animation_blend_skeleton)
+{
+	Animation* a = getAnimation(0);
+	Animation* b = getAnimation(1);
+	a->assignTime(0.3f);
+	b->assignTime(0.7f);
+	static Skeleton result;
+	result = a->skeleton;
+	state.setItemsPerIteration(result.num_bones);
+	float w = 0;
+	BENCH_LOOP(state)
+	{
+		w = w >= 1.0f ? 0.0f : w + 0.01f;
+		blendSkeleton(&a->skeleton, &b->skeleton, w, &result);
+		benchDoNotOptimize(result.pose);
+	}
+}
+
+BENCH(animation_blend_skeleton_128_bones)
+{
+	Animation* a = getBigAnimation(0);
+	Animation* b = getBigAnimation(1);
+	a->assignTime(0.3f);
+	b->assignTime(0.7f);
+	static Skeleton result;
+	result = a->skeleton;
+	state.setItemsPerIteration(result.num_bones);
+	float w = 0;
+	BENCH_LOOP(state)
+	{
+		w = w >= 1.0f ? 0.0f : w + 0.01f;
+		blendSkeleton(&a->skeleton, &b->skeleton, w, &result);
+		benchDoNotOptimize(result.pose);
+	}
+}
+
+BENCH(animation_blend_skeleton_layer)
+{
+	Animation* a = getAnimation(0);
+	Animation* b = getAnimation(1);
+	a->assignTime(0.3f);
+	b->assignTime(0.7f);
+	static Skeleton result;
+	result = a->skeleton;
+	float w = 0;
+	BENCH_LOOP(state)
+	{
+		w = w >= 1.0f ? 0.0f : w + 0.01f;
+		blendSkeleton(&a->skeleton, &b->skeleton, w, &result, UPPER_BODY);
+		benchDoNotOptimize(result.pose);
+	}
+}
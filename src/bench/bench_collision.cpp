@@ -0,0 +1,84 @@
+#include "bench.h"
+#include "graphics/mesh.h"
+#include "framework/extra/pathfinder/AStar.h"
+
+#include <cmath>
+
+#define NUM_RAYS 64
+
+//rays from around the sphere to its center (they always hit) and some to the side (they miss)
+BENCH(collision_mesh_ray)
+{
+	Mesh* mesh = Mesh::Decode("data/meshes/sphere.obj"); //no GL needed, the test only uses the CPU copy
+	if (!mesh)
+	{
+		state.skip("data/meshes/sphere.obj not found");
+		return;
+	}
+	mesh->createCollisionModel();
+	Matrix44 model;
+	Vector3 origins[NUM_RAYS], directions[NUM_RAYS];
+	for (int i = 0; i < NUM_RAYS; ++i)
+	{
+		float angle = i * 6.28f / NUM_RAYS;
+		origins[i] = Vector3(cos(angle), 0.5f, sin(angle)) * mesh->radius * 3.0f;
+		Vector3 target = (i & 1) ? Vector3(0.0f, 0.0f, 0.0f) : Vector3(-sin(angle), 0.0f, cos(angle)) * mesh->radius * 2.0f;
+		directions[i] = (target - origins[i]).normalize();
+	}
+	Vector3 collision, normal;
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		bool hit = mesh->testRayCollision(model, origins[i], directions[i], collision, normal);
+		benchDoNotOptimize(hit);
+		i = (i + 1) % NUM_RAYS;
+	}
+	delete mesh;
+}
+
+#define GRID_SIZE 32
+
+struct sGridNode : public AStarNode {
+	float distanceTo(AStarNode* node) const override
+	{
+		return (float)(abs((int)node->getX() - (int)m_x) + abs((int)node->getY() - (int)m_y));
+	}
+};
+
+//corner to corner in a grid with walls that leave a gap at alternate ends (a zigzag path)
+BENCH(collision_astar_grid)
+{
+	static sGridNode nodes[GRID_SIZE * GRID_SIZE];
+	static bool ready = false;
+	if (!ready)
+	{
+		for (int y = 0; y < GRID_SIZE; ++y)
+			for (int x = 0; x < GRID_SIZE; ++x)
+				nodes[x + y * GRID_SIZE].setPosition(x, y);
+		auto isWall = [](int x, int y) { return (x % 4) == 2 && y != ((x / 4) % 2 ? 0 : GRID_SIZE - 1); };
+		for (int y = 0; y < GRID_SIZE; ++y)
+			for (int x = 0; x < GRID_SIZE; ++x)
+			{
+				if (isWall(x, y))
+					continue;
+				const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+				for (auto& offset : offsets)
+				{
+					int nx = x + offset[0], ny = y + offset[1];
+					if (nx >= 0 && ny >= 0 && nx < GRID_SIZE && ny < GRID_SIZE && !isWall(nx, ny))
+						nodes[x + y * GRID_SIZE].addChild(&nodes[nx + ny * GRID_SIZE], 1.0f);
+				}
+			}
+		ready = true;
+	}
+
+	AStar& astar = AStar::getInstance();
+	std::vector<AStarNode*> path;
+	BENCH_LOOP(state)
+	{
+		path.clear();
+		bool found = astar.getPath(&nodes[0], &nodes[GRID_SIZE * GRID_SIZE - 1], path);
+		benchDoNotOptimize(found);
+		astar.clear();
+	}
+}
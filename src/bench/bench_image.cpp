@@ -0,0 +1,212 @@
+#include "bench.h"
+#include "graphics/image_ops.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define IMAGE_SIZE 1024 //RGBA, like a usual color texture
+
+static const Uint8* getSource()
+{
+	static std::vector<Uint8> pixels;
+	if (pixels.empty())
+	{
+		pixels.resize(IMAGE_SIZE * IMAGE_SIZE * 4);
+		for (size_t i = 0; i < pixels.size(); ++i)
+			pixels[i] = (Uint8)((i * 7) ^ (i >> 9));
+	}
+	return pixels.data();
+}
+
+//every kernel of image_ops against its scalar reference
+BENCH(image_flip_rows)
+{
+	std::vector<Uint8> data(getSource(), getSource() + IMAGE_SIZE * IMAGE_SIZE * 4);
+	state.setBytesPerIteration(data.size());
+	BENCH_LOOP(state)
+	{
+		flipRows(data.data(), IMAGE_SIZE, IMAGE_SIZE, 4);
+		benchDoNotOptimize(data.data());
+	}
+}
+
+BENCH(image_flip_rows_scalar)
+{
+	std::vector<Uint8> data(getSource(), getSource() + IMAGE_SIZE * IMAGE_SIZE * 4);
+	state.setBytesPerIteration(data.size());
+	BENCH_LOOP(state)
+	{
+		flipRowsScalar(data.data(), IMAGE_SIZE, IMAGE_SIZE, 4);
+		benchDoNotOptimize(data.data());
+	}
+}
+
+BENCH(image_downsample_box)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleBox(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data());
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_downsample_box_srgb)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleBox(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data(), true);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_downsample_box_srgb_scalar)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleBoxScalar(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data(), true);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_downsample_box_scalar)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleBoxScalar(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data());
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_downsample_kaiser)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleKaiser(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data());
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_downsample_kaiser_scalar)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		downsampleKaiserScalar(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data());
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+//to a non power of two size, like the old textures resized on load
+BENCH(image_resample_bilinear)
+{
+	std::vector<Uint8> dst(700 * 500 * 4);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		resampleBilinear(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data(), 700, 500);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_resample_bilinear_scalar)
+{
+	std::vector<Uint8> dst(700 * 500 * 4);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 4);
+	BENCH_LOOP(state)
+	{
+		resampleBilinearScalar(getSource(), IMAGE_SIZE, IMAGE_SIZE, 4, dst.data(), 700, 500);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_expand_rgb_to_rgba)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE * 4);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 3);
+	BENCH_LOOP(state)
+	{
+		expandRGBToRGBA(getSource(), dst.data(), IMAGE_SIZE * IMAGE_SIZE);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+BENCH(image_expand_rgb_to_rgba_scalar)
+{
+	std::vector<Uint8> dst(IMAGE_SIZE * IMAGE_SIZE * 4);
+	state.setBytesPerIteration(IMAGE_SIZE * IMAGE_SIZE * 3);
+	BENCH_LOOP(state)
+	{
+		expandRGBToRGBAScalar(getSource(), dst.data(), IMAGE_SIZE * IMAGE_SIZE);
+		benchDoNotOptimize(dst.data());
+	}
+}
+
+//the outputs of the vectorized kernels against the scalar ones, with odd sizes so the tails are used too
+//(the float kernels can round differently, 1 of difference is allowed)
+static bool compareOutputs(const std::vector<Uint8>& a, const std::vector<Uint8>& b, int tolerance, const char* what, std::string& error)
+{
+	for (size_t i = 0; i < a.size(); ++i)
+		if (abs(a[i] - b[i]) > tolerance)
+		{
+			error = std::string(what) + ": byte " + std::to_string(i) + " is " + std::to_string(a[i]) + " instead of " + std::to_string(b[i]);
+			return false;
+		}
+	return true;
+}
+
+BENCH_CHECK(image_ops_match_scalar)
+{
+	const int sizes[][2] = { { 64, 64 }, { 37, 21 }, { 1, 9 } };
+	for (auto& size : sizes)
+		for (int bpp = 1; bpp <= 4; ++bpp)
+		{
+			int width = size[0], height = size[1];
+			int w = std::max(width / 2, 1), h = std::max(height / 2, 1);
+			std::vector<Uint8> image(getSource(), getSource() + width * height * bpp);
+			std::vector<Uint8> a(w * h * bpp), b(w * h * bpp);
+
+			std::vector<Uint8> flipped = image, flipped_scalar = image;
+			flipRows(flipped.data(), width, height, bpp);
+			flipRowsScalar(flipped_scalar.data(), width, height, bpp);
+			if (!compareOutputs(flipped, flipped_scalar, 0, "flipRows", error))
+				return false;
+
+			for (int srgb = 0; srgb < 2; ++srgb)
+			{
+				downsampleBox(image.data(), width, height, bpp, a.data(), srgb);
+				downsampleBoxScalar(image.data(), width, height, bpp, b.data(), srgb);
+				if (!compareOutputs(a, b, srgb, "downsampleBox", error))
+					return false;
+
+				downsampleKaiser(image.data(), width, height, bpp, a.data(), srgb);
+				downsampleKaiserScalar(image.data(), width, height, bpp, b.data(), srgb);
+				if (!compareOutputs(a, b, 1, "downsampleKaiser", error))
+					return false;
+			}
+
+			std::vector<Uint8> resampled(23 * 15 * bpp), resampled_scalar(23 * 15 * bpp);
+			resampleBilinear(image.data(), width, height, bpp, resampled.data(), 23, 15);
+			resampleBilinearScalar(image.data(), width, height, bpp, resampled_scalar.data(), 23, 15);
+			if (!compareOutputs(resampled, resampled_scalar, 1, "resampleBilinear", error))
+				return false;
+		}
+
+	//more than the 16 pixels of a NEON block and a tail
+	std::vector<Uint8> a(37 * 4), b(37 * 4);
+	expandRGBToRGBA(getSource(), a.data(), 37);
+	expandRGBToRGBAScalar(getSource(), b.data(), 37);
+	return compareOutputs(a, b, 0, "expandRGBToRGBA", error);
+}
@@ -0,0 +1,160 @@
+#include "bench.h"
+#include "framework/job_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NUM_ITEMS (1 << 18)
+
+static float kernel(float x)
+{
+	return std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+}
+
+//the same work with the pool restarted with every size, to see how it scales with the cores
+static void benchParallelFor(sBenchState& state, int num_threads)
+{
+	if (num_threads > (int)std::thread::hardware_concurrency())
+	{
+		state.skip("not enough cores");
+		return;
+	}
+
+	static std::vector<float> input, output;
+	if (input.empty())
+	{
+		input.resize(NUM_ITEMS);
+		output.resize(NUM_ITEMS);
+		for (int i = 0; i < NUM_ITEMS; ++i)
+			input[i] = (float)(i % 1000);
+	}
+
+	JobSystem::Destroy();
+	JobSystem::Init(num_threads - 1);
+
+	auto job = [](int start, int end) {
+		for (int i = start; i < end; ++i)
+			output[i] = kernel(input[i]);
+	};
+
+	state.setBytesPerIteration(NUM_ITEMS * sizeof(float) * 2.0);
+	BENCH_LOOP(state)
+	{
+		//the pool always has a worker, one thread is the plain loop
+		if (num_threads == 1)
+			job(0, NUM_ITEMS);
+		else
+			JobSystem::parallelFor(NUM_ITEMS, job);
+		benchDoNotOptimize(output.data());
+	}
+	JobSystem::Destroy();
+}
+
+BENCH(jobs_parallel_for_1_thread) { benchParallelFor(state, 1); }
+BENCH(jobs_parallel_for_2_threads) { benchParallelFor(state, 2); }
+BENCH(jobs_parallel_for_4_threads) { benchParallelFor(state, 4); }
+BENCH(jobs_parallel_for_8_threads) { benchParallelFor(state, 8); }
+BENCH(jobs_parallel_for_16_threads) { benchParallelFor(state, 16); }
+
+//cost of a job by itself: submitting and stealing 1024 that do nothing
+BENCH(jobs_run_empty_1024)
+{
+	JobSystem::Init();
+	BENCH_LOOP(state)
+	{
+		JobCounter counter;
+		for (int i = 0; i < 1024; ++i)
+			JobSystem::run([] {}, &counter);
+		JobSystem::wait(&counter);
+	}
+}
+
+//chains of jobs that depend on the previous one, the counter of each link must reach zero before the next is queued
+BENCH(jobs_dependency_chain_64)
+{
+	JobSystem::Init();
+	BENCH_LOOP(state)
+	{
+		JobCounter counters[64];
+		int order[64];
+		std::atomic<int> next{ 0 };
+		for (int i = 0; i < 64; ++i)
+			JobSystem::run([&, i] { order[i] = next++; }, &counters[i], i ? &counters[i - 1] : NULL);
+		JobSystem::wait(&counters[63]);
+		benchDoNotOptimize(order);
+	}
+}
+
+//every item must be written once, whatever the number of workers and the batch size
+BENCH_CHECK(jobs_parallel_for_covers_all)
+{
+	const int sizes[] = { 1, 2, 4, 8 };
+	const int batches[] = { 0, 1, 7, 1000 };
+	std::vector<int> counts(10000);
+	bool ok = true;
+	for (int num_threads : sizes)
+	{
+		JobSystem::Destroy();
+		JobSystem::Init(num_threads - 1);
+		for (int batch_size : batches)
+		{
+			std::fill(counts.begin(), counts.end(), 0);
+			JobSystem::parallelFor((int)counts.size(), [&](int start, int end) {
+				for (int i = start; i < end; ++i)
+					counts[i]++;
+			}, batch_size);
+			for (int i = 0; i < (int)counts.size() && ok; ++i)
+				if (counts[i] != 1)
+				{
+					error = "item " + std::to_string(i) + " run " + std::to_string(counts[i]) + " times with " + std::to_string(num_threads) + " threads and batch " + std::to_string(batch_size);
+					ok = false;
+				}
+		}
+	}
+	JobSystem::Destroy();
+	return ok;
+}
+
+//a job with a dependency is not queued until the previous counter reaches zero
+BENCH_CHECK(jobs_dependency_order)
+{
+	JobSystem::Init();
+	for (int repeat = 0; repeat < 100; ++repeat)
+	{
+		JobCounter counters[64];
+		int order[64];
+		std::atomic<int> next{ 0 };
+		for (int i = 0; i < 64; ++i)
+			JobSystem::run([&, i] { order[i] = next++; }, &counters[i], i ? &counters[i - 1] : NULL);
+		JobSystem::wait(&counters[63]);
+		for (int i = 0; i < 64; ++i)
+			if (order[i] != i)
+			{
+				error = "job " + std::to_string(i) + " run in position " + std::to_string(order[i]);
+				return false;
+			}
+	}
+	return true;
+}
+
+//the background jobs run in the workers even if nobody waits for them (the texture streamer only polls)
+BENCH_CHECK(jobs_background_without_wait)
+{
+	JobSystem::Destroy();
+	JobSystem::Init(0);
+	JobCounter counter;
+	std::atomic<bool> done{ false };
+	JobSystem::runBackground([&] { done = true; }, &counter);
+	for (int i = 0; i < 2000 && !counter.isDone(); ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	bool ok = done && counter.isDone();
+	JobSystem::Destroy(); //runs it if it is still queued
+	if (!ok)
+		error = "the background job did not run in 2 seconds";
+	return ok;
+}
@@ -0,0 +1,200 @@
+#include "bench.h"
+#include "graphics/mesh.h"
+#include "graphics/texture.h"
+#include "graphics/texture_streamer.h"
+#include "framework/utils.h"
+#include "framework/extra/picopng.h"
+#include "framework/extra/stb_image.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#define BENCH_MESH "data/meshes/sphere.obj"
+#define BENCH_PNG "data/scene/Scene.001/colormap.png"
+#define BENCH_SCENE_FOLDER "data/scene"
+#define BENCH_TEMP_MESH "tje_bench_temp" //writeBin adds the .mbin
+#define BENCH_TEMP_TBIN "tje_bench_temp.tbin"
+
+//Mesh::Get would return the cached mesh after the first iteration, Decode parses the file every time
+//without the .mbin or the interleaving (the log of every load is muted, also the missing .mtl)
+static Mesh* decodeOBJ(const char* filename)
+{
+	bool use_binary = Mesh::use_binary;
+	bool interleave_meshes = Mesh::interleave_meshes;
+	Mesh::use_binary = false;
+	Mesh::interleave_meshes = false;
+	std::streambuf* out = std::cout.rdbuf(NULL);
+	std::streambuf* err = std::cerr.rdbuf(NULL);
+	Mesh* mesh = Mesh::Decode(filename);
+	std::cout.rdbuf(out);
+	std::cerr.rdbuf(err);
+	std::cout.clear();
+	std::cerr.clear();
+	Mesh::use_binary = use_binary;
+	Mesh::interleave_meshes = interleave_meshes;
+	return mesh;
+}
+
+BENCH(loaders_mesh_load_obj)
+{
+	Mesh* test = decodeOBJ(BENCH_MESH);
+	if (!test)
+	{
+		state.skip(BENCH_MESH " not found");
+		return;
+	}
+	delete test;
+	BENCH_LOOP(state)
+	{
+		Mesh* mesh = decodeOBJ(BENCH_MESH);
+		benchDoNotOptimize(mesh->vertices.size());
+		delete mesh;
+	}
+}
+
+BENCH(loaders_mesh_read_bin)
+{
+	Mesh* source = decodeOBJ(BENCH_MESH);
+	bool written = source && source->writeBin(BENCH_TEMP_MESH);
+	delete source;
+	if (!written)
+	{
+		state.skip(BENCH_MESH " not found");
+		return;
+	}
+	BENCH_LOOP(state)
+	{
+		Mesh mesh;
+		mesh.readBin(BENCH_TEMP_MESH ".mbin");
+		benchDoNotOptimize(mesh.vertices.size());
+	}
+	remove(BENCH_TEMP_MESH ".mbin");
+}
+
+BENCH(loaders_image_load_png)
+{
+	Image test;
+	if (!test.loadPNG(BENCH_PNG))
+	{
+		state.skip(BENCH_PNG " not found");
+		return;
+	}
+	state.setBytesPerIteration(test.width * test.height * test.bytes_per_pixel);
+	BENCH_LOOP(state)
+	{
+		Image image;
+		image.loadPNG(BENCH_PNG);
+		benchDoNotOptimize(image.data);
+	}
+}
+
+//the old decoder against the one used by Image::loadPNG, both from memory to leave the file reading out
+BENCH(loaders_png_decode_picopng)
+{
+	std::string content;
+	if (!readFile(BENCH_PNG, content))
+	{
+		state.skip(BENCH_PNG " not found");
+		return;
+	}
+	std::vector<unsigned char> pixels;
+	unsigned int width, height;
+	BENCH_LOOP(state)
+	{
+		pixels.clear();
+		decodePNG(pixels, width, height, (const unsigned char*)content.data(), content.size());
+		benchDoNotOptimize(pixels.data());
+	}
+	state.setBytesPerIteration(width * height * 4.0);
+}
+
+BENCH(loaders_png_decode_stb)
+{
+	std::string content;
+	if (!readFile(BENCH_PNG, content))
+	{
+		state.skip(BENCH_PNG " not found");
+		return;
+	}
+	int width = 0, height = 0, channels;
+	BENCH_LOOP(state)
+	{
+		stbi_uc* pixels = stbi_load_from_memory((const stbi_uc*)content.data(), (int)content.size(), &width, &height, &channels, 4);
+		benchDoNotOptimize(pixels);
+		stbi_image_free(pixels);
+	}
+	state.setBytesPerIteration(width * height * 4.0);
+}
+
+static void fillImage(Image& image, int size)
+{
+	image.resize(size, size, 4);
+	for (int i = 0; i < size * size * 4; ++i)
+		image.data[i] = (Uint8)((i * 7) ^ (i >> 9));
+}
+
+//what loading a texture costs without the .tbin: mipmaps built on load
+BENCH(loaders_texture_bin_build)
+{
+	static Image image;
+	if (!image.data)
+		fillImage(image, 1024);
+	BENCH_LOOP(state)
+	{
+		sTextureBin bin;
+		bin.build(&image, true, false);
+		benchDoNotOptimize(bin.data.data());
+	}
+	state.setBytesPerIteration(1024 * 1024 * 4.0);
+}
+
+//and with it: every level read at once
+BENCH(loaders_texture_bin_read)
+{
+	Image image;
+	fillImage(image, 1024);
+	sTextureBin source;
+	if (!source.build(&image, true, false) || !source.write(BENCH_TEMP_TBIN))
+	{
+		state.skip("cannot write " BENCH_TEMP_TBIN);
+		return;
+	}
+	BENCH_LOOP(state)
+	{
+		sTextureBin bin;
+		bin.read(BENCH_TEMP_TBIN);
+		benchDoNotOptimize(bin.data.data());
+	}
+	state.setBytesPerIteration((double)source.data.size());
+	remove(BENCH_TEMP_TBIN);
+}
+
+//loading the textures of a level: decoded in the jobs, uploaded through the pixel buffers
+BENCH_GL(loaders_texture_streamer_scene)
+{
+	std::vector<std::string> filenames;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(BENCH_SCENE_FOLDER, error))
+		if (entry.path().extension() == ".png")
+			filenames.push_back(entry.path().generic_string());
+	if (filenames.empty())
+	{
+		state.skip(BENCH_SCENE_FOLDER " not found");
+		return;
+	}
+
+	std::vector<Texture*> textures;
+	BENCH_LOOP(state)
+	{
+		for (const std::string& filename : filenames)
+			textures.push_back(TextureStreamer::Get(filename.c_str(), true, true, true));
+		TextureStreamer::Flush();
+		benchDoNotOptimize(textures.data());
+
+		//unregistered, so the next Get loads them again
+		for (Texture* texture : textures)
+			delete texture;
+		textures.clear();
+	}
+}
@@ -0,0 +1,123 @@
+#include "bench.h"
+#include "framework/framework.h"
+#include "framework/camera.h"
+
+#define NUM_INPUTS 64 //rotated every iteration so the compiler cannot fold a constant input
+
+static float randomFloat(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static void fillMatrices(Matrix44* matrices)
+{
+	unsigned int seed = 1;
+	for (int i = 0; i < NUM_INPUTS; ++i)
+	{
+		matrices[i].setRotation(randomFloat(seed) * 6.28f, Vector3(randomFloat(seed), 1.0f, randomFloat(seed)).normalize());
+		matrices[i].translate(randomFloat(seed) * 100.0f, randomFloat(seed) * 100.0f, randomFloat(seed) * 100.0f);
+	}
+}
+
+BENCH(math_matrix44_multiply)
+{
+	Matrix44 matrices[NUM_INPUTS];
+	fillMatrices(matrices);
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		Matrix44 result = matrices[i] * matrices[(i + 1) % NUM_INPUTS];
+		benchDoNotOptimize(result);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+BENCH(math_matrix44_inverse)
+{
+	Matrix44 matrices[NUM_INPUTS];
+	fillMatrices(matrices);
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		Matrix44 result = matrices[i];
+		result.inverse();
+		benchDoNotOptimize(result);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+BENCH(math_matrix44_transform_vector3)
+{
+	Matrix44 matrices[NUM_INPUTS];
+	fillMatrices(matrices);
+	Vector3 v(1.0f, 2.0f, 3.0f);
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		v = matrices[i] * v;
+		benchDoNotOptimize(v);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+BENCH(math_quaternion_slerp)
+{
+	Quaternion quats[NUM_INPUTS];
+	unsigned int seed = 1;
+	for (int i = 0; i < NUM_INPUTS; ++i)
+		quats[i] = Quaternion(Vector3(randomFloat(seed), randomFloat(seed), 1.0f).normalize(), randomFloat(seed) * 6.28f);
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		Quaternion result;
+		quats[i].slerp(quats[(i + 1) % NUM_INPUTS], (i & 15) * (1.0f / 16.0f), result);
+		benchDoNotOptimize(result);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+BENCH(math_transform_bounding_box)
+{
+	Matrix44 matrices[NUM_INPUTS];
+	fillMatrices(matrices);
+	BoundingBox box(Vector3(1.0f, 2.0f, 3.0f), Vector3(10.0f, 5.0f, 2.0f));
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		BoundingBox result = transformBoundingBox(matrices[i], box);
+		benchDoNotOptimize(result);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+//half the boxes are outside, like in a scene
+BENCH(math_camera_test_box_in_frustum)
+{
+	Camera camera;
+	camera.lookAt(Vector3(0.f, 100.f, 100.f), Vector3(0.f, 0.f, 0.f), Vector3(0.f, 1.f, 0.f));
+	camera.setPerspective(70.f, 16.f / 9.f, 0.1f, 10000.f);
+	Vector3 centers[NUM_INPUTS];
+	unsigned int seed = 1;
+	for (int i = 0; i < NUM_INPUTS; ++i)
+		centers[i] = Vector3(randomFloat(seed) - 0.5f, randomFloat(seed) - 0.5f, randomFloat(seed) - 0.5f) * 1000.0f;
+	Vector3 halfsize(5.0f, 5.0f, 5.0f);
+	int i = 0;
+	BENCH_LOOP(state)
+	{
+		char result = camera.testBoxInFrustum(centers[i], halfsize);
+		benchDoNotOptimize(result);
+		i = (i + 1) % NUM_INPUTS;
+	}
+}
+
+BENCH(math_multiply_matrices_batch)
+{
+	Matrix44 matrices[NUM_INPUTS], result[NUM_INPUTS];
+	fillMatrices(matrices);
+	BENCH_LOOP(state)
+	{
+		multiplyMatrices(matrices, matrices, result, NUM_INPUTS);
+		benchDoNotOptimize(result);
+	}
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "graphics/shader.h"
+
+static Shader* getShader(sBenchState& state)
+{
+	Shader* shader = Shader::Get("data/shaders/basic.vs", "data/shaders/flat.fs");
+	if (!shader)
+		state.skip("data/shaders/basic.vs or flat.fs not found");
+	else
+		shader->enable();
+	return shader;
+}
+
+//the value changes every iteration so the redundant uniform filter never skips the call
+BENCH_GL(shader_set_uniform_handle)
+{
+	Shader* shader = getShader(state);
+	if (!shader)
+		return;
+	float v = 0;
+	BENCH_LOOP(state)
+	{
+		v += 1.0f;
+		shader->setUniform(SHADER_VAR("u_color"), Vector4(v, 0.0f, 0.0f, 1.0f));
+	}
+	shader->disable();
+}
+
+BENCH_GL(shader_set_uniform_string)
+{
+	Shader* shader = getShader(state);
+	if (!shader)
+		return;
+	float v = 0;
+	BENCH_LOOP(state)
+	{
+		v += 1.0f;
+		shader->setUniform("u_color", Vector4(v, 0.0f, 0.0f, 1.0f));
+	}
+	shader->disable();
+}
+
+//same value every time, the call never reaches GL
+BENCH_GL(shader_set_uniform_handle_redundant)
+{
+	Shader* shader = getShader(state);
+	if (!shader)
+		return;
+	BENCH_LOOP(state)
+		shader->setUniform(SHADER_VAR("u_color"), Vector4(1.0f, 0.0f, 0.0f, 1.0f));
+	shader->disable();
+}
+
+//enabling the shader already bound, filtered by GLState
+BENCH_GL(shader_enable_same_program)
+{
+	Shader* shader = getShader(state);
+	if (!shader)
+		return;
+	BENCH_LOOP(state)
+		shader->enable();
+	shader->disable();
+}
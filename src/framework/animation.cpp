@@ -1,17 +1,58 @@
 #include "animation.h"
 #include "framework.h"
 #include "utils.h"
+#include "simd.h"
 #include <cassert>
 
 #include "camera.h"
 #include "graphics/shader.h"
 #include "graphics/mesh.h"
+#include "animation_system.h"
+#include "resource_manager.h"
 
 #include <sys/stat.h>
 
+//local transform of a bone as a matrix
+static void composeBone(const sSkeletonPose& pose, int i, Matrix44& m)
+{
+	const float(*c)[128] = pose.channels;
+	m.compose(
+		Vector3(c[sSkeletonPose::TX][i], c[sSkeletonPose::TY][i], c[sSkeletonPose::TZ][i]),
+		Quaternion(c[sSkeletonPose::RX][i], c[sSkeletonPose::RY][i], c[sSkeletonPose::RZ][i], c[sSkeletonPose::RW][i]),
+		Vector3(c[sSkeletonPose::SX][i], c[sSkeletonPose::SY][i], c[sSkeletonPose::SZ][i]));
+}
+
+static void decomposeBone(Matrix44 m, sSkeletonPose& pose, int i)
+{
+	Vector3 translation, scale;
+	Quaternion rotation;
+	m.decompose(translation, rotation, scale);
+	float(*c)[128] = pose.channels;
+	c[sSkeletonPose::TX][i] = translation.x;
+	c[sSkeletonPose::TY][i] = translation.y;
+	c[sSkeletonPose::TZ][i] = translation.z;
+	c[sSkeletonPose::RX][i] = rotation.x;
+	c[sSkeletonPose::RY][i] = rotation.y;
+	c[sSkeletonPose::RZ][i] = rotation.z;
+	c[sSkeletonPose::RW][i] = rotation.w;
+	c[sSkeletonPose::SX][i] = scale.x;
+	c[sSkeletonPose::SY][i] = scale.y;
+	c[sSkeletonPose::SZ][i] = scale.z;
+}
+
+static void setIdentity(sSkeletonPose& pose, int bone)
+{
+	for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
+		pose.channels[c][bone] = (c == sSkeletonPose::RW || c >= sSkeletonPose::SX) ? 1.0f : 0.0f;
+}
+
 Skeleton::Skeleton()
 {
 	num_bones = 0;
+	matrices_dirty = false;
+	layout_id = 0;
+	for (int i = 0; i < 128; ++i)
+		setIdentity(pose, i);
 }
 
 Skeleton::Bone* Skeleton::getBone(const char* name)
@@ -28,6 +69,7 @@ Matrix44& Skeleton::getBoneMatrix(const char* name, bool local)
 	auto it = bones_by_name.find(name);
 	if (it == bones_by_name.end())
 		return none;
+	updateGlobalMatrices();
 	if (local)
 		return bones[it->second].model;
 	return global_bone_matrices[it->second];
@@ -36,16 +78,147 @@ Matrix44& Skeleton::getBoneMatrix(const char* name, bool local)
 void Skeleton::computeFinalBoneMatrices(std::vector<Matrix44>& bone_matrices, Mesh* mesh)
 {
 	assert(mesh);
+	bone_matrices.resize(mesh->bones_info.size());
+	if (bone_matrices.size())
+		computeFinalBoneMatrices(&bone_matrices[0], mesh);
+}
 
+void Skeleton::computeFinalBoneMatrices(Matrix44* bone_matrices, Mesh* mesh)
+{
+	assert(mesh);
+
+	//the skeleton bone of every mesh bone is found once per mesh and bone layout
+	computeFinalBoneMatrices(bone_matrices, mesh->getBoneRemap(this));
+}
+
+void Skeleton::computeFinalBoneMatrices(Matrix44* bone_matrices, const Mesh::sBoneRemap& remap)
+{
 	updateGlobalMatrices();
 
-	bone_matrices.resize(mesh->bones_info.size());
-#pragma omp for  
-	for (int i = 0; i < (int)mesh->bones_info.size(); ++i)
+	int num = (int)remap.bones.size();
+	for (int i = 0; i < num; ++i)
+	{
+		int bone = remap.bones[i];
+		if (bone == -1)
+			bone_matrices[i].setIdentity();
+		else
+			bone_matrices[i] = global_bone_matrices[bone]; //use globals
+	}
+	multiplyMatrices(remap.bind_matrices.data(), bone_matrices, bone_matrices, num);
+}
+
+void blendPoseChannels(const float* const* a, const float* const* b, const float* const* weights, float* const* result, int num_bones, bool slerp)
+{
+	const int TS[] = { sSkeletonPose::TX, sSkeletonPose::TY, sSkeletonPose::TZ, sSkeletonPose::SX, sSkeletonPose::SY, sSkeletonPose::SZ };
+	const float4 zero = splat4(0.0f);
+	const float4 one = splat4(1.0f);
+	const float4 half = splat4(0.5f);
+
+	for (int i = 0; i < num_bones; i += 4)
+	{
+		//translation and scale
+		for (int j = 0; j < 6; ++j)
+		{
+			int c = TS[j];
+			float4 w = load4(weights[j < 3 ? 0 : 2] + i);
+			store4(result[c] + i, madd4(load4(a[c] + i), sub4(one, w), mul4(load4(b[c] + i), w)));
+		}
+
+		float4 w = load4(weights[1] + i);
+		float4 iw = sub4(one, w);
+
+		//rotation
+		float4 ax = load4(a[sSkeletonPose::RX] + i);
+		float4 ay = load4(a[sSkeletonPose::RY] + i);
+		float4 az = load4(a[sSkeletonPose::RZ] + i);
+		float4 aw = load4(a[sSkeletonPose::RW] + i);
+		float4 bx = load4(b[sSkeletonPose::RX] + i);
+		float4 by = load4(b[sSkeletonPose::RY] + i);
+		float4 bz = load4(b[sSkeletonPose::RZ] + i);
+		float4 bw = load4(b[sSkeletonPose::RW] + i);
+
+		float4 d = madd4(ax, bx, madd4(ay, by, madd4(az, bz, mul4(aw, bw))));
+
+		if (slerp)
+		{
+			//corrects the nlerp weight so it follows the slerp curve (max error ~1e-3 rad)
+			//https://zeux.io/2015/07/23/approximating-slerp/
+			float4 ad = abs4(d);
+			float4 A = madd4(ad, madd4(ad, madd4(ad, splat4(-1.43519f), splat4(3.55645f)), splat4(-3.2452f)), splat4(1.0904f));
+			float4 B = madd4(ad, madd4(ad, splat4(0.215638f), splat4(-1.06021f)), splat4(0.848013f));
+			float4 th = sub4(w, half);
+			float4 k = madd4(mul4(A, th), th, B);
+			w = madd4(mul4(mul4(w, th), sub4(w, one)), k, w);
+			iw = sub4(one, w);
+		}
+
+		//take the shortest path
+		float4 wb = select4(lessThan4(d, zero), sub4(zero, w), w);
+
+		float4 rx = madd4(ax, iw, mul4(bx, wb));
+		float4 ry = madd4(ay, iw, mul4(by, wb));
+		float4 rz = madd4(az, iw, mul4(bz, wb));
+		float4 rw = madd4(aw, iw, mul4(bw, wb));
+
+		float4 inv_len = div4(one, sqrt4(madd4(rx, rx, madd4(ry, ry, madd4(rz, rz, mul4(rw, rw))))));
+		store4(result[sSkeletonPose::RX] + i, mul4(rx, inv_len));
+		store4(result[sSkeletonPose::RY] + i, mul4(ry, inv_len));
+		store4(result[sSkeletonPose::RZ] + i, mul4(rz, inv_len));
+		store4(result[sSkeletonPose::RW] + i, mul4(rw, inv_len));
+	}
+}
+
+#define SMALLEST_THREE_RANGE 0.70710678f //the three smallest components of a unit quaternion are in [-1/sqrt(2),1/sqrt(2)]
+
+//stores the three smallest components in 15 bits each, the index of the largest goes in the two spare bits
+static void encodeQuaternion(const float* q, uint16* out)
+{
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+		if (fabs(q[i]) > fabs(q[largest]))
+			largest = i;
+	float sign = q[largest] < 0.0f ? -1.0f : 1.0f; //q and -q are the same rotation, keep the largest positive
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		if (i == largest)
+			continue;
+		float v = clamp((q[i] * sign + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE), 0.0f, 1.0f);
+		out[j++] = (uint16)(v * 32767.0f + 0.5f);
+	}
+	out[0] |= (largest & 1) << 15;
+	out[1] |= (largest >> 1) << 15;
+}
+
+static void decodeQuaternion(const uint16* in, float* q)
+{
+	const float scale = 2.0f * SMALLEST_THREE_RANGE / 32767.0f;
+	int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+	float sum = 0.0f;
+	for (int i = 0, j = 0; i < 4; ++i)
 	{
-		BoneInfo& bone_info = mesh->bones_info[i];
-		bone_matrices[i] = mesh->bind_matrix * bone_info.bind_pose * getBoneMatrix(bone_info.name, false); //use globals
+		if (i == largest)
+			continue;
+		q[i] = (in[j++] & 0x7FFF) * scale - SMALLEST_THREE_RANGE;
+		sum += q[i] * q[i];
 	}
+	q[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+}
+
+//writes the value of one key in the pose of the given bone
+static void decodeKey(const sAnimTrack& track, int type, const uint16* value, sSkeletonPose& pose, int bone)
+{
+	if (type == sAnimTrack::ROTATION)
+	{
+		float q[4];
+		decodeQuaternion(value, q);
+		for (int k = 0; k < 4; ++k)
+			pose.channels[sSkeletonPose::RX + k][bone] = q[k];
+		return;
+	}
+
+	int c = type == sAnimTrack::TRANSLATION ? sSkeletonPose::TX : sSkeletonPose::SX;
+	for (int k = 0; k < 3; ++k)
+		pose.channels[c + k][bone] = track.range_min[k] + value[k] * track.range_extent[k] * (1.0f / 65535.0f);
 }
 
 void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 layer)
@@ -74,46 +247,39 @@ void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 la
 	if (result != a) //copy bone names
 	{
 		memcpy(result->bones, a->bones, sizeof(result->bones)); //copy skeleton structure
-		result->bones_by_name = a->bones_by_name;
+		if (result->layout_id != a->layout_id || result->bones_by_name.empty())
+			result->bones_by_name = a->bones_by_name;
+		result->layout_id = a->layout_id;
 		result->num_bones = a->num_bones;
+		result->pose = a->pose;
 	}
 
+	//bones out of the layer keep the pose of A
+	float weights[128];
+	int num_bones = (result->num_bones + 3) & ~3;
+	for (int i = 0; i < num_bones; ++i)
+		weights[i] = (i < result->num_bones && (layer == 0xFF || (result->bones[i].layer & layer))) ? w : 0.0f;
+
 	//blend bones locally
-#pragma omp for  
-	for (int i = 0; i < result->num_bones; ++i)
+	const float* pa[sSkeletonPose::NUM_CHANNELS];
+	const float* pb[sSkeletonPose::NUM_CHANNELS];
+	float* out[sSkeletonPose::NUM_CHANNELS];
+	for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
 	{
-		Skeleton::Bone& bone = result->bones[i];
-		Skeleton::Bone& boneA = a->bones[i];
-		Skeleton::Bone& boneB = b->bones[i];
-		if (layer != 0xFF && !(bone.layer & layer)) //not in the same layer
-			continue;
-
-		Vector3 translationA, scaleA;
-		Quaternion rotationA;
-		boneA.model.decompose(translationA, rotationA, scaleA);
-
-		Vector3 translationB, scaleB;
-		Quaternion rotationB;
-		boneB.model.decompose(translationB, rotationB, scaleB);
-
-		// blend components
-		Vector3 translation = lerp(translationA, translationB, w);
-		Quaternion rotation = Qslerp(rotationA, rotationB, w);
-		Vector3 scale = lerp(scaleA, scaleB, w);
-
-		// compose final matrix
-		bone.model.compose(translation, rotation, scale);
-
-		//#pragma omp for
-		//for (int j = 0; j < 16; ++j)
-		//	bone.model.m[j] = lerp(boneA.model.m[j], boneB.model.m[j], w);
+		pa[c] = a->pose.channels[c];
+		pb[c] = b->pose.channels[c];
+		out[c] = result->pose.channels[c];
 	}
+	const float* pw[] = { weights, weights, weights };
+	blendPoseChannels(pa, pb, pw, out, num_bones, true);
+	result->matrices_dirty = true;
 }
 
 void Skeleton::renderSkeleton(Camera* camera, Matrix44 model, Vector4 color, bool render_points)
 {
 	Mesh m;
 
+	updateGlobalMatrices();
 	for (int i = 1; i < num_bones; ++i)
 	{
 		Bone& bone = bones[i];
@@ -148,11 +314,43 @@ void Skeleton::applyTransformToBones(const char* root, Matrix44 transform)
 	Bone* bone = getBone(root);
 	if (!bone)
 		return;
-	bone->model = bone->model * transform;
+	updateGlobalMatrices();
+	decomposeBone(bone->model * transform, pose, (int)(bone - bones));
+	matrices_dirty = true;
+}
+
+void Skeleton::updateLayout()
+{
+	//FNV-1a of the names and parents
+	layout_id = 2166136261u;
+	bones_by_name.clear();
+	for (int i = 0; i < num_bones; ++i)
+	{
+		Bone& bone = bones[i];
+		for (const char* c = bone.name; *c; ++c)
+			layout_id = (layout_id ^ (uint8)*c) * 16777619u;
+		layout_id = (layout_id ^ (uint8)bone.parent) * 16777619u;
+		bones_by_name[bone.name] = i;
+	}
+}
+
+void Skeleton::updatePose()
+{
+	for (int i = 0; i < num_bones; ++i)
+		decomposeBone(bones[i].model, pose, i);
+	matrices_dirty = true;
 }
 
 void Skeleton::updateGlobalMatrices()
 {
+	if (!matrices_dirty)
+		return;
+	matrices_dirty = false;
+
+	//compute local matrices
+	for (int i = 0; i < num_bones; ++i)
+		composeBone(pose, i, bones[i].model);
+
 	//compute global matrices
 	global_bone_matrices[0] = bones[0].model;
 	//order dependant
@@ -182,19 +380,39 @@ Animation::Animation()
 {
 	duration = 0.0f;
 	keyframes = NULL;
+	tracks = NULL;
+	tracks_stride = 0;
+	key_tracks = NULL;
+	key_frames = NULL;
+	key_values = NULL;
+	num_keys = 0;
 	num_keyframes = 0;
 	num_animated_bones = 0;
 }
 
 Animation::~Animation()
 {
+	ResourceManager::remove(this);
 	if (keyframes)
 		delete[] keyframes;
+	if (tracks)
+		delete[] tracks;
+	if (key_tracks)
+	{
+		delete[] key_tracks;
+		delete[] key_frames;
+		delete[] key_values;
+	}
 }
 
 void Animation::assignTime(float t, bool loop, bool interpolate, uint8 layers)
 {
-	assert(keyframes && skeleton.num_bones);
+	sample(t, &skeleton, loop, interpolate, layers);
+}
+
+void Animation::sample(float t, Skeleton* result, bool loop, bool interpolate, uint8 layers)
+{
+	assert(key_tracks && result && result->num_bones);
 
 	if (loop)
 	{
@@ -206,33 +424,241 @@ void Animation::assignTime(float t, bool loop, bool interpolate, uint8 layers)
 		t = clamp(t, 0.0f, duration - (1.0f / samples_per_second));
 	float v = samples_per_second * t;
 	int index = (int)clamp(floor(v), 0.0f, (float)(num_keyframes - 1));
-	int index2 = index + 1;
-	if (index2 >= num_keyframes)
-		index2 = 0;
-	float f = v - floor(v);
+	float f = interpolate ? v - floor(v) : 0.0f;
+
+	//find the keys around the frame in every track and decode them
+	sSkeletonPose a, b;
+	float weights[sAnimTrack::NUM_TRACKS][128];
+	int num_bones = (num_animated_bones + 3) & ~3;
+	for (int i = 0; i < num_animated_bones; ++i)
+	{
+		for (int j = 0; j < sAnimTrack::NUM_TRACKS; ++j)
+		{
+			const sAnimTrack& track = key_tracks[i * sAnimTrack::NUM_TRACKS + j];
+			const uint16* frames = key_frames + track.first_key;
+			int k = (int)(std::upper_bound(frames, frames + track.num_keys, (uint16)index) - frames) - 1; //first key is always frame 0
+			int k2 = k + 1;
+			float w = f;
+			if (k2 == (int)track.num_keys) //the last key is the last frame, it blends with the first one
+				k2 = 0;
+			else
+				w = (index + f - frames[k]) / (float)(frames[k2] - frames[k]);
+			decodeKey(track, j, key_values + (track.first_key + k) * 3, a, i);
+			decodeKey(track, j, key_values + (track.first_key + k2) * 3, b, i);
+			weights[j][i] = w;
+		}
+	}
+	for (int i = num_animated_bones; i < num_bones; ++i)
+	{
+		setIdentity(a, i);
+		setIdentity(b, i);
+		for (int j = 0; j < sAnimTrack::NUM_TRACKS; ++j)
+			weights[j][i] = 0.0f;
+	}
 
-	Matrix44* k = keyframes + index * num_animated_bones;
-	Matrix44* k2 = keyframes + index2 * num_animated_bones;
+	//interpolate all the animated bones at once
+	const float* ka[sSkeletonPose::NUM_CHANNELS];
+	const float* kb[sSkeletonPose::NUM_CHANNELS];
+	float* out[sSkeletonPose::NUM_CHANNELS];
+	for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
+	{
+		ka[c] = out[c] = a.channels[c];
+		kb[c] = b.channels[c];
+	}
+	const float* w[] = { weights[0], weights[1], weights[2] };
+	blendPoseChannels(ka, kb, w, out, num_bones, false);
 
-	//compute local bones
-#pragma omp for  
+	//write the animated bones in the pose
 	for (int i = 0; i < num_animated_bones; ++i)
 	{
 		int bone_index = bones_map[i];
-		Skeleton::Bone& bone = skeleton.bones[bone_index];
-		if (layers != 0xFF && !(bone.layer & layers))
+		if (layers != 0xFF && !(result->bones[bone_index].layer & layers))
 			continue;
-		for (int j = 0; j < 16; ++j)
-			bone.model.m[j] = lerp(k[i].m[j], k2[i].m[j], f);
+		for (int c = 0; c < sSkeletonPose::NUM_CHANNELS; ++c)
+			result->pose.channels[c][bone_index] = out[c][i];
+	}
+	result->matrices_dirty = true;
+}
+
+void Animation::buildTracks()
+{
+	assert(keyframes);
+
+	if (tracks)
+		delete[] tracks;
+	tracks_stride = (num_animated_bones + 3) & ~3;
+	tracks = new float[num_keyframes * sSkeletonPose::NUM_CHANNELS * tracks_stride];
+
+	for (int i = 0; i < num_keyframes; ++i)
+	{
+		float* k = tracks + i * sSkeletonPose::NUM_CHANNELS * tracks_stride;
+		float* prev = i > 0 ? k - sSkeletonPose::NUM_CHANNELS * tracks_stride : NULL; //the first keyframe has no previous one
+		for (int j = 0; j < tracks_stride; ++j)
+		{
+			Vector3 translation, scale(1.0f);
+			Quaternion rotation;
+			if (j < num_animated_bones) //the padding stays as identity
+				keyframes[i * num_animated_bones + j].decompose(translation, rotation, scale);
+
+			//keep consecutive keyframes in the same hemisphere so they interpolate the short way
+			if (prev)
+			{
+				float d = rotation.x * prev[sSkeletonPose::RX * tracks_stride + j] + rotation.y * prev[sSkeletonPose::RY * tracks_stride + j] +
+					rotation.z * prev[sSkeletonPose::RZ * tracks_stride + j] + rotation.w * prev[sSkeletonPose::RW * tracks_stride + j];
+				if (d < 0.0f)
+					rotation = Quaternion(-rotation.x, -rotation.y, -rotation.z, -rotation.w);
+			}
+
+			k[sSkeletonPose::TX * tracks_stride + j] = translation.x;
+			k[sSkeletonPose::TY * tracks_stride + j] = translation.y;
+			k[sSkeletonPose::TZ * tracks_stride + j] = translation.z;
+			k[sSkeletonPose::RX * tracks_stride + j] = rotation.x;
+			k[sSkeletonPose::RY * tracks_stride + j] = rotation.y;
+			k[sSkeletonPose::RZ * tracks_stride + j] = rotation.z;
+			k[sSkeletonPose::RW * tracks_stride + j] = rotation.w;
+			k[sSkeletonPose::SX * tracks_stride + j] = scale.x;
+			k[sSkeletonPose::SY * tracks_stride + j] = scale.y;
+			k[sSkeletonPose::SZ * tracks_stride + j] = scale.z;
+		}
 	}
+}
+
+void Animation::compress(float max_translation_error, float max_rotation_error, float max_scale_error)
+{
+	assert(tracks && num_keyframes > 0 && num_keyframes < 65536);
+
+	const int channels[] = { sSkeletonPose::TX, sSkeletonPose::RX, sSkeletonPose::SX };
+	const float max_error[] = { max_translation_error, 0.0f, max_scale_error };
+	const float min_dot = cos(max_rotation_error * 0.5f);
+
+	std::vector<uint16> frames;
+	std::vector<uint16> values;
+	std::vector<int> keys;
 
-	skeleton.updateGlobalMatrices();
+	if (key_tracks)
+	{
+		delete[] key_tracks;
+		delete[] key_frames;
+		delete[] key_values;
+	}
+	key_tracks = new sAnimTrack[num_animated_bones * sAnimTrack::NUM_TRACKS];
+
+	for (int i = 0; i < num_animated_bones; ++i)
+	{
+		for (int j = 0; j < sAnimTrack::NUM_TRACKS; ++j)
+		{
+			int c = channels[j];
+			int num_components = j == sAnimTrack::ROTATION ? 4 : 3;
+			auto sample = [&](int frame, int k) { return tracks[(frame * sSkeletonPose::NUM_CHANNELS + c + k) * tracks_stride + i]; };
+
+			//checks if the frame can be reconstructed interpolating frames start and end
+			auto isValid = [&](int start, int end, int frame) -> bool {
+				float w = start == end ? 0.0f : (frame - start) / (float)(end - start);
+				float r[4];
+				if (j != sAnimTrack::ROTATION)
+				{
+					for (int k = 0; k < num_components; ++k)
+						if (fabs(lerp(sample(start, k), sample(end, k), w) - sample(frame, k)) > max_error[j])
+							return false;
+					return true;
+				}
+				float d = 0.0f, len = 0.0f, dot = 0.0f;
+				for (int k = 0; k < 4; ++k)
+					d += sample(start, k) * sample(end, k);
+				for (int k = 0; k < 4; ++k)
+				{
+					r[k] = sample(start, k) * (1.0f - w) + sample(end, k) * (d < 0.0f ? -w : w); //same nlerp than the sampler
+					len += r[k] * r[k];
+					dot += r[k] * sample(frame, k);
+				}
+				return fabs(dot) >= min_dot * sqrtf(len);
+			};
+
+			//keep only the keys that cannot be interpolated from its neighbours (first and last are always kept)
+			keys.clear();
+			keys.push_back(0);
+			bool constant = true;
+			for (int frame = 1; frame < num_keyframes && constant; ++frame)
+				constant = isValid(0, 0, frame);
+			if (!constant)
+			{
+				int start = 0;
+				for (int end = 2; end < num_keyframes; ++end)
+					for (int frame = start + 1; frame < end; ++frame)
+						if (!isValid(start, end, frame))
+						{
+							start = end - 1;
+							keys.push_back(start);
+							break;
+						}
+				keys.push_back(num_keyframes - 1);
+			}
+
+			sAnimTrack& track = key_tracks[i * sAnimTrack::NUM_TRACKS + j];
+			track.first_key = (uint32)frames.size();
+			track.num_keys = (uint32)keys.size();
+			for (int k = 0; k < 3; ++k)
+			{
+				track.range_min[k] = 0.0f;
+				track.range_extent[k] = 0.0f;
+			}
+			if (j != sAnimTrack::ROTATION)
+				for (int k = 0; k < 3; ++k)
+				{
+					float min_value = sample(keys[0], k), max_value = min_value;
+					for (int key : keys)
+					{
+						min_value = std::min(min_value, sample(key, k));
+						max_value = std::max(max_value, sample(key, k));
+					}
+					track.range_min[k] = min_value;
+					track.range_extent[k] = max_value - min_value;
+				}
+
+			//quantize
+			for (int key : keys)
+			{
+				uint16 value[3];
+				float v[4];
+				for (int k = 0; k < num_components; ++k)
+					v[k] = sample(key, k);
+				if (j == sAnimTrack::ROTATION)
+					encodeQuaternion(v, value);
+				else
+					for (int k = 0; k < 3; ++k)
+						value[k] = track.range_extent[k] > 0.0f ? (uint16)(clamp((v[k] - track.range_min[k]) / track.range_extent[k], 0.0f, 1.0f) * 65535.0f + 0.5f) : 0;
+				frames.push_back((uint16)key);
+				values.insert(values.end(), value, value + 3);
+			}
+		}
+	}
+
+	num_keys = (int)frames.size();
+	key_frames = new uint16[num_keys];
+	key_values = new uint16[num_keys * 3];
+	memcpy(key_frames, frames.data(), sizeof(uint16) * num_keys);
+	memcpy(key_values, values.data(), sizeof(uint16) * num_keys * 3);
+
+	//raw data is not needed anymore
+	delete[] keyframes;
+	delete[] tracks;
+	keyframes = NULL;
+	tracks = NULL;
+}
+
+int Animation::getMemorySize()
+{
+	return num_animated_bones * sAnimTrack::NUM_TRACKS * sizeof(sAnimTrack) + num_keys * sizeof(uint16) * 4;
 }
 
 void Animation::operator = (Animation* anim)
 {
 	memcpy(this, anim, sizeof(Animation));
 	this->keyframes = NULL;
+	this->tracks = NULL;
+	this->key_tracks = NULL;
+	this->key_frames = NULL;
+	this->key_values = NULL;
 }
 
 bool Animation::load(const char* filename)
@@ -261,11 +687,25 @@ bool Animation::load(const char* filename)
 		writeABIN(filename);
 	}
 
-	std::cout << "[OK] Num. Bones: " << skeleton.num_bones << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "[OK] Num. Bones: " << skeleton.num_bones << " Keys: " << num_keys << " (" << getMemorySize() / 1024 << "KB) Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	return true;
 }
 
 struct sAnimHeader {
+	int version;
+	int header_bytes;
+	float duration;
+	float samples_per_second;
+	int num_animated_bones;
+	int num_keyframes;
+	int num_bones;
+	int num_keys;
+	int8 bones_map[128];
+	char extra[16];
+};
+
+//header of version 3, raw keyframes (matrices), only loaded to convert them
+struct sAnimHeaderV3 {
 	int version;
 	int header_bytes;
 	float duration;
@@ -300,6 +740,7 @@ bool Animation::writeABIN(const char* filename)
 	header.num_animated_bones = num_animated_bones;
 	header.num_keyframes = num_keyframes;
 	header.num_bones = skeleton.num_bones;
+	header.num_keys = num_keys;
 	memcpy(header.bones_map, bones_map, sizeof(bones_map));
 
 	//write header
@@ -308,8 +749,10 @@ bool Animation::writeABIN(const char* filename)
 	//write skeleton
 	fwrite((void*)skeleton.bones, sizeof(skeleton.bones), 1, f);
 
-	//write keyframes
-	fwrite((void*)keyframes, sizeof(Matrix44) * num_keyframes * num_animated_bones, 1, f);
+	//write keys
+	fwrite((void*)key_tracks, sizeof(sAnimTrack) * num_animated_bones * sAnimTrack::NUM_TRACKS, 1, f);
+	fwrite((void*)key_frames, sizeof(uint16) * num_keys, 1, f);
+	fwrite((void*)key_values, sizeof(uint16) * num_keys * 3, 1, f);
 
 	fclose(f);
 	return true;
@@ -340,37 +783,78 @@ bool Animation::loadABIN(const char* filename)
 	}
 
 	char* pos = data + 4;
-	sAnimHeader header;
-	memcpy(&header, pos, sizeof(sAnimHeader));
-	pos += sizeof(sAnimHeader);
+	int version = *(int*)pos;
 
-	if (header.version != ANIM_BIN_VERSION || header.header_bytes != sizeof(sAnimHeader))
+	//old version, keyframes are stored as matrices, compress them
+	if (version == 3)
 	{
-		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
-		return false;
-	}
+		sAnimHeaderV3 header;
+		memcpy(&header, pos, sizeof(sAnimHeaderV3));
+		pos += sizeof(sAnimHeaderV3);
+		if (header.header_bytes != sizeof(sAnimHeaderV3))
+		{
+			std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+			return false;
+		}
 
-	//extract header
-	duration = header.duration;
-	samples_per_second = header.samples_per_second;
-	num_animated_bones = header.num_animated_bones;
-	num_keyframes = header.num_keyframes;
-	skeleton.num_bones = header.num_bones;
-	memcpy(bones_map, header.bones_map, sizeof(bones_map));
+		duration = header.duration;
+		samples_per_second = header.samples_per_second;
+		num_animated_bones = header.num_animated_bones;
+		num_keyframes = header.num_keyframes;
+		skeleton.num_bones = header.num_bones;
+		memcpy(bones_map, header.bones_map, sizeof(bones_map));
+
+		memcpy(skeleton.bones, pos, sizeof(skeleton.bones));
+		pos += sizeof(skeleton.bones);
+
+		assert(keyframes == NULL);
+		keyframes = new Matrix44[num_keyframes * num_animated_bones];
+		memcpy(keyframes, pos, sizeof(Matrix44) * num_keyframes * num_animated_bones);
+		pos += sizeof(Matrix44) * num_keyframes * num_animated_bones;
+		buildTracks();
+		compress();
+	}
+	else
+	{
+		sAnimHeader header;
+		memcpy(&header, pos, sizeof(sAnimHeader));
+		pos += sizeof(sAnimHeader);
 
-	//extract skeleton
-	memcpy(skeleton.bones, pos, sizeof(skeleton.bones));
-	pos += sizeof(skeleton.bones);
+		if (header.version != ANIM_BIN_VERSION || header.header_bytes != sizeof(sAnimHeader))
+		{
+			std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+			return false;
+		}
 
-	//extract keyframes
-	assert(keyframes == NULL);
-	keyframes = new Matrix44[num_keyframes * num_animated_bones];
-	memcpy(keyframes, pos, sizeof(Matrix44) * num_keyframes * num_animated_bones);
-	pos += sizeof(Matrix44) * num_keyframes * num_animated_bones;
+		//extract header
+		duration = header.duration;
+		samples_per_second = header.samples_per_second;
+		num_animated_bones = header.num_animated_bones;
+		num_keyframes = header.num_keyframes;
+		num_keys = header.num_keys;
+		skeleton.num_bones = header.num_bones;
+		memcpy(bones_map, header.bones_map, sizeof(bones_map));
+
+		//extract skeleton
+		memcpy(skeleton.bones, pos, sizeof(skeleton.bones));
+		pos += sizeof(skeleton.bones);
+
+		//extract keys
+		assert(key_tracks == NULL);
+		key_tracks = new sAnimTrack[num_animated_bones * sAnimTrack::NUM_TRACKS];
+		key_frames = new uint16[num_keys];
+		key_values = new uint16[num_keys * 3];
+		memcpy(key_tracks, pos, sizeof(sAnimTrack) * num_animated_bones * sAnimTrack::NUM_TRACKS);
+		pos += sizeof(sAnimTrack) * num_animated_bones * sAnimTrack::NUM_TRACKS;
+		memcpy(key_frames, pos, sizeof(uint16) * num_keys);
+		pos += sizeof(uint16) * num_keys;
+		memcpy(key_values, pos, sizeof(uint16) * num_keys * 3);
+		pos += sizeof(uint16) * num_keys * 3;
+	}
 
 	//compute bone names map
-	for (int i = 0; i < skeleton.num_bones; ++i)
-		skeleton.bones_by_name[skeleton.bones[i].name] = i;
+	skeleton.updateLayout();
+	skeleton.updatePose();
 
 	delete[] data;
 	return true;
@@ -459,11 +943,8 @@ bool Animation::loadSKANIM(const char* filename)
 	}
 
 	for (int i = 0; i < skeleton.num_bones; ++i)
-	{
-		Skeleton::Bone& bone = skeleton.bones[i];
-		bone.layer = BODY;
-		skeleton.bones_by_name[bone.name] = i;
-	}
+		skeleton.bones[i].layer = BODY;
+	skeleton.updateLayout();
 
 	//assign layers
 	Skeleton::Bone* hips = skeleton.getBone("mixamorig_Hips");
@@ -478,6 +959,9 @@ bool Animation::loadSKANIM(const char* filename)
 		skeleton.assignLayer(skeleton.getBone("mixamorig_LeftShoulder"), LEFT_ARM);
 	}
 
+	buildTracks();
+	compress();
+	skeleton.updatePose();
 	assignTime(0); //reset pose
 
 	delete[] data;
@@ -485,55 +969,77 @@ bool Animation::loadSKANIM(const char* filename)
 }
 
 
-std::map<std::string, Animation*> Animation::sAnimationsLoaded;
+bool Animation::convertToABIN(const char* filename)
+{
+	Animation anim;
+	if (!anim.load(filename)) //loading an ASCII file already writes the .abin
+		return false;
+
+	std::string s_filename = filename;
+	std::string ext = s_filename.substr(s_filename.find_last_of(".") + 1);
+	if (ext == "abin" || ext == "ABIN")
+		return anim.writeABIN(s_filename.substr(0, s_filename.size() - 5).c_str());
+	return true;
+}
+
 Animation* Animation::Get(const char* filename)
 {
 	assert(filename);
 
 	//check if loaded
-	auto it = sAnimationsLoaded.find(filename);
-	if (it != sAnimationsLoaded.end())
-		return it->second;
+	Animation* anim = (Animation*)ResourceManager::find(RESOURCE_ANIMATION, filename);
+	if (anim)
+		return anim;
 
 	//load it
-	Animation* anim = new Animation();
+	anim = new Animation();
 	if (!anim->load(filename))
 	{
 		delete anim;
 		return NULL;
 	}
 
-	sAnimationsLoaded[filename] = anim;
+	ResourceManager::add(RESOURCE_ANIMATION, filename, anim);
 	return anim;
 }
 
+Animator::Animator(bool managed)
+{
+	if (managed)
+		AnimationSystem::Add(this);
+}
+
 Animator::~Animator()
 {
-	delete current_animation;
-	delete target_animation;
+	//the handles release the animations and the mesh, just make sure the system doesn't update us anymore
+	AnimationSystem::Remove(this);
 }
 
 void Animator::playAnimation(const char* path, bool loop, float transition, bool reset_time)
 {
-	Animation* new_animation = Animation::Get(path);
+	//loaded with a handle, so it can be evicted once no animator plays it
+	AnimationHandle new_animation = ResourceManager::load<Animation>(path);
 
 	if (current_animation) {
 
-		if (new_animation == current_animation) {
-			target_animation = nullptr;
+		if (new_animation.get() == current_animation.get()) {
+			target_animation.reset();
 			return;
 		}
 
 		target_animation = new_animation;
+		target_skeleton = new_animation->skeleton;
 		must_play_loop = loop;
 	}
 	else {
 		current_animation = new_animation;
+		current_skeleton = new_animation->skeleton;
 		playing_loop = loop;
 	}
 
 	transition_counter = 0.0f;
 	transition_time = transition;
+	bone_remap = nullptr; //the skeleton can have other bones
 
 	if (reset_time) {
 		time = 0.0f;
@@ -546,12 +1052,50 @@ void Animator::playAnimation(const char* path, bool loop, float transition, bool
 
 void Animator::stopAnimation()
 {
-	current_animation = nullptr;
-	target_animation = nullptr;
+	current_animation.reset();
+	target_animation.reset();
 	last_loop_animation = nullptr;
 }
 
 void Animator::update(float delta_time)
+{
+	advance(delta_time);
+	evaluate();
+}
+
+void Animator::evaluate()
+{
+	if (!current_animation)
+		return;
+
+	current_animation->sample(time, &current_skeleton, playing_loop);
+
+	if (target_animation) {
+
+		target_animation->sample(target_time, &target_skeleton, must_play_loop);
+
+		blendSkeleton(
+			&current_skeleton,
+			&target_skeleton,
+			transition_counter / transition_time,
+			&blended_skeleton);
+	}
+
+	if (mesh) {
+		//without locking the mesh every frame, only when the bones may have changed
+		Skeleton& skeleton = getCurrentSkeleton();
+		if (!bone_remap || bone_remap_layout != skeleton.layout_id)
+		{
+			bone_remap = &mesh->getBoneRemap(&skeleton);
+			bone_remap_layout = skeleton.layout_id;
+		}
+		bone_matrices.resize(bone_remap->bones.size());
+		if (bone_matrices.size())
+			skeleton.computeFinalBoneMatrices(&bone_matrices[0], *bone_remap);
+	}
+}
+
+void Animator::advance(float delta_time)
 {
 	time += delta_time;
 
@@ -569,25 +1113,19 @@ void Animator::update(float delta_time)
 		playAnimation(last_loop_animation, true, 0.3f, false);
 	}
 
-	current_animation->assignTime(time, playing_loop);
-
 	if (target_animation) {
 
-		target_animation->assignTime(transition_counter, must_play_loop);
+		target_time = transition_counter;
 
 		transition_counter += delta_time;
 
-		blendSkeleton(
-			&current_animation->skeleton,
-			&target_animation->skeleton,
-			transition_counter / transition_time,
-			&blended_skeleton);
-
 		if (transition_counter >= transition_time) {
 			current_animation = target_animation;
+			current_skeleton = target_skeleton;
 			playing_loop = must_play_loop;
 			time = transition_counter; // continue where the transition ended..
-			target_animation = nullptr;
+			target_animation.reset();
+			bone_remap = nullptr;
 			return;
 		}
 	}
@@ -651,5 +1189,5 @@ Skeleton& Animator::getCurrentSkeleton()
 		return blended_skeleton;
 	}
 
-	return current_animation->skeleton;
+	return current_skeleton;
 }
\ No newline at end of file
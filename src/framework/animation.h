@@ -1,13 +1,19 @@
 #pragma once
 
 #include "graphics/mesh.h"
+#include "resource_manager.h"
 #include <cstring>
 #include <algorithm>
 #include <functional>
 
 class Camera;
 
-#define ANIM_BIN_VERSION 3
+#define ANIM_BIN_VERSION 4
+
+//max error allowed when removing keyframes (in world units, radians and scale factor)
+#define ANIM_MAX_TRANSLATION_ERROR 0.001f
+#define ANIM_MAX_ROTATION_ERROR 0.0005f
+#define ANIM_MAX_SCALE_ERROR 0.0001f
 
 //defined layers for every body
 enum BODY_LAYERS {
@@ -21,8 +27,22 @@ enum BODY_LAYERS {
 	HIPS = 128,
 };
 
-//used to compare bone names in the map
-struct cmp_str { bool operator()(char const *a, char const *b) const { return std::strcmp(a, b) < 0; } };
+//local transform of every bone split in channels (translation, rotation quaternion and scale) stored as
+//structure of arrays, this way several bones can be interpolated with a single SIMD instruction
+struct sSkeletonPose {
+	enum { TX, TY, TZ, RX, RY, RZ, RW, SX, SY, SZ, NUM_CHANNELS };
+	float channels[NUM_CHANNELS][128];
+};
+
+//one compressed channel (translation, rotation or scale) of an animated bone, every key is stored as 3 x uint16:
+//translation and scale are quantized in the range of the track, rotations use smallest-three (2 bits index + 3 x 15 bits)
+struct sAnimTrack {
+	enum { TRANSLATION, ROTATION, SCALE, NUM_TRACKS };
+	uint32 first_key;	//index of the first key in key_frames
+	uint32 num_keys;
+	float range_min[3];
+	float range_extent[3];
+};
 
 //This class contains the bone structure hierarchy
 class Skeleton {
@@ -39,24 +59,37 @@ public:
 	Bone bones[128]; //max 128 bones
 	int num_bones;	//number of bones
 
+	sSkeletonPose pose; //local transform of every bone, animations and blending work with this, bone.model is built from it
+	bool matrices_dirty; //the pose changed since the matrices were computed
+
 	Matrix44 global_bone_matrices[128]; //transform of every bone in global coordinates (according to the 0,0,0 and not the parent)
-	std::map<const char*, int, cmp_str> bones_by_name;	//map to get the bone index from its name, required to extract the final bones array
+	std::map<std::string, int, std::less<>> bones_by_name;	//map to get the bone index from its name (found with a const char* without copying it), required to extract the final bones array
+	uint32 layout_id; //hash of the bone names and hierarchy, skeletons with the same bones share it (and the Mesh::getBoneRemap)
 
 	Skeleton();
 
 	Bone* getBone(const char* name); //returns the bone pointer
-	Matrix44& getBoneMatrix(const char* name, bool local = true); //returns the local matrix of a bone
+	Matrix44& getBoneMatrix(const char* name, bool local = true); //returns the local matrix of a bone (read only, changes must go to the pose)
 	void applyTransformToBones(const char* root, Matrix44 transform); //given a bone name and matrix, it multiplies the matrix to the bone
-	void updateGlobalMatrices(); //updates the list of global matrices according to the local matrices
+	void updatePose(); //decomposes the local matrix of every bone in the pose (only after loading)
+	void updateLayout(); //computes the layout_id and the bones_by_name map (only after loading)
+	void updateGlobalMatrices(); //builds the local and global matrices from the pose if it changed
 
 	void renderSkeleton(Camera* camera, Matrix44 model, Vector4 color = Vector4(0.5, 0, 0.5, 1), bool render_points = false); //renders the skeleton with lines
 	void computeFinalBoneMatrices(std::vector<Matrix44>& bones, Mesh* mesh); //fills the std::vector with the bones ready for the shader
+	void computeFinalBoneMatrices(Matrix44* bones, Mesh* mesh); //same but in a preallocated array (one per bone of the mesh)
+	void computeFinalBoneMatrices(Matrix44* bones, const Mesh::sBoneRemap& remap); //with the remap of the mesh for this skeleton already found
 	void assignLayer(Bone* bone, uint8 layer); //assigns a layer to a node and all its children
 };
 
 //this function takes skeleton A and blends it with skeleton B and stores the result in result
 void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 layer = 0xFF);
 
+//interpolates the channels of A and B 4 bones at a time: lerp for translation and scale, nlerp for the rotation.
+//a, b and result are arrays of NUM_CHANNELS pointers (result can alias a), weights are three arrays (translation,
+//rotation and scale) with one value per bone. num_bones must be a multiple of 4 and every channel must have room for it
+void blendPoseChannels(const float* const* a, const float* const* b, const float* const* weights, float* const* result, int num_bones, bool slerp);
+
 //This class contains one animation loaded from a file (it also uses a skeleton to store the current snapshot)
 class Animation {
 public:
@@ -71,24 +104,41 @@ public:
 	int num_keyframes;
 	int8 bones_map[128]; //maps from keyframe data index to bone
 
-	Matrix44* keyframes;
+	Matrix44* keyframes; //only while loading, freed once compressed
+
+	//keyframes decomposed in channels (SoA) as [keyframe][channel][animated bone], input of the compression
+	float* tracks;
+	int tracks_stride; //num_animated_bones rounded up to a multiple of 4
+
+	//compressed keys, sAnimTrack::NUM_TRACKS tracks per animated bone
+	sAnimTrack* key_tracks;
+	uint16* key_frames;	//keyframe index of every key (sorted inside its track)
+	uint16* key_values; //3 x uint16 per key
+	int num_keys;
 
 	Animation();
 	~Animation();	//we need the dtor to remove the keyframes memory
 
 	//change the skeleton to the given pose according to time
 	void assignTime(float time, bool loop = true, bool interpolate = true, uint8 layers = 0xFF);
+	//same but writes the pose in another skeleton (with the same bones), it doesn't modify the animation so it is thread safe
+	void sample(float time, Skeleton* result, bool loop = true, bool interpolate = true, uint8 layers = 0xFF);
 
 	//storage
 	bool load(const char* filename);
 	bool loadSKANIM(const char* filename);
 	bool loadABIN(const char* filename);
 	bool writeABIN(const char* filename);
+	void buildTracks(); //fills tracks from keyframes
+	void compress(float max_translation_error = ANIM_MAX_TRANSLATION_ERROR, float max_rotation_error = ANIM_MAX_ROTATION_ERROR, float max_scale_error = ANIM_MAX_SCALE_ERROR); //builds the keys from tracks and frees the raw keyframes
+	int getMemorySize(); //bytes used by the keys
+
+	//offline conversion of a .skanim (or an old .abin) to the current .abin
+	static bool convertToABIN(const char* filename);
 
-	static std::map<std::string, Animation*> sAnimationsLoaded;
-	static Animation* Get(const char* filename);
+	static Animation* Get(const char* filename); //cached in the ResourceManager
 
-	//copy operator to copy the keyframes
+	//copy operator to copy the header (keys are not copied)
 	void operator = (Animation* anim);
 };
 
@@ -109,16 +159,26 @@ class Animator {
 	float time = 0.0f;
 
 	bool playing_loop = true;
-	Animation* current_animation = nullptr;
+	AnimationHandle current_animation; //the handles keep them loaded while they are played
+	Skeleton current_skeleton; //animations are shared, every animator samples in its own skeletons
 
 	// Transitions
 	bool must_play_loop = true;
 	const char* last_loop_animation = nullptr;
-	Animation* target_animation = nullptr;
+	AnimationHandle target_animation;
+	Skeleton target_skeleton;
 	Skeleton blended_skeleton;
 
 	float transition_counter	= 0.f;
 	float transition_time		= 0.f;
+	float target_time			= 0.f;
+
+	// Skinning
+	MeshHandle mesh;
+	std::vector<Matrix44> bone_matrices;
+	const Mesh::sBoneRemap* bone_remap = nullptr; //of the mesh for the current skeleton, found again when the animations change
+	uint32 bone_remap_layout = 0;
+	int bones_offset = -1; //where the bone matrices are in the SkinningBuffer this frame
 
 	// Callbacks
 	float last_time = 0.0f;
@@ -127,19 +187,31 @@ class Animator {
 
 public:
 
-	Animator() {};
+	// Registered in the AnimationSystem, that updates it every frame, unless managed is false (then call update)
+	Animator(bool managed = true);
 	~Animator();
 
+	//the system keeps its address
+	Animator(const Animator&) = delete;
+	Animator& operator = (const Animator&) = delete;
+
 	void playAnimation(const char* path, bool loop = true, float transition = 0.2f, bool reset_time = true);
 	void stopAnimation();
 
-	void update(float delta_time);
+	void update(float delta_time); //advance + evaluate, for the ones not managed by the AnimationSystem
+	void advance(float delta_time); //updates the time, the transitions and calls the callbacks (main thread only)
+	void evaluate(); //samples the animations and fills the bone matrices if there is a mesh (can run in any thread)
 
 	void addCallback(const std::string& filename, std::function<void(float)> callback, float time);
 	void addCallback(const std::string& filename, std::function<void(float)> callback, int keyframe);
 
-	Animation* getCurrentAnimation() { return target_animation ? target_animation : current_animation; };
+	Animation* getCurrentAnimation() { return target_animation ? target_animation.get() : current_animation.get(); };
 	Skeleton& getCurrentSkeleton();
 
+	void setMesh(Mesh* mesh) { this->mesh = MeshHandle(mesh); bone_remap = nullptr; } //mesh used to compute the bone matrices in evaluate
+	std::vector<Matrix44>& getBoneMatrices() { return bone_matrices; } //ready to upload to the shader
+	void setBonesOffset(int offset) { bones_offset = offset; }
+	int getBonesOffset() { return bones_offset; }
+
 	void setOnFinishAnimation(std::function<void(std::string)> fn) { on_finish_animation = fn; }
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "animation_system.h"
+#include "animation.h"
+#include "job_system.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+std::vector<Animator*> AnimationSystem::sAnimators;
+std::vector<Animator*> AnimationSystem::sAdded;
+bool AnimationSystem::sAdvancing = false;
+
+void AnimationSystem::Add(Animator* animator)
+{
+	if (std::find(sAnimators.begin(), sAnimators.end(), animator) != sAnimators.end())
+		return;
+	//the list is being iterated, it is appended after the callbacks
+	std::vector<Animator*>& list = sAdvancing ? sAdded : sAnimators;
+	if (std::find(list.begin(), list.end(), animator) == list.end())
+		list.push_back(animator);
+}
+
+void AnimationSystem::Remove(Animator* animator)
+{
+	sAdded.erase(std::remove(sAdded.begin(), sAdded.end(), animator), sAdded.end());
+	auto it = std::find(sAnimators.begin(), sAnimators.end(), animator);
+	if (it == sAnimators.end())
+		return;
+	if (sAdvancing)
+		*it = nullptr; //the slot is removed after the callbacks
+	else
+		sAnimators.erase(it);
+}
+
+void AnimationSystem::Update(float delta_time)
+{
+	if (sAnimators.empty())
+		return;
+
+	//callbacks can play animations or touch the game, keep them in the thread of the update (see Game::pipelined)
+	sAdvancing = true;
+	for (size_t i = 0; i < sAnimators.size(); ++i)
+		if (sAnimators[i])
+			sAnimators[i]->advance(delta_time);
+	sAdvancing = false;
+
+	//the animators created and deleted by the callbacks
+	sAnimators.erase(std::remove(sAnimators.begin(), sAnimators.end(), nullptr), sAnimators.end());
+	sAnimators.insert(sAnimators.end(), sAdded.begin(), sAdded.end());
+	sAdded.clear();
+	if (sAnimators.empty())
+		return;
+
+	//one job per animator, the threads that end first steal the rest
+	JobSystem::parallelFor((int)sAnimators.size(), [](int start, int end) {
+		PROFILE_SCOPE("evaluate animators");
+		for (int i = start; i < end; ++i)
+			sAnimators[i]->evaluate();
+	}, 1);
+}
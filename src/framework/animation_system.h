@@ -0,0 +1,29 @@
+/*  AnimationSystem
+	Updates all the registered Animators every frame (they register themselves when created, see Animator). The time, transitions and callbacks are advanced in the
+	main thread and then every animator is sampled, blended and skinned in parallel in the JobSystem.
+*/
+
+#pragma once
+
+#include <vector>
+
+class Animator;
+
+class AnimationSystem {
+public:
+
+	// Register animators to be updated (called by the Animator constructor and destructor).
+	// The callbacks of the animators can create and delete others, the list changes once they are done
+	static void Add(Animator* animator);
+	static void Remove(Animator* animator);
+
+	// Advances and evaluates every registered animator
+	static void Update(float delta_time);
+
+	static std::vector<Animator*>& getAnimators() { return sAnimators; }
+
+private:
+	static std::vector<Animator*> sAnimators;
+	static std::vector<Animator*> sAdded; //while the callbacks run
+	static bool sAdvancing;
+};
@@ -1,6 +1,5 @@
 #include "audio.h"
-
-std::map<std::string, Audio*> Audio::sAudiosLoaded;
+#include "resource_manager.h"
 
 Audio::Audio()
 {
@@ -9,6 +8,7 @@ Audio::Audio()
 
 Audio::~Audio()
 {
+	ResourceManager::remove(this);
 	BASS_SampleFree(sample);
 }
 
@@ -58,19 +58,29 @@ void Audio::Destroy()
 
 Audio* Audio::Get(const std::string& filename, uint8_t flags)
 {
-	std::map<std::string, Audio*>::iterator it = sAudiosLoaded.find(filename);
-	if (it != sAudiosLoaded.end())
-		return it->second;
+	Audio* audio = (Audio*)ResourceManager::find(RESOURCE_AUDIO, filename);
+	if (audio)
+		return audio;
 
-	Audio* audio = new Audio();
-	if (!audio->load(filename, flags))
+	audio = new Audio();
+	if (!audio->load(filename, flags)) {
+		delete audio;
 		return nullptr;
+	}
 
-	sAudiosLoaded[filename] = audio;
+	ResourceManager::add(RESOURCE_AUDIO, filename, audio);
 
 	return audio;
 }
 
+int Audio::getMemorySize()
+{
+	BASS_SAMPLE info;
+	if (!sample || !BASS_SampleGetInfo(sample, &info))
+		return 0;
+	return (int)info.length;
+}
+
 HCHANNEL Audio::Play(const std::string& filename, float volume, uint8_t flags)
 {
 	Audio* audio = Audio::Get(filename, flags);
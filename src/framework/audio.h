@@ -18,9 +18,6 @@ private:
 	// Play audio and return the channel
 	HCHANNEL play(float volume = 1.0f);
 
-	// Map to store audios loaded
-	static std::map<std::string, Audio*> sAudiosLoaded;
-
 public:
 
 	Audio();
@@ -32,9 +29,12 @@ public:
 	// Close BASS
 	static void Destroy();
 
-	// Get from manager map
+	// Get from the ResourceManager (loaded the first time)
 	static Audio* Get(const std::string& filename, uint8_t flags = 0);
 
+	// Bytes of the sample data
+	int getMemorySize();
+
 	// Play Manager API
 	static HCHANNEL Play(const std::string& filename, float volume = 1.0f, uint8_t flags = 0);
 	static HCHANNEL Play3D(const std::string& filename, Vector3 position, float volume = 1.0f);
@@ -17,6 +17,13 @@ void Entity::update(float delta_time)
 	}
 }
 
+void Entity::addRenderItems(RenderSnapshot* snapshot)
+{
+	for (int i = 0; i < children.size(); ++i) {
+		children[i]->addRenderItems(snapshot);
+	}
+}
+
 void Entity::addChild(Entity* child)
 {
 	if (child->parent) {
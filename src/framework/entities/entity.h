@@ -4,6 +4,7 @@
 #include "framework/framework.h"
 
 class Camera;
+class RenderSnapshot;
 
 class Entity {
 
@@ -26,6 +27,7 @@ public:
 	// by derived classes 
 	virtual void render(Camera* camera);
 	virtual void update(float delta_time);
+	virtual void addRenderItems(RenderSnapshot* snapshot); //what render would draw, for the pipelined mode
 
 	// Some useful methods
 	Matrix44 getGlobalMatrix();
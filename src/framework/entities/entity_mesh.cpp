@@ -4,6 +4,7 @@
 #include "graphics/mesh.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
+#include "graphics/render_snapshot.h"
 
 EntityMesh::EntityMesh()
 {
@@ -24,26 +25,39 @@ void EntityMesh::render(Camera* camera)
 	Shader* shader = material.shader;
 	shader->enable();
 
-	shader->setUniform("u_viewprojection", camera->viewprojection_matrix);
-	shader->setUniform("u_color", material.color);
+	shader->setUniform(SHADER_VAR("u_viewprojection"), camera->viewprojection_matrix);
+	shader->setUniform(SHADER_VAR("u_color"), material.color);
 
 	if (material.diffuse) {
-		shader->setUniform("u_texture", material.diffuse, 0);
+		shader->setUniform(SHADER_VAR("u_texture"), material.diffuse, 0);
+		if (material.diffuse_layer != -1)
+			shader->setUniform(SHADER_VAR("u_texture_layer"), (float)material.diffuse_layer);
 	}
 
 	if (isInstanced && !models.empty()) {
-		mesh->renderInstanced(GL_TRIANGLES, models.data(), (int)models.size());
+		mesh->renderInstanced(GL_TRIANGLES, models.data(), (int)models.size(), &material);
 	}
 	else {
-		shader->setUniform("u_model", getGlobalMatrix());
-		mesh->render(GL_TRIANGLES);
+		shader->setUniform(SHADER_VAR("u_model"), getGlobalMatrix());
+		mesh->render(GL_TRIANGLES, -1, 0, &material);
 	}
 
-	shader->disable();
-
+	//the shader stays enabled, the next entity with the same material does not need to change the program
 	Entity::render(camera);
 }
 
+void EntityMesh::addRenderItems(RenderSnapshot* snapshot)
+{
+	if (mesh && material.shader) {
+		if (isInstanced && !models.empty())
+			snapshot->addInstanced(mesh.get(), material, models);
+		else
+			snapshot->add(mesh.get(), material, getGlobalMatrix());
+	}
+
+	Entity::addRenderItems(snapshot);
+}
+
 void EntityMesh::update(float delta_time)
 {
 	Entity::update(delta_time);
@@ -2,6 +2,7 @@
 
 #include "entity.h"
 #include "graphics/material.h"
+#include "framework/resource_manager.h"
 
 class Mesh;
 class Shader;
@@ -9,7 +10,7 @@ class Shader;
 class EntityMesh : public Entity {
 
 public:
-	Mesh* mesh = nullptr;
+	MeshHandle mesh; //referenced while the entity exists, it can be evicted after if it was loaded with a handle
 	Material material;
 
 	bool isInstanced = false;
@@ -21,4 +22,5 @@ public:
 
 	void render(Camera* camera) override;
 	void update(float delta_time) override;
+	void addRenderItems(RenderSnapshot* snapshot) override;
 };
@@ -0,0 +1,35 @@
+//implementation of stb_image, only the formats we load (PNG and JPG)
+//allocations use new[]/delete[] so the decoded pixels can be adopted by Image::data without a copy
+
+#include <cstring>
+#include <cstddef>
+
+static void* stbiNew(size_t size)
+{
+	return new unsigned char[size];
+}
+
+static void stbiDelete(void* p)
+{
+	delete[] (unsigned char*)p;
+}
+
+static void* stbiRealloc(void* p, size_t old_size, size_t new_size)
+{
+	unsigned char* data = new unsigned char[new_size];
+	if (p)
+	{
+		memcpy(data, p, old_size < new_size ? old_size : new_size);
+		delete[] (unsigned char*)p;
+	}
+	return data;
+}
+
+#define STBI_MALLOC(sz) stbiNew(sz)
+#define STBI_FREE(p) stbiDelete(p)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) stbiRealloc(p, oldsz, newsz)
+
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
@@ -1,6 +1,7 @@
 #include "framework.h"
 
 #include "includes.h"
+#include "simd.h"
 #include <cassert>
 #include <cmath> //for sqrt (square root) function
 #include <math.h> //atan2
@@ -561,42 +562,62 @@ Vector3 Matrix44::project(const Vector3& v)
 }
 
 
-//Multiply a matrix by another and returns the result
-Matrix44 Matrix44::operator*(const Matrix44& matrix) const
+//row i of the result is the rows of b weighted by the row i of a (same order of operations than the scalar loop)
+//result can be a or b, every row of a is read before writing it and b is loaded at the start
+static inline void multiplyMatrix(const float* a, const float* b, float* result)
 {
-	Matrix44 ret;
-
-	unsigned int i,j,k;
-	for (i=0;i<4;i++) 	
+	float4 b0 = load4(b), b1 = load4(b + 4), b2 = load4(b + 8), b3 = load4(b + 12);
+	for (int i = 0; i < 16; i += 4)
 	{
-		for (j=0;j<4;j++) 
-		{
-			ret.M[i][j]=0.0;
-			for (k=0;k<4;k++) 
-				ret.M[i][j] += M[i][k] * matrix.M[k][j];
-		}
+		float4 row = mul4(splat4(a[i]), b0);
+		row = madd4(splat4(a[i + 1]), b1, row);
+		row = madd4(splat4(a[i + 2]), b2, row);
+		row = madd4(splat4(a[i + 3]), b3, row);
+		store4(result + i, row);
 	}
+}
+
+//the rows of the matrix weighted by the components of the vector, w = 1 adds the translation
+static inline float4 transformPoint(const float* m, float x, float y, float z)
+{
+	float4 r = mul4(load4(m), splat4(x));
+	r = madd4(load4(m + 4), splat4(y), r);
+	r = madd4(load4(m + 8), splat4(z), r);
+	return add4(r, load4(m + 12));
+}
 
+//Multiply a matrix by another and returns the result
+Matrix44 Matrix44::operator*(const Matrix44& matrix) const
+{
+	Matrix44 ret;
+	multiplyMatrix(m, matrix.m, ret.m);
 	return ret;
 }
 
 //Multiplies a vector by a matrix and returns the new vector
 Vector3 operator * (const Matrix44& matrix, const Vector3& v) 
-{   
-   float x = matrix.m[0] * v.x + matrix.m[4] * v.y + matrix.m[8] * v.z + matrix.m[12]; 
-   float y = matrix.m[1] * v.x + matrix.m[5] * v.y + matrix.m[9] * v.z + matrix.m[13]; 
-   float z = matrix.m[2] * v.x + matrix.m[6] * v.y + matrix.m[10] * v.z + matrix.m[14];
-   return Vector3(x,y,z);
+{
+	float r[4];
+	store4(r, transformPoint(matrix.m, v.x, v.y, v.z));
+	return Vector3(r[0], r[1], r[2]);
 }
 
 //Multiplies a vector by a matrix and returns the new vector
 Vector4 operator * (const Matrix44& matrix, const Vector4& v)
 {
-	float x = matrix.m[0] * v.x + matrix.m[4] * v.y + matrix.m[8] * v.z + v.w * matrix.m[12];
-	float y = matrix.m[1] * v.x + matrix.m[5] * v.y + matrix.m[9] * v.z + v.w * matrix.m[13];
-	float z = matrix.m[2] * v.x + matrix.m[6] * v.y + matrix.m[10] * v.z + v.w * matrix.m[14];
-	float w = matrix.m[3] * v.x + matrix.m[7] * v.y + matrix.m[11] * v.z + v.w * matrix.m[15];
-	return Vector4(x, y, z, w);
+	float4 r = mul4(load4(matrix.m), splat4(v.x));
+	r = madd4(load4(matrix.m + 4), splat4(v.y), r);
+	r = madd4(load4(matrix.m + 8), splat4(v.z), r);
+	r = madd4(load4(matrix.m + 12), splat4(v.w), r);
+	Vector4 result;
+	store4(result.v, r);
+	return result;
+}
+
+void multiplyMatrices(const Matrix44* a, const Matrix44* b, Matrix44* result, int count)
+{
+	for (int i = 0; i < count; ++i)
+		multiplyMatrix(a[i].m, b[i].m, result[i].m);
 }
 
 void Matrix44::setUpAndOrthonormalize(Vector3 up)
@@ -674,75 +695,44 @@ void Matrix44::setFrontAndOrthonormalize(Vector3 front)
 
 bool Matrix44::inverse()
 {
-   unsigned int i, j, k, swap;
-   float t;
-   Matrix44 temp, final;
-   final.setIdentity();
-
-   temp = (*this);
+	//adjugate divided by the determinant, from the 2x2 sub-determinants of the top and bottom rows
+	//no branches or pivoting so the compiler can vectorize it
+	float a0 = m[0] * m[5] - m[1] * m[4], a1 = m[0] * m[6] - m[2] * m[4], a2 = m[0] * m[7] - m[3] * m[4];
+	float a3 = m[1] * m[6] - m[2] * m[5], a4 = m[1] * m[7] - m[3] * m[5], a5 = m[2] * m[7] - m[3] * m[6];
+	float b0 = m[8] * m[13] - m[9] * m[12], b1 = m[8] * m[14] - m[10] * m[12], b2 = m[8] * m[15] - m[11] * m[12];
+	float b3 = m[9] * m[14] - m[10] * m[13], b4 = m[9] * m[15] - m[11] * m[13], b5 = m[10] * m[15] - m[11] * m[14];
 
-   unsigned int m,n;
-   m = n = 4;
-	
-   for (i = 0; i < m; i++)
-   {
-      // Look for largest element in column
-
-      swap = i;
-      for (j = i + 1; j < m; j++)// m or n
-	  {
-		 if ( fabs(temp.M[j][i]) > fabs( temp.M[swap][i]) )
-            swap = j;
-	  }
-   
-      if (swap != i)
-      {
-         // Swap rows.
-         for (k = 0; k < n; k++)
-         {
-			 std::swap( temp.M[i][k],temp.M[swap][k]);
-			 std::swap( final.M[i][k], final.M[swap][k]);
-         }
-      }
-
-      // No non-zero pivot.  The CMatrix is singular, which shouldn't
-      // happen.  This means the user gave us a bad CMatrix.
-
-
-#define MATRIX_SINGULAR_THRESHOLD 0.00001 //change this if you experience problems with matrices
-
-      if ( fabsf(temp.M[i][i]) <= MATRIX_SINGULAR_THRESHOLD)
-	  {
-		  final.setIdentity();
-         return false;
-	  }
-#undef MATRIX_SINGULAR_THRESHOLD
+	float det = a0 * b5 - a1 * b4 + a2 * b3 + a3 * b2 - a4 * b1 + a5 * b0;
 
-      t = 1.0f/temp.M[i][i];
+#define MATRIX_SINGULAR_THRESHOLD 1e-20f //change this if you experience problems with matrices
 
-      for (k = 0; k < n; k++)//m or n
-      {
-         temp.M[i][k] *= t;
-         final.M[i][k] *= t;
-      }
-
-      for (j = 0; j < m; j++) // m or n
-      {
-         if (j != i)
-         {
-            t = temp.M[j][i];
-            for (k = 0; k < n; k++)//m or n
-            {
-               temp.M[j][k] -= (temp.M[i][k] * t);
-               final.M[j][k] -= (final.M[i][k] * t);
-            }
-         }
-      }
-   }
+	if (fabsf(det) <= MATRIX_SINGULAR_THRESHOLD) //singular, the matrix is not changed
+		return false;
+#undef MATRIX_SINGULAR_THRESHOLD
 
-   *this = final;
+	Matrix44 inv;
+	inv.m[0] = m[5] * b5 - m[6] * b4 + m[7] * b3;
+	inv.m[1] = -m[1] * b5 + m[2] * b4 - m[3] * b3;
+	inv.m[2] = m[13] * a5 - m[14] * a4 + m[15] * a3;
+	inv.m[3] = -m[9] * a5 + m[10] * a4 - m[11] * a3;
+	inv.m[4] = -m[4] * b5 + m[6] * b2 - m[7] * b1;
+	inv.m[5] = m[0] * b5 - m[2] * b2 + m[3] * b1;
+	inv.m[6] = -m[12] * a5 + m[14] * a2 - m[15] * a1;
+	inv.m[7] = m[8] * a5 - m[10] * a2 + m[11] * a1;
+	inv.m[8] = m[4] * b4 - m[5] * b2 + m[7] * b0;
+	inv.m[9] = -m[0] * b4 + m[1] * b2 - m[3] * b0;
+	inv.m[10] = m[12] * a4 - m[13] * a2 + m[15] * a0;
+	inv.m[11] = -m[8] * a4 + m[9] * a2 - m[11] * a0;
+	inv.m[12] = -m[4] * b3 + m[5] * b1 - m[6] * b0;
+	inv.m[13] = m[0] * b3 - m[1] * b1 + m[2] * b0;
+	inv.m[14] = -m[12] * a3 + m[13] * a1 - m[14] * a0;
+	inv.m[15] = m[8] * a3 - m[9] * a1 + m[10] * a0;
+
+	float4 inv_det = splat4(1.0f / det);
+	for (int i = 0; i < 16; i += 4)
+		store4(m + i, mul4(load4(inv.m + i), inv_det));
 
-   return true;
+	return true;
 }
 
 void Matrix44::multGL()
@@ -1145,12 +1135,12 @@ Quaternion Qlerp(const Quaternion &q1, const Quaternion &q2, float t)
 	Quaternion ret;
 	//ret = q1 + t*(q2-q1);
 
-	Quaternion b;
+	//the sign of q2 is flipped if they are more than 90 degrees apart
+	float4 b = load4(q2.q);
 	if (DotProduct(q1, q2)< 0.0f)
-		b.set(-q2.x, -q2.y, -q2.z, -q2.w);
-	else b = q2;
+		b = sub4(splat4(0.0f), b);
 
-	ret = q1*(1 - t) + b*t;
+	store4(ret.q, add4(mul4(load4(q1.q), splat4(1 - t)), mul4(b, splat4(t))));
 
 	ret.normalize();
 	return ret;
@@ -1182,7 +1172,9 @@ Quaternion Qslerp(const Quaternion &q1, const Quaternion &q2, float t)
 		sina = sinf(angle);
 		sinat = sinf(angle*t);
 		sinaomt = sinf(angle*(1 - t));
-		return (q1*sinaomt + q3*sinat) * (1.0f / sina);
+		Quaternion result;
+		store4(result.q, mul4(add4(mul4(load4(q1.q), splat4(sinaomt)), mul4(load4(q3.q), splat4(sinat))), splat4(1.0f / sina)));
+		return result;
 	}
 
 	//if the angle is small, use linear interpolation
@@ -1392,23 +1384,15 @@ float signedDistanceToPlane( const Vector4& plane, const Vector3& point )
 	return dot(plane.sV4Data.xyz, point) + plane.w;
 }
 
-const Vector3 corners[] = { {1,1,1},  {1,1,-1},  {1,-1,1},  {1,-1,-1},  {-1,1,1},  {-1,1,-1},  {-1,-1,1},  {-1,-1,-1} };
-
+//instead of transforming the 8 corners: the center is transformed and the new halfsize is the old one
+//projected over the absolute value of the axis of the matrix (same box, without the min/max)
 BoundingBox transformBoundingBox(const Matrix44 m, const BoundingBox& box)
 {
-	Vector3 box_min(10000000.0f,1000000.0f, 1000000.0f);
-	Vector3 box_max(-10000000.0f, -1000000.0f, -1000000.0f);
-
-	for (int i = 0; i < 8; ++i)
-	{
-		Vector3 corner = corners[i];
-		corner = box.halfsize * corner;
-		corner = corner + box.center;
-		corner = m * corner;
-		box_min.setMin(corner);
-		box_max.setMax(corner);
-	}
-
-	Vector3 halfsize = (box_max - box_min) * 0.5;
-	return BoundingBox(box_max - halfsize, halfsize );
+	float center[4], halfsize[4];
+	store4(center, transformPoint(m.m, box.center.x, box.center.y, box.center.z));
+	float4 h = mul4(abs4(load4(m.m)), splat4(box.halfsize.x));
+	h = madd4(abs4(load4(m.m + 4)), splat4(box.halfsize.y), h);
+	h = madd4(abs4(load4(m.m + 8)), splat4(box.halfsize.z), h);
+	store4(halfsize, h);
+	return BoundingBox(Vector3(center[0], center[1], center[2]), Vector3(halfsize[0], halfsize[1], halfsize[2]));
 }
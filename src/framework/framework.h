@@ -296,7 +296,10 @@ class Matrix44
 //Operators, they are our friends
 //Matrix44 operator * ( const Matrix44& a, const Matrix44& b );
 Vector3 operator * (const Matrix44& matrix, const Vector3& v);
-Vector4 operator * (const Matrix44& matrix, const Vector4& v); 
+Vector4 operator * (const Matrix44& matrix, const Vector4& v);
+
+//batch version of the operator for the skinning matrices, the result can be one of the inputs
+void multiplyMatrices(const Matrix44* a, const Matrix44* b, Matrix44* result, int count); //result[i] = a[i] * b[i]
 
 
 class Quaternion
@@ -0,0 +1,263 @@
+#include "job_system.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+
+struct sJobQueue {
+	std::mutex mutex;
+	std::deque<sJob> jobs; //the owner pops from the back, the others steal from the front
+};
+
+//state shared with the workers
+static struct sJobPool {
+	std::vector<std::thread> threads;
+	std::vector<sJobQueue*> queues; //one per thread of the pool, 0 is the thread that called Init
+	sJobQueue background; //only taken by the workers
+	std::atomic<int> queued{ 0 }; //jobs in all the queues
+	std::atomic<int> sleeping{ 0 };
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	bool initialized = false;
+	bool quit = false;
+
+	~sJobPool() { JobSystem::Destroy(); }
+} pool;
+
+static thread_local int t_thread_index = -1;
+
+void JobSystem::Init(int num_threads)
+{
+	if (pool.initialized)
+		return;
+	pool.initialized = true;
+	pool.quit = false;
+
+	//hardware_concurrency can be 0 (unknown), and there is always one worker as only they run the background jobs
+	if (num_threads < 0)
+		num_threads = (int)std::thread::hardware_concurrency() - 1;
+	num_threads = std::max(num_threads, 1);
+
+	t_thread_index = 0;
+	for (int i = 0; i <= num_threads; ++i)
+		pool.queues.push_back(new sJobQueue());
+	for (int i = 1; i <= num_threads; ++i)
+		pool.threads.push_back(std::thread(workerLoop, i));
+}
+
+void JobSystem::Destroy()
+{
+	if (!pool.initialized)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.quit = true;
+	}
+	pool.work_ready.notify_all();
+	for (std::thread& thread : pool.threads)
+		thread.join();
+	pool.threads.clear();
+
+	//nobody may be waiting for them, but their counters must reach zero
+	while (runNext(true));
+
+	for (sJobQueue* queue : pool.queues)
+		delete queue;
+	pool.queues.clear();
+	pool.initialized = false;
+	t_thread_index = -1;
+}
+
+int JobSystem::getNumThreads()
+{
+	return (int)pool.threads.size() + 1;
+}
+
+int JobSystem::getThreadIndex()
+{
+	return t_thread_index;
+}
+
+void JobSystem::run(const std::function<void()>& function, JobCounter* counter, JobCounter* dependency)
+{
+	if (!pool.initialized)
+		Init();
+
+	sJob job = { function, counter, false };
+	if (counter)
+		counter->pending++;
+
+	if (dependency)
+	{
+		//the counter is decremented with the lock taken, so it cannot reach zero while we check it
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->pending)
+		{
+			dependency->continuations.push_back(std::move(job));
+			return;
+		}
+	}
+	submit(job);
+}
+
+void JobSystem::runBackground(const std::function<void()>& function, JobCounter* counter)
+{
+	if (!pool.initialized)
+		Init();
+
+	sJob job = { function, counter, true };
+	if (counter)
+		counter->pending++;
+	submit(job);
+}
+
+void JobSystem::submit(sJob& job)
+{
+	sJobQueue* queue = job.background ? &pool.background : pool.queues[std::max(t_thread_index, 0)];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->jobs.push_back(std::move(job));
+	}
+	pool.queued++;
+
+	//a worker going to sleep checks queued after increasing sleeping, so one of the two sees the other
+	if (pool.sleeping)
+	{
+		{ std::lock_guard<std::mutex> lock(pool.mutex); }
+		pool.work_ready.notify_one();
+	}
+}
+
+bool JobSystem::runNext(bool background)
+{
+	if (!pool.queued)
+		return false;
+
+	sJob job;
+	bool found = false;
+	int num_queues = (int)pool.queues.size();
+
+	//own jobs first, the newest one
+	if (t_thread_index >= 0)
+	{
+		sJobQueue* queue = pool.queues[t_thread_index];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->jobs.empty())
+		{
+			job = std::move(queue->jobs.back());
+			queue->jobs.pop_back();
+			found = true;
+		}
+	}
+
+	//steal the oldest of another thread, starting by the next one so the thieves spread
+	for (int i = 1; i <= num_queues && !found; ++i)
+	{
+		int index = (std::max(t_thread_index, 0) + i) % num_queues;
+		if (index == t_thread_index)
+			continue;
+		sJobQueue* queue = pool.queues[index];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->jobs.empty())
+		{
+			job = std::move(queue->jobs.front());
+			queue->jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found && background)
+	{
+		std::lock_guard<std::mutex> lock(pool.background.mutex);
+		if (!pool.background.jobs.empty())
+		{
+			job = std::move(pool.background.jobs.front());
+			pool.background.jobs.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found)
+		return false;
+
+	pool.queued--;
+	job.function();
+	if (job.counter)
+		finish(job.counter);
+	return true;
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+	std::vector<sJob> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		assert(counter->pending > 0);
+		if (--counter->pending == 0)
+			continuations.swap(counter->continuations);
+	}
+	//the counter can be gone from here on (the waiter returns as soon as it is zero)
+	for (sJob& job : continuations)
+		submit(job);
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+	if (!counter)
+		return;
+	while (counter->pending)
+	{
+		if (!runNext(false))
+			std::this_thread::yield();
+	}
+	//the thread that finished the last job may still hold the lock
+	std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+void JobSystem::parallelFor(int count, const std::function<void(int start, int end)>& function, int batch_size)
+{
+	if (count <= 0)
+		return;
+	if (!pool.initialized)
+		Init();
+
+	//some batches per thread, so the ones that end first can steal the rest
+	if (batch_size <= 0)
+		batch_size = std::max(count / (getNumThreads() * 4), 1);
+	if (batch_size >= count || pool.threads.empty())
+	{
+		function(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (int start = batch_size; start < count; start += batch_size)
+	{
+		int end = std::min(start + batch_size, count);
+		run([&function, start, end] { function(start, end); }, &counter);
+	}
+	function(0, batch_size);
+	wait(&counter);
+}
+
+void JobSystem::workerLoop(int index)
+{
+	t_thread_index = index;
+	Profiler::setThreadName(("job worker " + std::to_string(index)).c_str());
+	while (true)
+	{
+		if (runNext(true))
+			continue;
+
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		pool.sleeping++;
+		pool.work_ready.wait(lock, [] { return pool.quit || pool.queued > 0; });
+		pool.sleeping--;
+		if (pool.quit)
+			return;
+	}
+}
@@ -0,0 +1,82 @@
+/*  JobSystem
+	Fixed pool of worker threads shared by the whole framework (animation, texture decoding...) so the systems don't
+	create their own threads. Every worker has its own queue: it takes the jobs it submitted from the back (still hot
+	in the cache) and when it runs out it steals from the front of the others. Jobs submitted from other threads go
+	to the queue of the main thread, that the workers also steal from. Long jobs (loading files) go to a separate
+	queue that only the workers take when they have nothing else, so a thread waiting for its work never gets stuck
+	running one of them.
+
+	Jobs are grouped with a JobCounter, waiting for it keeps the thread running jobs instead of sleeping:
+
+		JobCounter counter;
+		JobSystem::run([&] { loadSomething(); }, &counter);
+		JobSystem::run([&] { useIt(); }, NULL, &counter); //runs once the first one is done
+		JobSystem::wait(&counter);
+
+		JobSystem::parallelFor((int)items.size(), [&](int start, int end) { ... }); //blocks until every item is done
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class JobCounter;
+
+struct sJob {
+	std::function<void()> function;
+	JobCounter* counter; //decremented when the job ends, can be NULL
+	bool background;
+};
+
+class JobCounter {
+public:
+	JobCounter() {}
+	JobCounter(const JobCounter&) = delete;
+
+	bool isDone() const { return pending == 0; }
+	int getPending() const { return pending; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> pending{ 0 };
+	std::mutex mutex;
+	std::vector<sJob> continuations; //jobs waiting for this counter to reach zero
+};
+
+class JobSystem {
+public:
+
+	// Creates the workers (by default one less than the number of cores, the thread that waits also works), called automatically on the first job.
+	// There is at least one, even in a single core, as the background jobs only run in the workers
+	static void Init(int num_threads = -1);
+
+	// Stops and joins the workers, the jobs still queued are run in the calling thread
+	static void Destroy();
+
+	// Queues a job, if dependency is set it is not queued until that counter reaches zero
+	static void run(const std::function<void()>& function, JobCounter* counter = NULL, JobCounter* dependency = NULL);
+
+	// Queues a long job (IO, decoding...), it may wait until a worker is free of the frame jobs
+	static void runBackground(const std::function<void()>& function, JobCounter* counter = NULL);
+
+	// Runs jobs (except the background ones) until the counter reaches zero
+	static void wait(JobCounter* counter);
+
+	// Calls function with ranges of [0,count) in parallel and waits, batch_size 0 splits it in some batches per thread
+	static void parallelFor(int count, const std::function<void(int start, int end)>& function, int batch_size = 0);
+
+	// Workers plus the thread that waits
+	static int getNumThreads();
+
+	// Index of the calling thread in the pool (0 is the one that called Init, -1 for threads outside the pool)
+	static int getThreadIndex();
+
+private:
+	static void submit(sJob& job);
+	static bool runNext(bool background);
+	static void finish(JobCounter* counter);
+	static void workerLoop(int index);
+};
@@ -0,0 +1,408 @@
+#include "profiler.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+bool Profiler::enabled = true;
+bool Profiler::show_overlay = false;
+
+#define PROFILER_REPORT_INTERVAL 250 //ms between updates of the overlay text
+
+//zones of one thread, the main thread takes them at the end of every frame
+struct sThreadBuffer {
+	int index;
+	std::string name;
+	std::mutex mutex;
+	std::vector<sProfilerZone> zones; //closed
+	std::vector<sProfilerZone> stack; //open
+};
+
+struct sCounter {
+	const char* name;
+	double time;
+	double value;
+};
+
+struct sGPUQuery {
+	GLuint query;
+	const char* name;
+};
+
+static struct sProfilerState {
+	std::chrono::high_resolution_clock::time_point epoch = std::chrono::high_resolution_clock::now();
+
+	std::mutex mutex; //protects threads and next_thread
+	std::vector<sThreadBuffer*> threads; //never freed, a thread can end before its zones are collected
+	sThreadBuffer* main_thread = NULL;
+	int next_thread = 1; //0 is the main thread
+
+	double frame_start = 0;
+	std::vector<sProfilerZone> last_frame;
+	double last_frame_start = 0;
+	double last_frame_end = 0;
+
+	//GPU queries, a ring of frames so the results are read when they are ready
+	std::vector<sGPUQuery> gpu_frames[PROFILER_GPU_FRAMES];
+	std::vector<GLuint> free_queries;
+	std::map<std::string, double> gpu_times; //last result of every GPU zone
+	int gpu_frame = 0;
+	bool gpu_zone_open = false;
+
+	std::string report;
+	double report_time = -1e9;
+
+	//capture
+	int capture_frames = 0; //frames left
+	std::string capture_filename;
+	std::vector<sProfilerZone> capture_zones;
+	std::vector<sCounter> capture_counters;
+	std::vector<std::pair<double, double>> capture_frame_times;
+} s_profiler;
+
+static thread_local sThreadBuffer* t_buffer = NULL;
+
+static sThreadBuffer* getThreadBuffer()
+{
+	if (t_buffer)
+		return t_buffer;
+	t_buffer = new sThreadBuffer();
+	std::lock_guard<std::mutex> lock(s_profiler.mutex);
+	t_buffer->index = s_profiler.next_thread++;
+	s_profiler.threads.push_back(t_buffer);
+	return t_buffer;
+}
+
+double Profiler::getTime()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - s_profiler.epoch).count();
+}
+
+void Profiler::beginZone(const char* name)
+{
+	if (!enabled)
+		return;
+	sThreadBuffer* buffer = getThreadBuffer();
+	sProfilerZone zone;
+	zone.name = name;
+	zone.thread = buffer->index;
+	zone.depth = (int)buffer->stack.size();
+	zone.start = getTime();
+	zone.end = zone.start;
+	buffer->stack.push_back(zone);
+}
+
+void Profiler::endZone()
+{
+	sThreadBuffer* buffer = t_buffer;
+	if (!buffer || buffer->stack.empty()) //opened while disabled
+		return;
+	sProfilerZone zone = std::move(buffer->stack.back());
+	buffer->stack.pop_back();
+	zone.end = getTime();
+	zone.thread = buffer->index; //the main thread can be renamed after the zone started
+
+	std::lock_guard<std::mutex> lock(buffer->mutex);
+	buffer->zones.push_back(zone);
+}
+
+void Profiler::beginGPUZone(const char* name)
+{
+	beginZone(name);
+	if (!enabled || !glGenQueries || s_profiler.gpu_zone_open)
+		return; //GL_TIME_ELAPSED queries cannot be nested, the inner one is only a CPU zone
+	assert(t_buffer == s_profiler.main_thread && "GPU zones only in the main thread");
+
+	GLuint query = 0;
+	if (s_profiler.free_queries.size())
+	{
+		query = s_profiler.free_queries.back();
+		s_profiler.free_queries.pop_back();
+	}
+	else
+		glGenQueries(1, &query);
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	s_profiler.gpu_frames[s_profiler.gpu_frame].push_back({ query, name });
+	s_profiler.gpu_zone_open = true;
+	t_buffer->stack.back().gpu_time = 0; //marks it as GPU zone
+}
+
+void Profiler::endGPUZone()
+{
+	sThreadBuffer* buffer = t_buffer;
+	if (s_profiler.gpu_zone_open && buffer && buffer->stack.size() && buffer->stack.back().gpu_time == 0)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		s_profiler.gpu_zone_open = false;
+	}
+	endZone();
+}
+
+void Profiler::setZoneDetail(const std::string& detail)
+{
+	if (t_buffer && t_buffer->stack.size())
+		t_buffer->stack.back().detail = detail;
+}
+
+void Profiler::beginFrame()
+{
+	//the thread that runs the frames is the main thread (index 0), even if it opened zones before
+	sThreadBuffer* buffer = getThreadBuffer();
+	if (s_profiler.main_thread != buffer)
+	{
+		buffer->index = 0;
+		buffer->name = "main";
+		s_profiler.main_thread = buffer;
+	}
+	s_profiler.frame_start = getTime();
+}
+
+//the results of the oldest frame in the ring, those queries are reused by the next frame
+static void readGPUQueries()
+{
+	s_profiler.gpu_frame = (s_profiler.gpu_frame + 1) % PROFILER_GPU_FRAMES;
+	std::vector<sGPUQuery>& queries = s_profiler.gpu_frames[s_profiler.gpu_frame];
+	std::map<std::string, double> frame_times;
+	for (sGPUQuery& gpu_query : queries)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(gpu_query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) //if not, the result is lost instead of waiting
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(gpu_query.query, GL_QUERY_RESULT, &nanoseconds);
+			frame_times[gpu_query.name] += nanoseconds * 0.000001;
+		}
+		s_profiler.free_queries.push_back(gpu_query.query);
+	}
+	queries.clear();
+	for (auto& it : frame_times)
+		s_profiler.gpu_times[it.first] = it.second;
+}
+
+static void buildReport()
+{
+	std::vector<sProfilerZone>& zones = s_profiler.last_frame;
+	std::string& report = s_profiler.report;
+	char line[256];
+
+	snprintf(line, sizeof(line), "Frame: %.2f ms\n", s_profiler.last_frame_end - s_profiler.last_frame_start);
+	report = line;
+
+	//main thread, siblings with the same name are merged (shown with the number of calls)
+	struct sEntry { std::string path; const char* name; int depth; double time; double gpu_time; int count; };
+	std::vector<sEntry> entries;
+	std::vector<std::string> path;
+	for (sProfilerZone& zone : zones)
+	{
+		if (zone.thread != 0)
+			continue;
+		path.resize(zone.depth);
+		path.push_back(zone.name);
+		std::string key = join(path, "/");
+		auto it = std::find_if(entries.begin(), entries.end(), [&](sEntry& e) { return e.path == key; });
+		if (it == entries.end())
+		{
+			entries.push_back({ key, zone.name, zone.depth, 0, -1, 0 });
+			it = entries.end() - 1;
+		}
+		it->time += zone.end - zone.start;
+		it->count++;
+		if (zone.gpu_time >= 0)
+			it->gpu_time = std::max(it->gpu_time, 0.0) + zone.gpu_time;
+	}
+	for (sEntry& entry : entries)
+	{
+		int len = snprintf(line, sizeof(line), "%*s%s: %.2f ms", entry.depth * 2, "", entry.name, entry.time);
+		if (entry.count > 1)
+			len += snprintf(line + len, sizeof(line) - len, " (x%d)", entry.count);
+		if (entry.gpu_time >= 0)
+			len += snprintf(line + len, sizeof(line) - len, "  GPU: %.2f ms", entry.gpu_time);
+		report += std::string(line) + "\n";
+	}
+
+	//other threads, only the total of the outer zones
+	std::map<std::pair<int, std::string>, std::pair<double, int>> others;
+	for (sProfilerZone& zone : zones)
+		if (zone.thread != 0 && zone.depth == 0)
+		{
+			std::pair<double, int>& total = others[{ zone.thread, zone.name }];
+			total.first += zone.end - zone.start;
+			total.second++;
+		}
+	for (auto& it : others)
+	{
+		snprintf(line, sizeof(line), "[thread %d] %s: %.2f ms (x%d)\n", it.first.first, it.first.second.c_str(), it.second.first, it.second.second);
+		report += line;
+	}
+}
+
+static std::string escapeJSON(const std::string& str)
+{
+	std::string result;
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+		if ((unsigned char)c >= 32)
+			result += c;
+	}
+	return result;
+}
+
+//Chrome Trace Event Format, times in microseconds
+static void writeCapture()
+{
+	FILE* f = fopen(s_profiler.capture_filename.c_str(), "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write the profiler capture: " << s_profiler.capture_filename << std::endl;
+		return;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"TJE\"}}");
+	{
+		std::lock_guard<std::mutex> lock(s_profiler.mutex);
+		for (sThreadBuffer* buffer : s_profiler.threads)
+		{
+			std::string name = buffer->name.size() ? buffer->name : "thread " + std::to_string(buffer->index);
+			fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", buffer->index, escapeJSON(name).c_str());
+			fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", buffer->index, buffer->index);
+		}
+	}
+
+	for (int i = 0; i < (int)s_profiler.capture_frame_times.size(); ++i)
+	{
+		std::pair<double, double>& frame = s_profiler.capture_frame_times[i];
+		fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"frame\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"index\":%d}}", frame.first * 1000.0, (frame.second - frame.first) * 1000.0, i);
+	}
+
+	for (sProfilerZone& zone : s_profiler.capture_zones)
+	{
+		fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", escapeJSON(zone.name).c_str(), zone.thread, zone.start * 1000.0, (zone.end - zone.start) * 1000.0);
+		if (zone.gpu_time >= 0 && zone.detail.size())
+			fprintf(f, ",\"args\":{\"gpu_ms\":%.3f,\"detail\":\"%s\"}", zone.gpu_time, escapeJSON(zone.detail).c_str());
+		else if (zone.gpu_time >= 0)
+			fprintf(f, ",\"args\":{\"gpu_ms\":%.3f}", zone.gpu_time);
+		else if (zone.detail.size())
+			fprintf(f, ",\"args\":{\"detail\":\"%s\"}", escapeJSON(zone.detail).c_str());
+		fprintf(f, "}");
+	}
+
+	for (sCounter& counter : s_profiler.capture_counters)
+		fprintf(f, ",\n{\"ph\":\"C\",\"name\":\"%s\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%g}}", escapeJSON(counter.name).c_str(), counter.time * 1000.0, counter.value);
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	std::cout << " + Profiler capture saved: " << s_profiler.capture_filename << " (" << s_profiler.capture_frame_times.size() << " frames, " << s_profiler.capture_zones.size() << " zones)" << std::endl;
+	s_profiler.capture_zones.clear();
+	s_profiler.capture_counters.clear();
+	s_profiler.capture_frame_times.clear();
+}
+
+void Profiler::startCapture(int num_frames, const std::string& filename)
+{
+	if (num_frames <= 0 || isCapturing())
+		return;
+	s_profiler.capture_frames = num_frames;
+	s_profiler.capture_filename = filename;
+	std::cout << " + Profiler capturing " << num_frames << " frames..." << std::endl;
+}
+
+bool Profiler::isCapturing()
+{
+	return s_profiler.capture_frames > 0;
+}
+
+void Profiler::addCounter(const char* name, double value)
+{
+	if (s_profiler.capture_frames > 0)
+		s_profiler.capture_counters.push_back({ name, getTime(), value });
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	sThreadBuffer* buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(s_profiler.mutex);
+	buffer->name = name;
+}
+
+void Profiler::endFrame()
+{
+	double now = getTime();
+	std::vector<sProfilerZone> zones;
+	{
+		std::lock_guard<std::mutex> lock(s_profiler.mutex);
+		for (sThreadBuffer* buffer : s_profiler.threads)
+		{
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			zones.insert(zones.end(), buffer->zones.begin(), buffer->zones.end());
+			buffer->zones.clear();
+		}
+	}
+	std::sort(zones.begin(), zones.end(), [](const sProfilerZone& a, const sProfilerZone& b) {
+		return a.thread != b.thread ? a.thread < b.thread : a.start < b.start;
+	});
+
+	if (glGenQueries)
+		readGPUQueries();
+	for (sProfilerZone& zone : zones)
+		if (zone.gpu_time >= 0)
+		{
+			auto it = s_profiler.gpu_times.find(zone.name);
+			zone.gpu_time = it != s_profiler.gpu_times.end() ? it->second : 0;
+		}
+
+	s_profiler.last_frame.swap(zones);
+	s_profiler.last_frame_start = s_profiler.frame_start;
+	s_profiler.last_frame_end = now;
+
+	if (s_profiler.capture_frames > 0)
+	{
+		const std::vector<sProfilerZone>& frame = s_profiler.last_frame;
+		s_profiler.capture_zones.insert(s_profiler.capture_zones.end(), frame.begin(), frame.end());
+		s_profiler.capture_frame_times.push_back({ s_profiler.frame_start, now });
+		if (--s_profiler.capture_frames == 0)
+			writeCapture();
+	}
+
+	if (now - s_profiler.report_time > PROFILER_REPORT_INTERVAL)
+	{
+		buildReport();
+		s_profiler.report_time = now;
+	}
+}
+
+const std::vector<sProfilerZone>& Profiler::getLastFrame()
+{
+	return s_profiler.last_frame;
+}
+
+double Profiler::getLastFrameStart()
+{
+	return s_profiler.last_frame_start;
+}
+
+double Profiler::getLastFrameEnd()
+{
+	return s_profiler.last_frame_end;
+}
+
+const std::string& Profiler::getReport()
+{
+	return s_profiler.report;
+}
+
+void Profiler::drawOverlay(float x, float y, float scale)
+{
+	if (show_overlay && s_profiler.report.size())
+		drawText(x, y, s_profiler.report, Vector3(1, 1, 0), scale);
+}
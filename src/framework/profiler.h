@@ -0,0 +1,84 @@
+/*  Profiler
+	Measures zones of code every frame. CPU zones use a high resolution clock and can be opened from any thread
+	(every thread writes in its own buffer), GPU zones wrap a GL_TIME_ELAPSED query that is read some frames later
+	so the CPU never waits for the GPU. Use the macros:
+
+		PROFILE_SCOPE("update");		//until the end of the block
+		PROFILE_GPU_SCOPE("scene");		//CPU and GPU time, main thread only and GPU zones cannot be nested
+
+	The overlay (F2 in the game) shows the hierarchy of the main thread and the total time of the other threads.
+	Frames can also be captured to a Chrome trace file (F3 in the game or --trace in the command line), open it in
+	chrome://tracing or ui.perfetto.dev to see every thread in its own track.
+*/
+
+#pragma once
+
+#include "includes.h"
+
+#include <string>
+#include <vector>
+
+#define PROFILER_GPU_FRAMES 3 //frames the GPU queries wait before being read
+
+struct sProfilerZone {
+	const char* name; //must be a literal (or live forever)
+	int thread; //0 is the main thread
+	int depth; //nesting level in its thread
+	double start; //ms since the profiler started
+	double end;
+	double gpu_time = -1; //ms, -1 if it is not a GPU zone (or the result is not ready)
+	std::string detail; //optional, like the file being loaded
+};
+
+class Profiler {
+public:
+	static bool enabled;
+	static bool show_overlay;
+
+	// Called by the main loop around every frame
+	static void beginFrame();
+	static void endFrame();
+
+	static void beginZone(const char* name);
+	static void endZone();
+	static void beginGPUZone(const char* name);
+	static void endGPUZone();
+	static void setZoneDetail(const std::string& detail); //of the last zone opened in this thread
+
+	// ms since the profiler started
+	static double getTime();
+
+	// Zones of the last complete frame, sorted by thread and start (the GPU times are the ones of some frames before)
+	static const std::vector<sProfilerZone>& getLastFrame();
+	static double getLastFrameStart();
+	static double getLastFrameEnd();
+
+	// Saves the zones and counters of the next frames as a Chrome trace (JSON), the file is written when they are done
+	static void startCapture(int num_frames, const std::string& filename = "trace.json");
+	static bool isCapturing();
+
+	// Value shown as a counter track in the captures (draw calls, triangles...), main thread only
+	static void addCounter(const char* name, double value);
+
+	// Name of the calling thread in the captures
+	static void setThreadName(const char* name);
+
+	// Text used by the overlay (refreshed a few times per second so it can be read)
+	static const std::string& getReport();
+	static void drawOverlay(float x, float y, float scale = 1);
+};
+
+struct ProfileScope {
+	ProfileScope(const char* name) { Profiler::beginZone(name); }
+	~ProfileScope() { Profiler::endZone(); }
+};
+
+struct ProfileGPUScope {
+	ProfileGPUScope(const char* name) { Profiler::beginGPUZone(name); }
+	~ProfileGPUScope() { Profiler::endGPUZone(); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) ProfileGPUScope PROFILE_CONCAT(profile_gpu_scope_, __LINE__)(name)
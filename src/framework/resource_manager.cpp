@@ -0,0 +1,485 @@
+#include "resource_manager.h"
+#include "animation.h"
+#include "audio.h"
+#include "profiler.h"
+#include "graphics/mesh.h"
+#include "graphics/shader.h"
+#include "graphics/texture.h"
+#include "graphics/texture_streamer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#define EVICTION_DELAY_FRAMES 2 //the snapshot of the pipelined render can still point to them
+
+struct sResource {
+	eResourceType type;
+	std::vector<std::string> names;
+	int refs = 0; //handles and resources depending on it
+	bool pinned = false; //got outside a load, someone may keep the pointer
+	long last_used = 0;
+	size_t cpu_bytes = 0;
+	size_t gpu_bytes = 0;
+	std::vector<ResourceRef> dependencies;
+};
+
+struct sResourceBudget {
+	size_t cpu_bytes;
+	size_t gpu_bytes;
+};
+
+static bool s_destroyed = false; //resources deleted at exit after the registry
+
+static struct sResourceData {
+	std::recursive_mutex mutex; //a release can happen while removing another resource
+	std::unordered_map<void*, sResource> resources;
+	std::map<std::string, void*> names[NUM_RESOURCE_TYPES];
+	long frame = 0;
+
+	//sum of the sizes of every type, kept up to date on add, updateSize, remove and evict
+	size_t cpu_bytes[NUM_RESOURCE_TYPES] = {};
+	size_t gpu_bytes[NUM_RESOURCE_TYPES] = {};
+
+	sResourceBudget budgets[NUM_RESOURCE_TYPES] = {
+		{ 512 * 1024 * 1024, 256 * 1024 * 1024 }, //meshes keep a copy in RAM
+		{ 0, 512 * 1024 * 1024 },
+		{ 0, 0 },
+		{ 0, 0 },
+		{ 0, 0 }
+	};
+
+	~sResourceData() { s_destroyed = true; }
+} data;
+
+static thread_local std::vector<std::vector<void*>> t_loads; //resources used by every load in progress
+
+static const char* s_type_names[NUM_RESOURCE_TYPES] = { "meshes", "textures", "shaders", "animations", "audios" };
+static const char* s_counter_names[NUM_RESOURCE_TYPES] = { "meshes MB", "textures MB", "shaders MB", "animations MB", "audios MB" }; //the profiler keeps the pointer
+
+//the resource is used by the innermost load of this thread
+static void trackUse(void* resource)
+{
+	if (t_loads.empty())
+		return;
+	std::vector<void*>& used = t_loads.back();
+	if (std::find(used.begin(), used.end(), resource) == used.end())
+		used.push_back(resource);
+}
+
+template<class T>
+static size_t getVectorBytes(const std::vector<T>& v)
+{
+	return v.size() * sizeof(T);
+}
+
+static void computeMeshBytes(Mesh* mesh, sResource& entry)
+{
+	struct sStream { size_t bytes; unsigned int vbo; };
+	sStream streams[] = {
+		{ getVectorBytes(mesh->vertices), mesh->vertices_vbo_id },
+		{ getVectorBytes(mesh->normals), mesh->normals_vbo_id },
+		{ getVectorBytes(mesh->uvs), mesh->uvs_vbo_id },
+		{ getVectorBytes(mesh->uvs1), mesh->uvs1_vbo_id },
+		{ getVectorBytes(mesh->colors), mesh->colors_vbo_id },
+		{ getVectorBytes(mesh->interleaved), mesh->interleaved_vbo_id },
+		{ getVectorBytes(mesh->indices), mesh->indices_vbo_id },
+		{ getVectorBytes(mesh->bones), mesh->bones_vbo_id },
+		{ getVectorBytes(mesh->weights), mesh->weights_vbo_id }
+	};
+	entry.cpu_bytes = 0;
+	entry.gpu_bytes = 0;
+	for (sStream& stream : streams)
+	{
+		entry.cpu_bytes += stream.bytes;
+		if (stream.vbo)
+			entry.gpu_bytes += stream.bytes;
+	}
+}
+
+//estimated from the format, the driver may pad it
+static void computeTextureBytes(Texture* texture, sResource& entry)
+{
+	entry.cpu_bytes = texture->image.data ? texture->image.width * texture->image.height * texture->image.bytes_per_pixel : 0;
+	entry.gpu_bytes = 0;
+	if (!texture->texture_id || texture->shared_id || texture->is_view)
+		return;
+
+	double bytes_per_pixel;
+	switch (texture->format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: bytes_per_pixel = 0.5; break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: bytes_per_pixel = 1; break;
+	default:
+	{
+		int channels = 4;
+		if (texture->format == GL_RED || texture->format == GL_DEPTH_COMPONENT)
+			channels = 1;
+		else if (texture->format == GL_RG)
+			channels = 2;
+		else if (texture->format == GL_RGB)
+			channels = 3;
+		int component = 1;
+		if (texture->type == GL_FLOAT || texture->type == GL_UNSIGNED_INT)
+			component = 4;
+		else if (texture->type == GL_HALF_FLOAT || texture->type == GL_UNSIGNED_SHORT)
+			component = 2;
+		bytes_per_pixel = channels * component;
+	}
+	}
+
+	double bytes = texture->width * texture->height * std::max(texture->depth, 1.0f) * bytes_per_pixel;
+	if (texture->texture_type == GL_TEXTURE_CUBE_MAP)
+		bytes *= 6;
+	if (texture->mipmaps)
+		bytes *= 4.0 / 3.0;
+	entry.gpu_bytes = (size_t)bytes;
+}
+
+static void computeBytes(void* resource, sResource& entry)
+{
+	switch (entry.type)
+	{
+	case RESOURCE_MESH: computeMeshBytes((Mesh*)resource, entry); break;
+	case RESOURCE_TEXTURE: computeTextureBytes((Texture*)resource, entry); break;
+	case RESOURCE_ANIMATION: entry.cpu_bytes = ((Animation*)resource)->getMemorySize(); break;
+	case RESOURCE_AUDIO: entry.cpu_bytes = ((Audio*)resource)->getMemorySize(); break;
+	default: break; //the shaders are tiny
+	}
+}
+
+//replaces the size of the resource in the totals of its type
+static void setBytes(void* resource, sResource& entry)
+{
+	data.cpu_bytes[entry.type] -= entry.cpu_bytes;
+	data.gpu_bytes[entry.type] -= entry.gpu_bytes;
+	computeBytes(resource, entry);
+	data.cpu_bytes[entry.type] += entry.cpu_bytes;
+	data.gpu_bytes[entry.type] += entry.gpu_bytes;
+}
+
+//takes the resource out of the totals and the names, it must be erased after
+static void forget(sResource& entry)
+{
+	data.cpu_bytes[entry.type] -= entry.cpu_bytes;
+	data.gpu_bytes[entry.type] -= entry.gpu_bytes;
+	for (std::string& name : entry.names)
+		data.names[entry.type].erase(name);
+}
+
+static bool isOverBudget(int type)
+{
+	sResourceBudget& budget = data.budgets[type];
+	return (budget.cpu_bytes && data.cpu_bytes[type] > budget.cpu_bytes) || (budget.gpu_bytes && data.gpu_bytes[type] > budget.gpu_bytes);
+}
+
+static bool canEvict(void* resource, const sResource& entry)
+{
+	if (entry.refs || entry.pinned || data.frame - entry.last_used < EVICTION_DELAY_FRAMES)
+		return false;
+	//a texture still streaming would be written after being deleted
+	if (entry.type == RESOURCE_TEXTURE && TextureStreamer::isLoading((Texture*)resource))
+		return false;
+	return true;
+}
+
+static void deleteResource(eResourceType type, void* resource)
+{
+	switch (type)
+	{
+	case RESOURCE_MESH: delete (Mesh*)resource; break;
+	case RESOURCE_TEXTURE: delete (Texture*)resource; break;
+	case RESOURCE_SHADER: delete (Shader*)resource; break;
+	case RESOURCE_ANIMATION: delete (Animation*)resource; break;
+	case RESOURCE_AUDIO: delete (Audio*)resource; break;
+	default: assert(0 && "unknown resource type");
+	}
+}
+
+ResourceRef::ResourceRef(void* resource) : pointer(resource)
+{
+	if (pointer)
+		ResourceManager::addRef(pointer);
+}
+
+ResourceRef::ResourceRef(const ResourceRef& other) : pointer(other.pointer)
+{
+	if (pointer)
+		ResourceManager::addRef(pointer);
+}
+
+ResourceRef::ResourceRef(ResourceRef&& other) noexcept : pointer(other.pointer)
+{
+	other.pointer = nullptr;
+}
+
+ResourceRef::~ResourceRef()
+{
+	reset();
+}
+
+ResourceRef& ResourceRef::operator = (ResourceRef other)
+{
+	std::swap(pointer, other.pointer);
+	return *this;
+}
+
+void ResourceRef::reset()
+{
+	if (pointer)
+		ResourceManager::release(pointer);
+	pointer = nullptr;
+}
+
+void ResourceManager::add(eResourceType type, const std::string& name, void* resource, std::vector<ResourceRef> dependencies)
+{
+	assert(resource);
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+
+	auto inserted = data.resources.try_emplace(resource);
+	sResource& entry = inserted.first->second;
+	if (inserted.second)
+		entry.type = type;
+	assert(entry.type == type && "resource registered with another type");
+	entry.last_used = data.frame;
+	if (t_loads.empty())
+		entry.pinned = true;
+
+	//the name may belong to another resource (reloaded), it loses it
+	auto name_it = data.names[type].find(name);
+	if (name_it != data.names[type].end() && name_it->second != resource)
+	{
+		std::vector<std::string>& names = data.resources[name_it->second].names;
+		names.erase(std::remove(names.begin(), names.end(), name), names.end());
+	}
+	data.names[type][name] = resource;
+	if (std::find(entry.names.begin(), entry.names.end(), name) == entry.names.end())
+		entry.names.push_back(name);
+
+	for (ResourceRef& dependency : dependencies)
+		if (dependency.getPointer() != resource)
+			entry.dependencies.push_back(std::move(dependency));
+
+	setBytes(resource, entry);
+	trackUse(resource);
+}
+
+bool ResourceManager::contains(eResourceType type, const std::string& name)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	return data.names[type].find(name) != data.names[type].end();
+}
+
+void* ResourceManager::find(eResourceType type, const std::string& name)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	auto it = data.names[type].find(name);
+	if (it == data.names[type].end())
+		return NULL;
+
+	sResource& entry = data.resources[it->second];
+	entry.last_used = data.frame;
+	if (t_loads.empty())
+		entry.pinned = true;
+	trackUse(it->second);
+	return it->second;
+}
+
+void ResourceManager::remove(void* resource)
+{
+	if (s_destroyed)
+		return;
+
+	std::vector<ResourceRef> dependencies; //released once unlocked
+	{
+		std::lock_guard<std::recursive_mutex> lock(data.mutex);
+		auto it = data.resources.find(resource);
+		if (it == data.resources.end())
+			return;
+		sResource& entry = it->second;
+		forget(entry);
+		dependencies.swap(entry.dependencies);
+		data.resources.erase(it);
+	}
+}
+
+void ResourceManager::updateSize(void* resource)
+{
+	if (s_destroyed)
+		return;
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	auto it = data.resources.find(resource);
+	if (it != data.resources.end())
+		setBytes(resource, it->second);
+}
+
+std::vector<void*> ResourceManager::getAll(eResourceType type)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	std::vector<void*> result;
+	for (auto& it : data.resources)
+		if (it.second.type == type)
+			result.push_back(it.first);
+	return result;
+}
+
+void ResourceManager::addRef(void* resource)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	auto it = data.resources.find(resource);
+	if (it == data.resources.end())
+		return; //not managed
+	it->second.refs++;
+	it->second.last_used = data.frame;
+}
+
+void ResourceManager::release(void* resource)
+{
+	if (s_destroyed)
+		return;
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	auto it = data.resources.find(resource);
+	if (it == data.resources.end())
+		return;
+	assert(it->second.refs > 0 && "resource released more times than referenced");
+	it->second.refs--;
+	it->second.last_used = data.frame;
+}
+
+void ResourceManager::beginLoad()
+{
+	t_loads.push_back(std::vector<void*>());
+}
+
+std::vector<ResourceRef> ResourceManager::endLoad()
+{
+	assert(t_loads.size() && "endLoad without beginLoad");
+	std::vector<void*> used;
+	used.swap(t_loads.back());
+	t_loads.pop_back();
+
+	std::vector<ResourceRef> result;
+	for (void* resource : used)
+		result.push_back(ResourceRef(resource));
+	return result;
+}
+
+void ResourceManager::setBudget(eResourceType type, size_t cpu_bytes, size_t gpu_bytes)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	data.budgets[type] = { cpu_bytes, gpu_bytes };
+}
+
+void ResourceManager::update()
+{
+	PROFILE_SCOPE("resource manager");
+	data.frame++;
+	evict(false);
+
+	for (int i = 0; i < NUM_RESOURCE_TYPES; ++i)
+	{
+		eResourceType type = (eResourceType)i;
+		Profiler::addCounter(s_counter_names[i], (getCPUBytes(type) + getGPUBytes(type)) / (1024.0 * 1024.0));
+	}
+}
+
+void ResourceManager::evictUnused()
+{
+	evict(true);
+}
+
+void ResourceManager::evict(bool all)
+{
+	std::vector<std::pair<eResourceType, void*>> evicted;
+	std::vector<ResourceRef> dependencies; //released once unlocked, they may be evicted in the next frames
+	{
+		std::lock_guard<std::recursive_mutex> lock(data.mutex);
+
+		//the candidates are only searched when a type is over its budget
+		bool over_budget[NUM_RESOURCE_TYPES];
+		bool any_over_budget = all;
+		for (int i = 0; i < NUM_RESOURCE_TYPES; ++i)
+		{
+			over_budget[i] = isOverBudget(i);
+			any_over_budget = any_over_budget || over_budget[i];
+		}
+		if (!any_over_budget)
+			return;
+
+		std::vector<std::pair<long, void*>> candidates[NUM_RESOURCE_TYPES];
+		for (auto& it : data.resources)
+		{
+			sResource& entry = it.second;
+			if ((all || over_budget[entry.type]) && canEvict(it.first, entry))
+				candidates[entry.type].push_back(std::make_pair(entry.last_used, it.first));
+		}
+
+		for (int i = 0; i < NUM_RESOURCE_TYPES; ++i)
+		{
+			std::sort(candidates[i].begin(), candidates[i].end()); //least recently used first
+			for (auto& candidate : candidates[i])
+			{
+				if (!all && !isOverBudget(i))
+					break;
+				sResource& entry = data.resources[candidate.second];
+				forget(entry);
+				for (ResourceRef& dependency : entry.dependencies)
+					dependencies.push_back(std::move(dependency));
+				data.resources.erase(candidate.second);
+				evicted.push_back(std::make_pair((eResourceType)i, candidate.second));
+			}
+		}
+	}
+
+	for (auto& it : evicted)
+		deleteResource(it.first, it.second);
+}
+
+int ResourceManager::getCount(eResourceType type)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	int count = 0;
+	for (auto& it : data.resources)
+		if (it.second.type == type)
+			count++;
+	return count;
+}
+
+size_t ResourceManager::getCPUBytes(eResourceType type)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	return data.cpu_bytes[type];
+}
+
+size_t ResourceManager::getGPUBytes(eResourceType type)
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	return data.gpu_bytes[type];
+}
+
+const char* ResourceManager::getTypeName(eResourceType type)
+{
+	return s_type_names[type];
+}
+
+std::string ResourceManager::getReport()
+{
+	std::lock_guard<std::recursive_mutex> lock(data.mutex);
+	const double MB = 1024.0 * 1024.0;
+	std::string report = "Resources     count     RAM MB    VRAM MB    budget RAM/VRAM MB\n";
+	char line[256];
+	for (int i = 0; i < NUM_RESOURCE_TYPES; ++i)
+	{
+		eResourceType type = (eResourceType)i;
+		sResourceBudget& budget = data.budgets[i];
+		std::string cpu_budget = budget.cpu_bytes ? std::to_string((int)(budget.cpu_bytes / MB)) : "-";
+		std::string gpu_budget = budget.gpu_bytes ? std::to_string((int)(budget.gpu_bytes / MB)) : "-";
+		snprintf(line, sizeof(line), "%-12s %6d %10.2f %10.2f    %s/%s\n", s_type_names[i], getCount(type),
+			getCPUBytes(type) / MB, getGPUBytes(type) / MB, cpu_budget.c_str(), gpu_budget.c_str());
+		report += line;
+	}
+	return report;
+}
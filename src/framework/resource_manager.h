@@ -0,0 +1,137 @@
+/*  ResourceManager
+	Single registry of every resource loaded by name (meshes, textures, shaders, animations and audios), the Get
+	functions of every class use it as their cache. It keeps how many handles point to every resource, when it was
+	used last and how many bytes it takes in RAM and VRAM, so the unused ones can be freed when a type goes over its budget.
+
+	Resources got with a plain Get outside a load are pinned: the raw pointer may be stored anywhere, so they are never
+	evicted (it works like the old maps). To let the manager free them, load them with a handle:
+
+		MeshHandle mesh = ResourceManager::load<Mesh>("data/box.obj"); //referenced while the handle exists
+
+		ResourceManager::beginLoad();
+		createSomeEntities(); //every Get inside is recorded
+		std::vector<ResourceRef> used = ResourceManager::endLoad(); //hold them, once dropped they can be evicted
+
+	A resource loaded while loading another one (the textures of a mesh) is referenced by it until it is evicted.
+	Eviction only happens in update (main thread), least recently used first, and never the frames right after the
+	resource was used, as the pipelined render can still point to it.
+
+	The sizes are computed when a resource is added, anything that changes them later (an upload to VRAM, a
+	texture turned into a view) must call updateSize.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Mesh;
+class Texture;
+class Shader;
+class Animation;
+class Audio;
+
+enum eResourceType {
+	RESOURCE_MESH,
+	RESOURCE_TEXTURE,
+	RESOURCE_SHADER,
+	RESOURCE_ANIMATION,
+	RESOURCE_AUDIO,
+	NUM_RESOURCE_TYPES
+};
+
+//holds a reference to a registered resource (of any type)
+class ResourceRef {
+public:
+	ResourceRef() {}
+	explicit ResourceRef(void* resource);
+	ResourceRef(const ResourceRef& other);
+	ResourceRef(ResourceRef&& other) noexcept;
+	~ResourceRef();
+
+	ResourceRef& operator = (ResourceRef other);
+
+	void reset();
+	void* getPointer() const { return pointer; }
+	explicit operator bool() const { return pointer != nullptr; }
+
+protected:
+	void* pointer = nullptr;
+};
+
+template<class T>
+class ResourceHandle : public ResourceRef {
+public:
+	ResourceHandle() {}
+	explicit ResourceHandle(T* resource) : ResourceRef(resource) {}
+
+	T* get() const { return (T*)pointer; }
+	T* operator -> () const { return (T*)pointer; }
+	T& operator * () const { return *(T*)pointer; }
+};
+
+typedef ResourceHandle<Mesh> MeshHandle;
+typedef ResourceHandle<Texture> TextureHandle;
+typedef ResourceHandle<Shader> ShaderHandle;
+typedef ResourceHandle<Animation> AnimationHandle;
+typedef ResourceHandle<Audio> AudioHandle;
+
+class ResourceManager {
+public:
+
+	// Registers a resource with a name (calling it again with another name adds an alias), used by the loaders.
+	// It keeps the dependencies referenced until the resource is evicted
+	static void add(eResourceType type, const std::string& name, void* resource, std::vector<ResourceRef> dependencies = {});
+
+	// The resource with that name (NULL if it is not loaded), it counts as a use
+	static void* find(eResourceType type, const std::string& name);
+
+	// If there is a resource with that name, without counting as a use (so it can be asked from a job)
+	static bool contains(eResourceType type, const std::string& name);
+
+	// Forgets the resource without deleting it, called by the destructors
+	static void remove(void* resource);
+
+	// Computes again the RAM and VRAM of the resource after changing it (nothing if it is not registered)
+	static void updateSize(void* resource);
+
+	// Every resource of the type (once, even with aliases)
+	static std::vector<void*> getAll(eResourceType type);
+
+	static void addRef(void* resource);
+	static void release(void* resource);
+
+	// Records the resources used until endLoad, which returns them referenced (the new ones are not pinned)
+	static void beginLoad();
+	static std::vector<ResourceRef> endLoad();
+
+	// Calls T::Get inside a load, so the resource can be evicted once no handle points to it
+	template<class T, class... Args>
+	static ResourceHandle<T> load(Args... args)
+	{
+		beginLoad();
+		ResourceHandle<T> handle(T::Get(args...));
+		endLoad();
+		return handle;
+	}
+
+	// Bytes of RAM and VRAM the type can use before its unused resources are evicted, 0 is no limit
+	static void setBudget(eResourceType type, size_t cpu_bytes, size_t gpu_bytes);
+
+	// Evicts over the budgets, once per frame from the main thread with the GL context
+	static void update();
+
+	// Frees every unused resource that can be evicted now (for example after unloading a level)
+	static void evictUnused();
+
+	static int getCount(eResourceType type);
+	static size_t getCPUBytes(eResourceType type);
+	static size_t getGPUBytes(eResourceType type);
+	static const char* getTypeName(eResourceType type);
+
+	// Table with the resident bytes and budgets of every type
+	static std::string getReport();
+
+private:
+	static void evict(bool all);
+};
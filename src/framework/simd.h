@@ -0,0 +1,73 @@
+/*  SIMD helpers
+	Small wrapper over 4-wide float registers (SSE on x86, NEON on ARM64, plain floats elsewhere).
+	Used by the hot loops that process several elements with one instruction (animation sampling, etc).
+*/
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define TJE_SIMD_SSE
+	#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define TJE_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#include <cmath>
+
+#if defined(TJE_SIMD_SSE)
+
+typedef __m128 float4;
+
+inline float4 load4(const float* p) { return _mm_loadu_ps(p); }
+inline void store4(float* p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 splat4(float v) { return _mm_set1_ps(v); }
+inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+inline float4 sqrt4(float4 a) { return _mm_sqrt_ps(a); }
+inline float4 min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+inline float4 lessThan4(float4 a, float4 b) { return _mm_cmplt_ps(a, b); } //mask with all bits set where a < b
+inline float4 select4(float4 mask, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); } //mask ? a : b
+
+#elif defined(TJE_SIMD_NEON)
+
+typedef float32x4_t float4;
+
+inline float4 load4(const float* p) { return vld1q_f32(p); }
+inline void store4(float* p, float4 v) { vst1q_f32(p, v); }
+inline float4 splat4(float v) { return vdupq_n_f32(v); }
+inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 div4(float4 a, float4 b) { return vdivq_f32(a, b); }
+inline float4 sqrt4(float4 a) { return vsqrtq_f32(a); }
+inline float4 min4(float4 a, float4 b) { return vminq_f32(a, b); }
+inline float4 max4(float4 a, float4 b) { return vmaxq_f32(a, b); }
+inline float4 lessThan4(float4 a, float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+inline float4 select4(float4 mask, float4 a, float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+
+#else
+
+//fallback, the compiler may still vectorize it
+struct float4 { float v[4]; };
+
+inline float4 load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void store4(float* p, float4 v) { p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3]; }
+inline float4 splat4(float v) { return { { v, v, v, v } }; }
+inline float4 add4(float4 a, float4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+inline float4 sub4(float4 a, float4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+inline float4 mul4(float4 a, float4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+inline float4 div4(float4 a, float4 b) { return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+inline float4 sqrt4(float4 a) { return { { sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3]) } }; }
+inline float4 min4(float4 a, float4 b) { return { { fminf(a.v[0], b.v[0]), fminf(a.v[1], b.v[1]), fminf(a.v[2], b.v[2]), fminf(a.v[3], b.v[3]) } }; }
+inline float4 max4(float4 a, float4 b) { return { { fmaxf(a.v[0], b.v[0]), fmaxf(a.v[1], b.v[1]), fmaxf(a.v[2], b.v[2]), fmaxf(a.v[3], b.v[3]) } }; }
+inline float4 lessThan4(float4 a, float4 b) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i] ? 1.0f : 0.0f; return r; }
+inline float4 select4(float4 mask, float4 a, float4 b) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return r; }
+
+#endif
+
+inline float4 madd4(float4 a, float4 b, float4 c) { return add4(mul4(a, b), c); } //a * b + c
+inline float4 abs4(float4 a) { return max4(a, sub4(splat4(0.0f), a)); }
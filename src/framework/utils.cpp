@@ -12,6 +12,8 @@
 #include "framework/camera.h"
 #include "graphics/shader.h"
 #include "graphics/mesh.h"
+#include "graphics/gl_state.h"
+#include "profiler.h"
 
 #include "extra/stb_easy_font.h"
 
@@ -148,8 +150,8 @@ bool drawText(float x, float y, std::string text, Vector3 c, float scale )
 	Matrix44 projection_matrix;
 	projection_matrix.ortho(0, Game::instance->window_width / scale, Game::instance->window_height / scale, 0, -1, 1);
 
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
+	GLState::disable(GL_DEPTH_TEST);
+	GLState::disable(GL_CULL_FACE);
 
 	glMatrixMode(GL_MODELVIEW);
 	glPushMatrix();
@@ -159,6 +161,7 @@ bool drawText(float x, float y, std::string text, Vector3 c, float scale )
 	glLoadMatrixf(projection_matrix.m);
 
 	glColor3f(c.x, c.y, c.z);
+	GLState::bindVertexArray(0); //client arrays are part of the VAO state
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glVertexPointer(2, GL_FLOAT, 16, buffer);
 	glDrawArrays(GL_QUADS, 0, num_quads * 4);
@@ -168,8 +171,8 @@ bool drawText(float x, float y, std::string text, Vector3 c, float scale )
 	glMatrixMode(GL_MODELVIEW);
 	glPopMatrix();
 
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::enable(GL_CULL_FACE);
 
 	return true;
 }
@@ -247,8 +250,14 @@ std::string getGPUStats()
 	}
 
 	std::string str = "FPS: " + std::to_string(Game::instance->fps) + " DCS: " + std::to_string(Mesh::num_meshes_rendered) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int((nTotalMemoryInKB-nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs";
+	str += " GL calls: " + std::to_string(GLState::stats.getTotalIssued()) + " (skipped " + std::to_string(GLState::stats.getTotalSkipped()) + ")";
+	Profiler::addCounter("draw calls", (double)Mesh::num_meshes_rendered);
+	Profiler::addCounter("triangles", (double)Mesh::num_triangles_rendered);
+	Profiler::addCounter("GL calls", GLState::stats.getTotalIssued());
+	Profiler::addCounter("GL calls skipped", GLState::stats.getTotalSkipped());
 	Mesh::num_meshes_rendered = 0;
 	Mesh::num_triangles_rendered = 0;
+	GLState::resetStats();
 	return str;
 }
 
@@ -263,9 +272,9 @@ void drawGrid()
 	}
 
 	glLineWidth(1);
-	glEnable(GL_BLEND);
-	glDepthMask(false);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::enable(GL_BLEND);
+	GLState::depthMask(false);
+	GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	Shader* grid_shader = Shader::getDefaultShader("grid");
 	grid_shader->enable();
 	Matrix44 m;
@@ -275,8 +284,8 @@ void drawGrid()
 	grid_shader->setUniform("u_camera_position", Camera::current->eye);
 	grid_shader->setUniform("u_viewprojection", Camera::current->viewprojection_matrix);
 	grid->render(GL_LINES); //background grid
-	glDisable(GL_BLEND);
-	glDepthMask(true);
+	GLState::disable(GL_BLEND);
+	GLState::depthMask(true);
 	grid_shader->disable();
 }
 
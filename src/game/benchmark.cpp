@@ -0,0 +1,291 @@
+#include "benchmark.h"
+#include "game.h"
+#include "graphics/fbo.h"
+#include "graphics/mesh.h"
+#include "graphics/gl_state.h"
+#include "graphics/texture_streamer.h"
+#include "framework/profiler.h"
+#include "framework/resource_manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+bool Benchmark::enabled = false;
+sBenchmarkSettings Benchmark::settings;
+
+//time spent loading every kind of resource (the profiler zones with a detail are the loaders)
+struct sLoadStats {
+	double time = 0;
+	int count = 0;
+	double slowest = 0;
+	std::string slowest_file;
+};
+static std::map<std::string, sLoadStats> s_loads;
+
+//the eye and center of the camera when the scene was loaded, the path orbits around that center
+static Vector3 s_start_eye;
+static Vector3 s_start_center;
+
+static void collectLoads()
+{
+	for (const sProfilerZone& zone : Profiler::getLastFrame())
+	{
+		if (zone.detail.empty())
+			continue;
+		sLoadStats& load = s_loads[zone.name];
+		double time = zone.end - zone.start;
+		load.time += time;
+		load.count++;
+		if (time > load.slowest)
+		{
+			load.slowest = time;
+			load.slowest_file = zone.detail;
+		}
+	}
+}
+
+//ms of the zones with that name in the last frame, in any thread
+static double getZoneTime(const char* name)
+{
+	double time = 0;
+	for (const sProfilerZone& zone : Profiler::getLastFrame())
+		if (strcmp(zone.name, name) == 0)
+			time += zone.end - zone.start;
+	return time;
+}
+
+//escapes the string to go between quotes (the paths can have backslashes in windows)
+static std::string toJSON(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.size());
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+		{
+			result += '\\';
+			result += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+			result += code;
+		}
+		else
+			result += c;
+	}
+	return result;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t index = (size_t)std::min(sorted.size() - 1.0, std::floor(p * 0.01 * sorted.size()));
+	return sorted[index];
+}
+
+bool Benchmark::parseArgs(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--bench") == 0)
+		{
+			enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.frames = std::max(1, atoi(argv[++i]));
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc)
+			settings.dt = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &settings.width, &settings.height) != 2 || settings.width <= 0 || settings.height <= 0)
+			{
+				std::cout << "[ERROR] Benchmark size must be like 1280x720: " << argv[i] << std::endl;
+				settings.width = 1280;
+				settings.height = 720;
+			}
+		}
+	}
+	if (settings.dt <= 0)
+		settings.dt = 1.0f / 60.0f;
+	settings.warmup = std::min(settings.warmup, settings.frames - 1);
+	return enabled;
+}
+
+void Benchmark::setupVideoDriver()
+{
+#if defined(__linux__) && SDL_VERSION_ATLEAST(2, 0, 22)
+	if (getenv("SDL_VIDEODRIVER") || getenv("DISPLAY") || getenv("WAYLAND_DISPLAY"))
+		return;
+	std::cout << " + Benchmark: no display, using the offscreen video driver (EGL)" << std::endl;
+	SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+#endif
+}
+
+//one orbit around the center of the initial camera during the benchmark, at the initial distance and height
+void Benchmark::setCamera(Game* game, int frame)
+{
+	float angle = 2.0f * float(M_PI) * frame / (float)settings.frames;
+	Vector3 offset = s_start_eye - s_start_center;
+	Vector3 eye(offset.x * cos(angle) - offset.z * sin(angle), offset.y, offset.x * sin(angle) + offset.z * cos(angle));
+	game->camera->lookAt(s_start_center + eye, s_start_center, Vector3(0.f, 1.f, 0.f));
+}
+
+int Benchmark::run(Game* game, double load_time)
+{
+	std::cout << " + Benchmark: " << settings.frames << " frames of " << settings.dt << "s at " << settings.width << "x" << settings.height << std::endl;
+
+	//the textures requested while loading count as loading time
+	double flush_start = Profiler::getTime();
+	TextureStreamer::Flush();
+	load_time += Profiler::getTime() - flush_start;
+
+	FBO* fbo = new FBO();
+	if (!fbo->create(settings.width, settings.height))
+	{
+		std::cout << "[ERROR] Benchmark cannot create the offscreen framebuffer" << std::endl;
+		delete fbo;
+		return 1;
+	}
+	game->offscreen = fbo;
+	game->onResize(settings.width, settings.height);
+
+	s_start_eye = game->camera->eye;
+	s_start_center = game->camera->center;
+	s_loads.clear();
+
+	std::vector<sBenchmarkFrame> frames;
+	frames.reserve(settings.frames);
+
+	SDL_Event sdlEvent;
+	for (int i = 0; i < settings.frames; ++i)
+	{
+		//the window is hidden but the events must be consumed, it can still be closed
+		while (SDL_PollEvent(&sdlEvent))
+			if (sdlEvent.type == SDL_QUIT)
+			{
+				std::cout << "[ERROR] Benchmark cancelled at frame " << i << std::endl;
+				game->offscreen = NULL;
+				delete fbo;
+				return 1;
+			}
+
+		Profiler::beginFrame();
+		double start = Profiler::getTime();
+
+		game->frame = i + 1;
+		game->time = (i + 1) * settings.dt;
+		game->elapsed_time = settings.dt;
+		game->fps = (int)round(1.0f / settings.dt);
+
+		//before the update, when pipelined the snapshot is taken at the end of it
+		setCamera(game, i);
+		game->step(settings.dt);
+
+		sBenchmarkFrame frame;
+		frame.cpu_time = Profiler::getTime() - start;
+		frame.draw_calls = (int)Mesh::num_meshes_rendered;
+		frame.triangles = (long)Mesh::num_triangles_rendered;
+		frame.gl_calls = GLState::stats.getTotalIssued();
+		frames.push_back(frame);
+		Mesh::num_meshes_rendered = 0;
+		Mesh::num_triangles_rendered = 0;
+		GLState::resetStats();
+
+		Profiler::endFrame();
+		frames.back().update_time = getZoneTime("update");
+		frames.back().render_time = getZoneTime("render");
+		collectLoads();
+	}
+
+	game->offscreen = NULL;
+	delete fbo;
+
+	return writeReport(frames, load_time) ? 0 : 1;
+}
+
+bool Benchmark::writeReport(const std::vector<sBenchmarkFrame>& frames, double load_time)
+{
+	std::vector<double> times;
+	double total_time = 0;
+	double draw_calls = 0, triangles = 0, gl_calls = 0;
+	double update_time = 0, render_time = 0;
+	for (size_t i = settings.warmup; i < frames.size(); ++i)
+	{
+		times.push_back(frames[i].cpu_time);
+		total_time += frames[i].cpu_time;
+		update_time += frames[i].update_time;
+		render_time += frames[i].render_time;
+		draw_calls += frames[i].draw_calls;
+		triangles += frames[i].triangles;
+		gl_calls += frames[i].gl_calls;
+	}
+	int num = std::max(1, (int)times.size());
+	std::sort(times.begin(), times.end());
+
+	//overlapping the update and the render can only hide the shortest of the two
+	double pipelined_bound = std::max(update_time, render_time) > 0 ? (update_time + render_time) / std::max(update_time, render_time) : 1;
+
+	FILE* f = fopen(settings.output.c_str(), "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] Benchmark cannot write the report: " << settings.output << std::endl;
+		return false;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"renderer\": \"%s\",\n", toJSON((const char*)glGetString(GL_RENDERER)).c_str());
+	fprintf(f, "\t\"frames\": %d,\n\t\"warmup\": %d,\n\t\"dt\": %f,\n", (int)frames.size(), settings.warmup, settings.dt);
+	fprintf(f, "\t\"width\": %d,\n\t\"height\": %d,\n", settings.width, settings.height);
+	fprintf(f, "\t\"pipelined\": %s,\n", Game::instance->pipelined ? "true" : "false");
+	fprintf(f, "\t\"load_ms\": %.3f,\n", load_time);
+	fprintf(f, "\t\"cpu_ms\": { \"avg\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+		total_time / num, percentile(times, 0), percentile(times, 50), percentile(times, 90), percentile(times, 95), percentile(times, 99), percentile(times, 100));
+	fprintf(f, "\t\"update_ms\": %.3f,\n\t\"render_ms\": %.3f,\n", update_time / num, render_time / num);
+	if (!Game::instance->pipelined)
+		fprintf(f, "\t\"pipelined_speedup_bound\": %.2f,\n", pipelined_bound);
+	fprintf(f, "\t\"draw_calls\": %.1f,\n\t\"triangles\": %.1f,\n\t\"gl_calls\": %.1f,\n", draw_calls / num, triangles / num, gl_calls / num);
+
+	fprintf(f, "\t\"loads\": {");
+	bool first = true;
+	for (auto& it : s_loads)
+	{
+		fprintf(f, "%s\n\t\t\"%s\": { \"ms\": %.3f, \"count\": %d, \"slowest_ms\": %.3f, \"slowest\": \"%s\" }", first ? "" : ",",
+			it.first.c_str(), it.second.time, it.second.count, it.second.slowest, toJSON(it.second.slowest_file).c_str());
+		first = false;
+	}
+	fprintf(f, "\n\t},\n");
+
+	//resident at the end of the run
+	fprintf(f, "\t\"resources\": {");
+	for (int i = 0; i < NUM_RESOURCE_TYPES; ++i)
+	{
+		eResourceType type = (eResourceType)i;
+		fprintf(f, "%s\n\t\t\"%s\": { \"count\": %d, \"cpu_bytes\": %zu, \"gpu_bytes\": %zu }", i ? "," : "",
+			ResourceManager::getTypeName(type), ResourceManager::getCount(type), ResourceManager::getCPUBytes(type), ResourceManager::getGPUBytes(type));
+	}
+	fprintf(f, "\n\t},\n");
+
+	//every frame, to plot them or compare two runs
+	fprintf(f, "\t\"frame_ms\": [");
+	for (size_t i = 0; i < frames.size(); ++i)
+		fprintf(f, "%s%.3f", i ? "," : "", frames[i].cpu_time);
+	fprintf(f, "]\n}\n");
+	fclose(f);
+
+	std::cout << " + Benchmark report saved: " << settings.output << " (avg " << total_time / num << " ms, p99 " << percentile(times, 99) << " ms)" << std::endl;
+	std::cout << " + Update " << update_time / num << " ms, render " << render_time / num << " ms";
+	if (!Game::instance->pipelined)
+		std::cout << ", --pipelined can be up to " << pipelined_bound << "x faster";
+	std::cout << std::endl;
+	return true;
+}
@@ -0,0 +1,58 @@
+/*  Benchmark
+	Headless and deterministic run of the game to catch performance regressions:
+
+		TJE_Framework --bench [frames] [report.json] [--dt 0.016] [--size 1280x720] [--pipelined]
+
+	The window is hidden and every frame is rendered in an offscreen FBO (so it also works with a software GL like
+	Mesa's llvmpipe), the game is updated with a fixed dt and the camera orbits around the scene following a fixed path.
+	A hidden window still needs a display: on Linux without one (DISPLAY and WAYLAND_DISPLAY unset) SDL's "offscreen"
+	video driver is used, which creates the context in an EGL pbuffer and requires SDL 2.0.22 or newer built with EGL
+	(libEGL and a driver like Mesa installed). Setting SDL_VIDEODRIVER chooses the driver instead (e.g. run it in xvfb-run).
+	When the frames are done a JSON report is written with the percentiles of the CPU time per frame, draw calls,
+	triangles and the loading times. It also has the time of the update and the render: --pipelined overlaps them, so
+	a run without it tells the best speedup it can give, (update + render) / max(update, render).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Game;
+
+struct sBenchmarkSettings {
+	int frames = 600;
+	int warmup = 10; //first frames not used in the stats (shader compilation, first uploads...)
+	float dt = 1.0f / 60.0f; //seconds
+	int width = 1280;
+	int height = 720;
+	std::string output = "benchmark.json";
+};
+
+struct sBenchmarkFrame {
+	double cpu_time; //ms of update and render (waiting the GPU to finish)
+	double update_time; //ms of the update zone (in a job when pipelined)
+	double render_time; //ms of the render zone
+	int draw_calls;
+	long triangles;
+	int gl_calls;
+};
+
+class Benchmark {
+public:
+	static bool enabled;
+	static sBenchmarkSettings settings;
+
+	// Reads the --bench arguments (wrong values keep the defaults), returns true if the benchmark was requested
+	static bool parseArgs(int argc, char** argv);
+
+	// Chooses the offscreen (EGL) video driver when there is no display, before SDL_Init
+	static void setupVideoDriver();
+
+	// Runs the frames with the game already loaded (load_time in ms) and writes the report, returns the exit code
+	static int run(Game* game, double load_time);
+
+private:
+	static void setCamera(Game* game, int frame);
+	static bool writeReport(const std::vector<sBenchmarkFrame>& frames, double load_time);
+};
@@ -4,8 +4,16 @@
 #include "graphics/texture.h"
 #include "graphics/fbo.h"
 #include "graphics/shader.h"
+#include "graphics/skinning.h"
+#include "graphics/gl_state.h"
+#include "framework/profiler.h"
+#include "graphics/texture_streamer.h"
 #include "framework/input.h"
+#include "framework/animation_system.h"
+#include "framework/job_system.h"
+#include "framework/resource_manager.h"
 #include "scene_parser/scene_parser.h"
+#include "scene_parser/world_partition.h"
 
 #include <cmath>
 
@@ -13,6 +21,7 @@
 float mouse_speed = 100.0f;
 
 Game* Game::instance = NULL;
+std::string Game::world_scene;
 
 Game::Game(int window_width, int window_height, SDL_Window* window)
 {
@@ -29,53 +38,126 @@ Game::Game(int window_width, int window_height, SDL_Window* window)
 	mouse_locked = false;
 
 	// OpenGL flags
-	glEnable( GL_CULL_FACE ); //render both sides of every triangle
-	glEnable( GL_DEPTH_TEST ); //check the occlusions using the Z buffer
+	GLState::enable(GL_CULL_FACE); //render both sides of every triangle
+	GLState::enable(GL_DEPTH_TEST); //check the occlusions using the Z buffer
 
 	// Create our camera
 	camera = new Camera();
 	camera->lookAt(Vector3(0.f, 100.f, 100.f), Vector3(0.f, 0.f, 0.f), Vector3(0.f, 1.f, 0.f));
 	camera->setPerspective(70.f, window_width / (float)window_height, 0.1f, 10000.f);
 
-	// Load the scene
+	// Load the scene (or only the index of its cells, they are loaded around the camera in upload)
 	root = new Entity();
-	SceneParser parser;
-	parser.parse("data/scenes/scene1/myscene.scene", root);
+	if (world_scene.size()) {
+		world = new WorldPartition();
+		world->load(world_scene.c_str(), root);
+	}
+	else {
+		SceneParser parser;
+		parser.parse("data/scenes/scene1/myscene.scene", root);
+	}
 
 	// Hide the cursor
 	SDL_ShowCursor(!mouse_locked);
 }
 
+//one frame: when pipelined the update runs in a job at the same time than the render of the previous one
+void Game::step(double seconds_elapsed)
+{
+	if (!pipelined)
+	{
+		{
+			PROFILE_SCOPE("update");
+			update(seconds_elapsed);
+		}
+		upload();
+		{
+			PROFILE_SCOPE("render");
+			render();
+		}
+		return;
+	}
+
+	//the update is stopped here: upload what the last one produced and render its snapshot
+	upload();
+	front_snapshot = 1 - front_snapshot;
+
+	JobCounter simulation;
+	JobSystem::run([this, seconds_elapsed] {
+		PROFILE_SCOPE("update");
+		update(seconds_elapsed);
+		snapshots[1 - front_snapshot].capture(root, camera);
+	}, &simulation);
+
+	{
+		PROFILE_SCOPE("render");
+		render();
+	}
+
+	//the main thread helps with the jobs of the update (animation) once it is done
+	PROFILE_SCOPE("wait update");
+	JobSystem::wait(&simulation);
+}
+
 //what to do when the image has to be draw
 void Game::render(void)
 {
+	if (offscreen)
+		offscreen->bind();
+
 	// Set the clear color (the background color)
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
 	// Clear the window and the depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Set the camera as default
-	camera->enable();
-
 	// Set flags
-	glDisable(GL_BLEND);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-
-	// Render the scene
-	if (root) {
-		root->render(camera);
+	GLState::disable(GL_BLEND);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::enable(GL_CULL_FACE);
+
+	// Render the scene (the camera and entities of the snapshot if the update is running)
+	if (pipelined) {
+		PROFILE_GPU_SCOPE("scene");
+		snapshots[front_snapshot].render();
+	}
+	else {
+		// Set the camera as default
+		camera->enable();
+
+		if (root) {
+			PROFILE_GPU_SCOPE("scene");
+			root->render(camera);
+		}
 	}
 
 	// Draw the floor grid
-	drawGrid();
+	{
+		PROFILE_GPU_SCOPE("grid");
+		drawGrid();
+	}
+
+	// Headless: the text is not measured and the frame must be finished to count its time
+	if (offscreen)
+	{
+		offscreen->unbind();
+		PROFILE_SCOPE("finish");
+		glFinish();
+		return;
+	}
 
 	// Render the FPS, Draw Calls, etc
-	drawText(2, 2, getGPUStats(), Vector3(1, 1, 1), 2);
+	{
+		PROFILE_GPU_SCOPE("overlay");
+		drawText(2, 2, getGPUStats(), Vector3(1, 1, 1), 2);
+		Profiler::drawOverlay(2, 20, 2);
+	}
 
 	// Swap between front buffer and back buffer
-	SDL_GL_SwapWindow(this->window);
+	{
+		PROFILE_SCOPE("swap");
+		SDL_GL_SwapWindow(this->window);
+	}
 }
 
 void Game::update(double seconds_elapsed)
@@ -84,9 +166,16 @@ void Game::update(double seconds_elapsed)
 
 	// Update scene entities
 	if (root) {
+		PROFILE_SCOPE("entities");
 		root->update((float)seconds_elapsed);
 	}
 
+	// Update the animators registered in the AnimationSystem (in parallel)
+	{
+		PROFILE_SCOPE("animation");
+		AnimationSystem::Update((float)seconds_elapsed);
+	}
+
 	// Mouse input to rotate the cam
 	if (Input::isMousePressed(SDL_BUTTON_LEFT) || mouse_locked) //is left button pressed?
 	{
@@ -102,6 +191,40 @@ void Game::update(double seconds_elapsed)
 	if (Input::isKeyPressed(SDL_SCANCODE_D) || Input::isKeyPressed(SDL_SCANCODE_RIGHT)) camera->move(Vector3(-1.0f,0.0f, 0.0f) * speed);
 }
 
+void Game::upload(void)
+{
+	// Load and unload the cells around the camera (the update is stopped, the entities can change)
+	if (world)
+		world->update(camera->eye);
+
+	// Send the bones of all the animators to the GPU at once (see Mesh::renderAnimated with an offset)
+	{
+		PROFILE_SCOPE("skinning upload");
+		SkinningBuffer* skinning = SkinningBuffer::Get();
+		skinning->clear();
+		skinning->addAnimators(AnimationSystem::getAnimators());
+		skinning->upload();
+	}
+
+	// Upload the textures decoded in the background (limited bytes per frame)
+	{
+		PROFILE_SCOPE("texture streaming");
+		TextureStreamer::Update();
+	}
+
+	// Free the unused resources of the types over their memory budget
+	ResourceManager::update();
+}
+
+void Game::setPipelined(bool enabled)
+{
+	pipelined = enabled;
+	//the first frame renders the current state, the update is not running
+	if (enabled)
+		snapshots[1 - front_snapshot].capture(root, camera);
+	std::cout << " + Pipelined update/render: " << (enabled ? "ON" : "OFF") << std::endl;
+}
+
 //Keyboard event handler (sync input)
 void Game::onKeyDown( SDL_KeyboardEvent event )
 {
@@ -109,6 +232,10 @@ void Game::onKeyDown( SDL_KeyboardEvent event )
 	{
 		case SDLK_ESCAPE: must_exit = true; break; //ESC key, kill the app
 		case SDLK_F1: Shader::ReloadAll(); break; 
+		case SDLK_F2: Profiler::show_overlay = !Profiler::show_overlay; break;
+		case SDLK_F3: Profiler::startCapture(120, "trace.json"); break; //two seconds at 60 fps
+		case SDLK_F4: setPipelined(!pipelined); break;
+		case SDLK_F5: std::cout << ResourceManager::getReport(); break; //resident bytes per type
 	}
 }
 
@@ -8,6 +8,10 @@
 #include "framework/camera.h"
 #include "framework/utils.h"
 #include "framework/entities/entity.h"
+#include "graphics/render_snapshot.h"
+
+class FBO;
+class WorldPartition;
 
 class Game
 {
@@ -30,12 +34,29 @@ public:
 	Camera* camera; //our global camera
 	bool mouse_locked; //tells if the mouse is locked (not seen)
 	Entity* root = nullptr; //scene root entity
+	FBO* offscreen = nullptr; //if set the frames are rendered here and the window is not swapped (see Benchmark)
+	WorldPartition* world = nullptr; //streams the cells of world_scene around the camera
+	static std::string world_scene; //if set it is loaded by cells instead of the default scene (--world level.scene)
+
+	//pipelined mode (--pipelined or F4): the update of the next frame runs in a job while this one is rendered from a
+	//snapshot, one frame more of latency. The update (and the animation callbacks called from it) then runs outside
+	//the GL thread while the render reads the snapshot, so inside update:
+	// - entities, transforms, the camera, animators and gameplay state can change (the render does not read them)
+	// - no GL: Mesh::Get/Upload, Texture::Get/create and Shader::Get assert it in debug. ResourceManager::find is fine, and
+	//   TextureStreamer::Get once it was used in the main thread (the scene load does). New meshes and shaders go in upload
+	bool pipelined = false;
+	RenderSnapshot snapshots[2]; //the front one is rendered while the update fills the other
+	int front_snapshot = 0;
 
 	Game( int window_width, int window_height, SDL_Window* window );
 
 	//main functions
+	void step( double dt ); //update, upload and render of one frame (pipelined or not)
 	void render( void );
 	void update( double dt );
+	void upload( void ); //GL work of the frame (bones, streamed textures), always in the main thread
+
+	void setPipelined(bool enabled);
 
 	void setMouseLocked(bool must_lock);
 
@@ -0,0 +1,213 @@
+#include "gl_state.h"
+
+#include <cassert>
+
+#define GLSTATE_UNKNOWN 0xFFFFFFFF //nothing cached, the next call always reaches GL
+
+sGLStateStats GLState::stats;
+std::thread::id GLState::gl_thread;
+
+//targets with a slot in the cache
+static const GLenum s_texture_targets[] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER };
+static const GLenum s_buffer_targets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_TEXTURE_BUFFER };
+static const GLenum s_flags[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE };
+
+#define NUM_TEXTURE_TARGETS (sizeof(s_texture_targets) / sizeof(GLenum))
+#define NUM_BUFFER_TARGETS (sizeof(s_buffer_targets) / sizeof(GLenum))
+#define NUM_FLAGS (sizeof(s_flags) / sizeof(GLenum))
+
+struct sGLStateCache {
+	GLuint program;
+	GLuint active_unit;
+	GLuint textures[GLSTATE_MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+	GLuint buffers[NUM_BUFFER_TARGETS];
+	GLuint vertex_array;
+	GLuint flags[NUM_FLAGS]; //0, 1 or unknown
+	GLuint depth_mask;
+	GLenum blend_src;
+	GLenum blend_dst;
+
+	sGLStateCache() { reset(); }
+	void reset()
+	{
+		program = active_unit = vertex_array = depth_mask = blend_src = blend_dst = GLSTATE_UNKNOWN;
+		for (GLuint* t = &textures[0][0]; t != &textures[0][0] + GLSTATE_MAX_TEXTURE_UNITS * NUM_TEXTURE_TARGETS; ++t)
+			*t = GLSTATE_UNKNOWN;
+		for (GLuint& b : buffers)
+			b = GLSTATE_UNKNOWN;
+		for (GLuint& f : flags)
+			f = GLSTATE_UNKNOWN;
+	}
+};
+
+static sGLStateCache s_cache;
+
+template<size_t N> static int findTarget(const GLenum(&targets)[N], GLenum target)
+{
+	for (int i = 0; i < (int)N; ++i)
+		if (targets[i] == target)
+			return i;
+	return -1;
+}
+
+//returns true if the value changed (and stores it), counting the call
+static bool updateValue(GLuint& cached, GLuint value, eGLStateCall type)
+{
+	if (cached == value)
+	{
+		GLState::stats.skipped[type]++;
+		return false;
+	}
+	cached = value;
+	GLState::stats.issued[type]++;
+	return true;
+}
+
+int sGLStateStats::getTotalIssued() const
+{
+	int total = 0;
+	for (int i = 0; i < GLSTATE_NUM_CALLS; ++i)
+		total += issued[i];
+	return total;
+}
+
+int sGLStateStats::getTotalSkipped() const
+{
+	int total = 0;
+	for (int i = 0; i < GLSTATE_NUM_CALLS; ++i)
+		total += skipped[i];
+	return total;
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if (updateValue(s_cache.program, program, GLSTATE_PROGRAM))
+		glUseProgram(program);
+}
+
+void GLState::activeTexture(GLenum texture)
+{
+	assert(texture >= GL_TEXTURE0 && texture < GL_TEXTURE0 + GLSTATE_MAX_TEXTURE_UNITS);
+	if (updateValue(s_cache.active_unit, texture - GL_TEXTURE0, GLSTATE_TEXTURE))
+		glActiveTexture(texture);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+	int index = findTarget(s_texture_targets, target);
+	if (index == -1 || s_cache.active_unit == GLSTATE_UNKNOWN)
+	{
+		stats.issued[GLSTATE_TEXTURE]++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (updateValue(s_cache.textures[s_cache.active_unit][index], texture, GLSTATE_TEXTURE))
+		glBindTexture(target, texture);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = findTarget(s_buffer_targets, target);
+	if (index == -1)
+	{
+		stats.issued[GLSTATE_BUFFER]++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (updateValue(s_cache.buffers[index], buffer, GLSTATE_BUFFER))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+	if (!updateValue(s_cache.vertex_array, vao, GLSTATE_VERTEX_ARRAY))
+		return;
+	glBindVertexArray(vao);
+	//the index buffer binding is part of the VAO
+	s_cache.buffers[findTarget(s_buffer_targets, GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+}
+
+void GLState::enable(GLenum cap)
+{
+	int index = findTarget(s_flags, cap);
+	if (index == -1)
+	{
+		stats.issued[GLSTATE_FLAG]++;
+		glEnable(cap);
+	}
+	else if (updateValue(s_cache.flags[index], 1, GLSTATE_FLAG))
+		glEnable(cap);
+}
+
+void GLState::disable(GLenum cap)
+{
+	int index = findTarget(s_flags, cap);
+	if (index == -1)
+	{
+		stats.issued[GLSTATE_FLAG]++;
+		glDisable(cap);
+	}
+	else if (updateValue(s_cache.flags[index], 0, GLSTATE_FLAG))
+		glDisable(cap);
+}
+
+void GLState::depthMask(GLboolean flag)
+{
+	if (updateValue(s_cache.depth_mask, flag ? 1 : 0, GLSTATE_FLAG))
+		glDepthMask(flag);
+}
+
+void GLState::blendFunc(GLenum sfactor, GLenum dfactor)
+{
+	if (s_cache.blend_src == sfactor && s_cache.blend_dst == dfactor)
+	{
+		stats.skipped[GLSTATE_FLAG]++;
+		return;
+	}
+	s_cache.blend_src = sfactor;
+	s_cache.blend_dst = dfactor;
+	stats.issued[GLSTATE_FLAG]++;
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint* textures)
+{
+	for (int i = 0; i < n; ++i)
+		for (GLuint* t = &s_cache.textures[0][0]; t != &s_cache.textures[0][0] + GLSTATE_MAX_TEXTURE_UNITS * NUM_TEXTURE_TARGETS; ++t)
+			if (*t == textures[i])
+				*t = 0;
+	glDeleteTextures(n, textures);
+}
+
+void GLState::deleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	for (int i = 0; i < n; ++i)
+		for (GLuint& b : s_cache.buffers)
+			if (b == buffers[i])
+				b = 0;
+	glDeleteBuffers(n, buffers);
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+	for (int i = 0; i < n; ++i)
+		if (s_cache.vertex_array == arrays[i])
+		{
+			s_cache.vertex_array = 0;
+			s_cache.buffers[findTarget(s_buffer_targets, GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+		}
+	glDeleteVertexArrays(n, arrays);
+}
+
+void GLState::deleteProgram(GLuint program)
+{
+	//GL can give the same id to a new program
+	glDeleteProgram(program);
+	if (s_cache.program == program)
+		s_cache.program = GLSTATE_UNKNOWN;
+}
+
+void GLState::invalidate()
+{
+	s_cache.reset();
+}
@@ -0,0 +1,68 @@
+/*  GLState
+	Shadows the GL state the framework changes while rendering (program, textures per unit, buffers, VAO, blend/depth/cull)
+	and drops the calls that would set the value already set. The functions have the same arguments than the GL ones, so
+	they can be used as a replacement. If some code changes the state calling GL directly, call invalidate() after it.
+	The uniform values are filtered in the Shader (per program), using the same counters.
+*/
+
+#pragma once
+
+#include "framework/includes.h"
+
+#include <thread>
+
+#define GLSTATE_MAX_TEXTURE_UNITS 16
+
+enum eGLStateCall {
+	GLSTATE_PROGRAM,
+	GLSTATE_TEXTURE, //glActiveTexture and glBindTexture
+	GLSTATE_BUFFER,
+	GLSTATE_VERTEX_ARRAY,
+	GLSTATE_FLAG, //glEnable, glDisable, glDepthMask, glBlendFunc
+	GLSTATE_UNIFORM,
+	GLSTATE_NUM_CALLS
+};
+
+struct sGLStateStats {
+	int issued[GLSTATE_NUM_CALLS] = {}; //sent to the driver
+	int skipped[GLSTATE_NUM_CALLS] = {}; //dropped because they changed nothing
+
+	int getTotalIssued() const;
+	int getTotalSkipped() const;
+};
+
+class GLState {
+public:
+	static sGLStateStats stats; //since the last resetStats (once per frame in getGPUStats)
+
+	static void useProgram(GLuint program);
+	static void activeTexture(GLenum texture); //GL_TEXTURE0 + unit
+	static void bindTexture(GLenum target, GLuint texture); //in the active unit
+	static void bindBuffer(GLenum target, GLuint buffer);
+	static void bindVertexArray(GLuint vao);
+
+	//only GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are cached, the rest go straight to GL
+	static void enable(GLenum cap);
+	static void disable(GLenum cap);
+	static void depthMask(GLboolean flag);
+	static void blendFunc(GLenum sfactor, GLenum dfactor);
+
+	//delete and forget the ids, GL unbinds them and could give the same ids to new objects
+	static void deleteTextures(GLsizei n, const GLuint* textures);
+	static void deleteBuffers(GLsizei n, const GLuint* buffers);
+	static void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+	static void deleteProgram(GLuint program);
+
+	//forget everything, the next calls always reach GL
+	static void invalidate();
+
+	//the thread with the GL context, the loaders that call GL assert they run in it (see Game::update when pipelined)
+	static void setGLThread() { gl_thread = std::this_thread::get_id(); }
+	static bool isGLThread() { return gl_thread == std::thread::id() || gl_thread == std::this_thread::get_id(); } //true if none was set
+
+	static void countUniform(bool skipped) { if (skipped) stats.skipped[GLSTATE_UNIFORM]++; else stats.issued[GLSTATE_UNIFORM]++; }
+	static void resetStats() { stats = sGLStateStats(); }
+
+private:
+	static std::thread::id gl_thread;
+};
@@ -0,0 +1,436 @@
+#include "image_ops.h"
+#include "framework/simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#define LINEAR_TO_SRGB_TABLE_SIZE 4096
+
+//conversion tables, built once
+static struct sColorTables {
+	float to_float[256]; //byte to [0..1]
+	float srgb_to_linear[256];
+	Uint8 linear_to_srgb[LINEAR_TO_SRGB_TABLE_SIZE];
+
+	sColorTables()
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			float v = i / 255.0f;
+			to_float[i] = v;
+			srgb_to_linear[i] = v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; ++i)
+		{
+			float v = i / (float)(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+			float s = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+			linear_to_srgb[i] = (Uint8)std::clamp((int)(s * 255.0f + 0.5f), 0, 255);
+		}
+	}
+} tables;
+
+//pixels are processed as float4 (missing channels are 0, missing alpha is 1)
+static inline float4 loadPixel(const Uint8* p, int bpp, bool srgb)
+{
+#if defined(TJE_SIMD_SSE)
+	if (bpp == 4 && !srgb) //common case, convert the 4 bytes at once
+	{
+		int bytes;
+		memcpy(&bytes, p, 4);
+		__m128i zero = _mm_setzero_si128();
+		__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+		return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+	}
+#endif
+	const float* color = srgb ? tables.srgb_to_linear : tables.to_float;
+	float v[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	for (int c = 0; c < bpp; ++c)
+		v[c] = c == 3 ? tables.to_float[p[c]] : color[p[c]];
+	return load4(v);
+}
+
+static inline void storePixel(float4 pixel, Uint8* p, int bpp, bool srgb)
+{
+	pixel = min4(max4(pixel, splat4(0.0f)), splat4(1.0f));
+#if defined(TJE_SIMD_SSE)
+	if (bpp == 4 && !srgb)
+	{
+		__m128i v = _mm_cvtps_epi32(_mm_mul_ps(pixel, _mm_set1_ps(255.0f))); //rounds to nearest
+		v = _mm_packs_epi32(v, v);
+		int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+		memcpy(p, &bytes, 4);
+		return;
+	}
+#endif
+	float v[4];
+	store4(v, pixel);
+	for (int c = 0; c < bpp; ++c)
+	{
+		if (srgb && c != 3)
+			p[c] = tables.linear_to_srgb[(int)(v[c] * (LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f)];
+		else
+			p[c] = (Uint8)(v[c] * 255.0f + 0.5f);
+	}
+}
+
+void flipRows(Uint8* data, int width, int height, int bytes_per_pixel)
+{
+	assert(data);
+	int row_size = width * bytes_per_pixel;
+	for (int y = 0; y < height / 2; ++y)
+	{
+		Uint8* a = data + y * row_size;
+		Uint8* b = data + (height - y - 1) * row_size;
+		int i = 0;
+#if defined(TJE_SIMD_SSE)
+		for (; i + 16 <= row_size; i += 16)
+		{
+			__m128i va = _mm_loadu_si128((__m128i*)(a + i));
+			__m128i vb = _mm_loadu_si128((__m128i*)(b + i));
+			_mm_storeu_si128((__m128i*)(a + i), vb);
+			_mm_storeu_si128((__m128i*)(b + i), va);
+		}
+#elif defined(TJE_SIMD_NEON)
+		for (; i + 16 <= row_size; i += 16)
+		{
+			uint8x16_t va = vld1q_u8(a + i);
+			uint8x16_t vb = vld1q_u8(b + i);
+			vst1q_u8(a + i, vb);
+			vst1q_u8(b + i, va);
+		}
+#endif
+		for (; i < row_size; ++i)
+			std::swap(a[i], b[i]);
+	}
+}
+
+void expandRGBToRGBA(const Uint8* src, Uint8* dst, int num_pixels)
+{
+	assert(src && dst && src != dst);
+	int i = 0;
+	//the shuffle needs SSSE3, the build targets plain SSE2 so x86 uses the loop below
+#if defined(TJE_SIMD_NEON)
+	for (; i + 16 <= num_pixels; i += 16)
+	{
+		uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+		uint8x16x4_t rgba;
+		rgba.val[0] = rgb.val[0];
+		rgba.val[1] = rgb.val[1];
+		rgba.val[2] = rgb.val[2];
+		rgba.val[3] = vdupq_n_u8(255);
+		vst4q_u8(dst + i * 4, rgba);
+	}
+#endif
+	for (; i < num_pixels; ++i)
+	{
+		dst[i * 4] = src[i * 3];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 2];
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+void downsampleBox(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb)
+{
+	assert(src && dst);
+	int bpp = bytes_per_pixel;
+	int w = std::max(width / 2, 1);
+	int h = std::max(height / 2, 1);
+
+	for (int y = 0; y < h; ++y)
+	{
+		//clamped so 1 pixel wide images work too
+		const Uint8* row0 = src + std::min(y * 2, height - 1) * width * bpp;
+		const Uint8* row1 = src + std::min(y * 2 + 1, height - 1) * width * bpp;
+		Uint8* out = dst + y * w * bpp;
+
+		if (srgb)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				int x0 = std::min(x * 2, width - 1) * bpp;
+				int x1 = std::min(x * 2 + 1, width - 1) * bpp;
+				float4 sum = add4(add4(loadPixel(row0 + x0, bpp, true), loadPixel(row0 + x1, bpp, true)),
+					add4(loadPixel(row1 + x0, bpp, true), loadPixel(row1 + x1, bpp, true)));
+				storePixel(mul4(sum, splat4(0.25f)), out + x * bpp, bpp, true);
+			}
+			continue;
+		}
+
+		int x = 0;
+#if defined(TJE_SIMD_SSE)
+		//4 source pixels (16 bytes) of both rows give 2 pixels
+		if (bpp == 4 && width >= 2)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+			for (; x + 2 <= w && (x * 2 + 4) <= width; x += 2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)); //pixels 0,1
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)); //pixels 2,3
+				lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+				__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), round), 2);
+				_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+			}
+		}
+#elif defined(TJE_SIMD_NEON)
+		if (bpp == 4 && width >= 2)
+		{
+			for (; x + 2 <= w && (x * 2 + 4) <= width; x += 2)
+			{
+				uint16x8_t lo = vaddl_u8(vld1_u8(row0 + x * 8), vld1_u8(row1 + x * 8)); //pixels 0,1
+				uint16x8_t hi = vaddl_u8(vld1_u8(row0 + x * 8 + 8), vld1_u8(row1 + x * 8 + 8)); //pixels 2,3
+				uint16x8_t sum = vcombine_u16(vadd_u16(vget_low_u16(lo), vget_high_u16(lo)), vadd_u16(vget_low_u16(hi), vget_high_u16(hi)));
+				vst1_u8(out + x * 4, vrshrn_n_u16(sum, 2));
+			}
+		}
+#endif
+		for (; x < w; ++x)
+		{
+			int x0 = std::min(x * 2, width - 1) * bpp;
+			int x1 = std::min(x * 2 + 1, width - 1) * bpp;
+			for (int c = 0; c < bpp; ++c)
+				out[x * bpp + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2;
+		}
+	}
+}
+
+//I0, modified bessel function of the first kind
+static double besselI0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 20; ++k)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+#define KAISER_TAPS 6
+
+//weights of the taps around the center of the output pixel (2x + 0.5), normalized
+static struct sKaiserWeights {
+	float weights[KAISER_TAPS];
+
+	sKaiserWeights()
+	{
+		const double pi = 3.14159265358979323846;
+		const double alpha = 4.0;
+		const double radius = 3.0;
+		double total = 0.0;
+		double w[KAISER_TAPS];
+		for (int i = 0; i < KAISER_TAPS; ++i)
+		{
+			double d = i - 2.5; //distance to the center in source pixels
+			double x = d * 0.5; //in destination pixels
+			double sinc = sin(pi * x) / (pi * x); //x is never 0
+			double t = d / radius;
+			double window = besselI0(alpha * sqrt(std::max(0.0, 1.0 - t * t))) / besselI0(alpha);
+			w[i] = sinc * window;
+			total += w[i];
+		}
+		for (int i = 0; i < KAISER_TAPS; ++i)
+			weights[i] = (float)(w[i] / total);
+	}
+} kaiser;
+
+void downsampleKaiser(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb)
+{
+	assert(src && dst);
+	int bpp = bytes_per_pixel;
+	int w = std::max(width / 2, 1);
+	int h = std::max(height / 2, 1);
+	const float* weights = kaiser.weights;
+
+	//horizontal pass into floats (one float4 per pixel), then vertical pass
+	thread_local std::vector<float> temp;
+	temp.resize(w * height * 4);
+
+	for (int y = 0; y < height; ++y)
+	{
+		const Uint8* row = src + y * width * bpp;
+		float* out = &temp[y * w * 4];
+		for (int x = 0; x < w; ++x)
+		{
+			float4 sum = splat4(0.0f);
+			for (int t = 0; t < KAISER_TAPS; ++t)
+			{
+				int sx = std::clamp(x * 2 - 2 + t, 0, width - 1);
+				sum = madd4(loadPixel(row + sx * bpp, bpp, srgb), splat4(weights[t]), sum);
+			}
+			store4(out + x * 4, sum);
+		}
+	}
+
+	for (int y = 0; y < h; ++y)
+	{
+		Uint8* out = dst + y * w * bpp;
+		const float* rows[KAISER_TAPS];
+		for (int t = 0; t < KAISER_TAPS; ++t)
+			rows[t] = &temp[std::clamp(y * 2 - 2 + t, 0, height - 1) * w * 4];
+		for (int x = 0; x < w; ++x)
+		{
+			float4 sum = splat4(0.0f);
+			for (int t = 0; t < KAISER_TAPS; ++t)
+				sum = madd4(load4(rows[t] + x * 4), splat4(weights[t]), sum);
+			storePixel(sum, out + x * bpp, bpp, srgb);
+		}
+	}
+}
+
+void resampleBilinear(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, int dst_width, int dst_height, bool srgb)
+{
+	assert(src && dst && dst_width > 0 && dst_height > 0);
+	int bpp = bytes_per_pixel;
+
+	//the source columns and weights are the same for every row
+	thread_local std::vector<int> columns;
+	thread_local std::vector<float> column_weights;
+	columns.resize(dst_width * 2);
+	column_weights.resize(dst_width);
+	float scale_x = width / (float)dst_width;
+	for (int x = 0; x < dst_width; ++x)
+	{
+		float sx = std::max((x + 0.5f) * scale_x - 0.5f, 0.0f);
+		int x0 = std::min((int)sx, width - 1);
+		columns[x * 2] = x0 * bpp;
+		columns[x * 2 + 1] = std::min(x0 + 1, width - 1) * bpp;
+		column_weights[x] = sx - x0;
+	}
+
+	float scale_y = height / (float)dst_height;
+	for (int y = 0; y < dst_height; ++y)
+	{
+		float sy = std::max((y + 0.5f) * scale_y - 0.5f, 0.0f);
+		int y0 = std::min((int)sy, height - 1);
+		const Uint8* row0 = src + y0 * width * bpp;
+		const Uint8* row1 = src + std::min(y0 + 1, height - 1) * width * bpp;
+		float4 fy = splat4(sy - y0);
+		Uint8* out = dst + y * dst_width * bpp;
+
+		for (int x = 0; x < dst_width; ++x)
+		{
+			float4 fx = splat4(column_weights[x]);
+			float4 a = loadPixel(row0 + columns[x * 2], bpp, srgb);
+			float4 b = loadPixel(row0 + columns[x * 2 + 1], bpp, srgb);
+			float4 c = loadPixel(row1 + columns[x * 2], bpp, srgb);
+			float4 d = loadPixel(row1 + columns[x * 2 + 1], bpp, srgb);
+			float4 top = madd4(sub4(b, a), fx, a);
+			float4 bottom = madd4(sub4(d, c), fx, c);
+			storePixel(madd4(sub4(bottom, top), fy, top), out + x * bpp, bpp, srgb);
+		}
+	}
+}
+
+void flipRowsScalar(Uint8* data, int width, int height, int bytes_per_pixel)
+{
+	int row_size = width * bytes_per_pixel;
+	for (int y = 0; y < height / 2; ++y)
+		for (int i = 0; i < row_size; ++i)
+			std::swap(data[y * row_size + i], data[(height - y - 1) * row_size + i]);
+}
+
+void expandRGBToRGBAScalar(const Uint8* src, Uint8* dst, int num_pixels)
+{
+	for (int i = 0; i < num_pixels; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+			dst[i * 4 + c] = src[i * 3 + c];
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+static float toLinearScalar(Uint8 value, int channel, bool srgb)
+{
+	float v = value / 255.0f;
+	if (!srgb || channel == 3)
+		return v;
+	return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static Uint8 fromLinearScalar(float v, int channel, bool srgb)
+{
+	v = std::clamp(v, 0.0f, 1.0f);
+	if (srgb && channel != 3)
+		v = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+	return (Uint8)(v * 255.0f + 0.5f);
+}
+
+void downsampleBoxScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb)
+{
+	int bpp = bytes_per_pixel;
+	int w = std::max(width / 2, 1);
+	int h = std::max(height / 2, 1);
+	for (int y = 0; y < h; ++y)
+		for (int x = 0; x < w; ++x)
+		{
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int c = 0; c < bpp; ++c)
+			{
+				const Uint8* p00 = &src[(y0 * width + x0) * bpp + c];
+				const Uint8* p01 = &src[(y0 * width + x1) * bpp + c];
+				const Uint8* p10 = &src[(y1 * width + x0) * bpp + c];
+				const Uint8* p11 = &src[(y1 * width + x1) * bpp + c];
+				if (srgb)
+				{
+					float sum = toLinearScalar(*p00, c, true) + toLinearScalar(*p01, c, true) + toLinearScalar(*p10, c, true) + toLinearScalar(*p11, c, true);
+					dst[(y * w + x) * bpp + c] = fromLinearScalar(sum * 0.25f, c, true);
+				}
+				else
+					dst[(y * w + x) * bpp + c] = (*p00 + *p01 + *p10 + *p11 + 2) >> 2;
+			}
+		}
+}
+
+void downsampleKaiserScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb)
+{
+	int bpp = bytes_per_pixel;
+	int w = std::max(width / 2, 1);
+	int h = std::max(height / 2, 1);
+	for (int y = 0; y < h; ++y)
+		for (int x = 0; x < w; ++x)
+			for (int c = 0; c < bpp; ++c)
+			{
+				float sum = 0.0f;
+				for (int ty = 0; ty < KAISER_TAPS; ++ty)
+				{
+					int sy = std::clamp(y * 2 - 2 + ty, 0, height - 1);
+					float row = 0.0f;
+					for (int tx = 0; tx < KAISER_TAPS; ++tx)
+					{
+						int sx = std::clamp(x * 2 - 2 + tx, 0, width - 1);
+						row += toLinearScalar(src[(sy * width + sx) * bpp + c], c, srgb) * kaiser.weights[tx];
+					}
+					sum += row * kaiser.weights[ty];
+				}
+				dst[(y * w + x) * bpp + c] = fromLinearScalar(sum, c, srgb);
+			}
+}
+
+void resampleBilinearScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, int dst_width, int dst_height)
+{
+	int bpp = bytes_per_pixel;
+	for (int y = 0; y < dst_height; ++y)
+		for (int x = 0; x < dst_width; ++x)
+		{
+			float sx = std::max((x + 0.5f) * width / (float)dst_width - 0.5f, 0.0f);
+			float sy = std::max((y + 0.5f) * height / (float)dst_height - 0.5f, 0.0f);
+			int x0 = std::min((int)sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+			int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+			float fx = sx - x0, fy = sy - y0;
+			for (int c = 0; c < bpp; ++c)
+			{
+				float top = src[(y0 * width + x0) * bpp + c] * (1.0f - fx) + src[(y0 * width + x1) * bpp + c] * fx;
+				float bottom = src[(y1 * width + x0) * bpp + c] * (1.0f - fx) + src[(y1 * width + x1) * bpp + c] * fx;
+				dst[(y * dst_width + x) * bpp + c] = (Uint8)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+}
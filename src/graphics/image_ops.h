@@ -0,0 +1,30 @@
+/*  Image operations
+	Kernels that work on the pixel buffers of the Image class (rows of width * bytes_per_pixel bytes), vectorized
+	with SSE2/NEON when possible. They never allocate the images, the caller gives the destination buffer.
+	The sRGB versions filter colors in linear space (alpha is always linear), use them for color textures.
+*/
+
+#pragma once
+
+#include "framework/includes.h"
+
+//swaps the rows in place (vertical flip), works with any bytes per pixel
+void flipRows(Uint8* data, int width, int height, int bytes_per_pixel);
+
+//RGB to RGBA with alpha 255, dst needs num_pixels * 4 bytes and cannot be src
+void expandRGBToRGBA(const Uint8* src, Uint8* dst, int num_pixels);
+
+//half size (at least 1 pixel) for mip levels, dst needs max(width/2,1) * max(height/2,1) * bytes_per_pixel bytes
+void downsampleBox(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb = false); //2x2 average
+void downsampleKaiser(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb = false); //6 taps kaiser windowed sinc, sharper mips
+
+//any size, pixel centers are aligned like in the GPU
+void resampleBilinear(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, int dst_width, int dst_height, bool srgb = false);
+
+//plain versions kept as reference to check and benchmark the vectorized ones
+//(the sRGB conversions use the formulas instead of the tables, the results can differ by 1)
+void flipRowsScalar(Uint8* data, int width, int height, int bytes_per_pixel);
+void expandRGBToRGBAScalar(const Uint8* src, Uint8* dst, int num_pixels);
+void downsampleBoxScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb = false);
+void downsampleKaiserScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, bool srgb = false);
+void resampleBilinearScalar(const Uint8* src, int width, int height, int bytes_per_pixel, Uint8* dst, int dst_width, int dst_height);
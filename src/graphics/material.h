@@ -2,6 +2,11 @@
 
 #include "framework/includes.h"
 #include "framework/framework.h"
+#include "graphics/texture_array.h"
+
+#include <map>
+#include <memory>
+#include <string>
 
 class Shader;
 class Texture;
@@ -11,6 +16,11 @@ public:
 	Shader* shader = nullptr;
 	Vector4 color = Vector4(1.f);
 	Texture* diffuse = nullptr;
+	int diffuse_layer = -1; //layer to read when diffuse is a GL_TEXTURE_2D_ARRAY (see TextureArrayPacker)
+
+	//array and layer that replace the Kd_texture of each mesh material (by name) for this entity only,
+	//the mesh is shared in the cache so it is not changed. Shared by the copies of the material, it holds the arrays
+	std::shared_ptr<const sMeshTextureLayers> mesh_layers;
 };
 
 struct sRenderData {
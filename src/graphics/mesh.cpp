@@ -2,6 +2,8 @@
 #include "framework/extra/textparser.h"
 #include "framework/utils.h"
 #include "shader.h"
+#include "gl_state.h"
+#include "skinning.h"
 #include "framework/includes.h"
 #include "framework/framework.h"
 
@@ -13,14 +15,18 @@
 
 #include "framework/camera.h"
 #include "texture.h"
+#include "material.h"
+#include "texture_streamer.h"
 #include "framework/animation.h"
+#include "framework/profiler.h"
+#include "framework/resource_manager.h"
 #include "framework/extra/coldet/coldet.h"
 
 bool Mesh::use_binary = true;			//checks if there is .wbin, it there is one tries to read it instead of the other file
 bool Mesh::auto_upload_to_vram = true;	//uploads the mesh to the GPU VRAM to speed up rendering
 bool Mesh::interleave_meshes = true;	//places the geometry in an interleaved array
+bool Mesh::use_vertex_arrays = true;	//records the attributes setup of the meshes in VRAM in VAOs, so binding them is one call
 
-std::map<std::string, Mesh*> Mesh::sMeshesLoaded;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
 
@@ -39,6 +45,7 @@ Mesh::Mesh()
 
 Mesh::~Mesh()
 {
+	ResourceManager::remove(this);
 	clear();
 }
 
@@ -47,23 +54,25 @@ void Mesh::clear()
 {
 	//Free VBOs
 	if (vertices_vbo_id)
-		glDeleteBuffersARB(1, &vertices_vbo_id);
+		GLState::deleteBuffers(1, &vertices_vbo_id);
 	if (uvs_vbo_id)
-		glDeleteBuffersARB(1, &uvs_vbo_id);
+		GLState::deleteBuffers(1, &uvs_vbo_id);
 	if (normals_vbo_id)
-		glDeleteBuffersARB(1, &normals_vbo_id);
+		GLState::deleteBuffers(1, &normals_vbo_id);
 	if (colors_vbo_id)
-		glDeleteBuffersARB(1, &colors_vbo_id);
+		GLState::deleteBuffers(1, &colors_vbo_id);
 	if (interleaved_vbo_id)
-		glDeleteBuffersARB(1, &interleaved_vbo_id);
+		GLState::deleteBuffers(1, &interleaved_vbo_id);
 	if (indices_vbo_id)
-		glDeleteBuffersARB(1, &indices_vbo_id);
+		GLState::deleteBuffers(1, &indices_vbo_id);
 	if (bones_vbo_id)
-		glDeleteBuffersARB(1, &bones_vbo_id);
+		GLState::deleteBuffers(1, &bones_vbo_id);
 	if (weights_vbo_id)
-		glDeleteBuffersARB(1, &weights_vbo_id);
+		GLState::deleteBuffers(1, &weights_vbo_id);
 	if (uvs1_vbo_id)
-		glDeleteBuffersARB(1, &uvs1_vbo_id);
+		GLState::deleteBuffers(1, &uvs1_vbo_id);
+
+	clearVertexArrays();
 
 	//VBOs ids
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = uvs1_vbo_id = 0;
@@ -81,6 +90,50 @@ void Mesh::clear()
 
 	if (collision_model)
 		delete (CollisionModel3D*)collision_model;
+	collision_model = NULL;
+
+	std::lock_guard<std::mutex> lock(bone_remaps_mutex);
+	bone_remaps.clear();
+}
+
+bool Mesh::sBoneRemap::matches(const Skeleton* skeleton) const
+{
+	if ((int)skeleton_names.size() != skeleton->num_bones)
+		return false;
+	for (int i = 0; i < skeleton->num_bones; ++i)
+		if (skeleton_parents[i] != skeleton->bones[i].parent || skeleton_names[i] != skeleton->bones[i].name)
+			return false;
+	return true;
+}
+
+const Mesh::sBoneRemap& Mesh::getBoneRemap(const Skeleton* skeleton)
+{
+	//the entries are never removed while the mesh is alive, so the reference stays valid after unlocking
+	std::lock_guard<std::mutex> lock(bone_remaps_mutex);
+	auto range = bone_remaps.equal_range(skeleton->layout_id);
+	for (auto it = range.first; it != range.second; ++it)
+		if (it->second.matches(skeleton))
+			return it->second;
+
+	//first time with these bones (or another skeleton with the same hash)
+	sBoneRemap& remap = bone_remaps.emplace(skeleton->layout_id, sBoneRemap())->second;
+	for (int i = 0; i < skeleton->num_bones; ++i)
+	{
+		remap.skeleton_names.push_back(skeleton->bones[i].name);
+		remap.skeleton_parents.push_back(skeleton->bones[i].parent);
+	}
+
+	int num = (int)bones_info.size();
+	remap.bones.resize(num);
+	remap.bind_matrices.resize(num);
+	for (int i = 0; i < num; ++i)
+	{
+		BoneInfo& bone_info = bones_info[i];
+		auto it = skeleton->bones_by_name.find(bone_info.name);
+		remap.bones[i] = it == skeleton->bones_by_name.end() ? -1 : it->second;
+		remap.bind_matrices[i] = bind_matrix * bone_info.bind_pose;
+	}
+	return remap;
 }
 
 int vertex_location = -1;
@@ -90,10 +143,59 @@ int color_location = -1;
 int bones_location = -1;
 int weights_location = -1;
 int uv1_location = -1;
+GLuint bound_vertex_array = 0; //VAO bound by the last enableBuffers, 0 if the attributes were set one by one
+
+void Mesh::clearVertexArrays()
+{
+	for (sVertexArray& va : vertex_arrays)
+	{
+		if (bound_vertex_array == va.vao)
+			bound_vertex_array = 0;
+		GLState::deleteVertexArrays(1, &va.vao);
+	}
+	vertex_arrays.clear();
+}
 
 void Mesh::enableBuffers(Shader* sh)
 {
-	vertex_location = sh->getAttribLocation("a_vertex");
+	bool record = false; //creating a VAO, the setup below is stored in it
+
+	if (use_vertex_arrays && glGenVertexArrays && (interleaved_vbo_id || vertices_vbo_id))
+	{
+		int layout[MESH_NUM_ATTRIBS] = {
+			sh->getAttribLocation(SHADER_VAR("a_vertex")),
+			sh->getAttribLocation(SHADER_VAR("a_normal")),
+			sh->getAttribLocation(SHADER_VAR("a_uv")),
+			sh->getAttribLocation(SHADER_VAR("a_uv1")),
+			sh->getAttribLocation(SHADER_VAR("a_color")),
+			sh->getAttribLocation(SHADER_VAR("a_bones")),
+			sh->getAttribLocation(SHADER_VAR("a_weights"))
+		};
+
+		for (sVertexArray& va : vertex_arrays)
+		{
+			if (memcmp(va.layout, layout, sizeof(layout)) != 0)
+				continue;
+			GLState::bindVertexArray(va.vao);
+			bound_vertex_array = va.vao;
+			return;
+		}
+
+		sVertexArray va;
+		memcpy(va.layout, layout, sizeof(layout));
+		glGenVertexArrays(1, &va.vao);
+		vertex_arrays.push_back(va);
+		GLState::bindVertexArray(va.vao);
+		bound_vertex_array = va.vao;
+		record = true;
+	}
+	else
+	{
+		GLState::bindVertexArray(0);
+		bound_vertex_array = 0;
+	}
+
+	vertex_location = sh->getAttribLocation(SHADER_VAR("a_vertex"));
 	assert(vertex_location != -1 && "No a_vertex found in shader");
 
 	if (vertex_location == -1)
@@ -114,7 +216,7 @@ void Mesh::enableBuffers(Shader* sh)
 
 	if (vertices_vbo_id || interleaved_vbo_id)
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
 		glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
 	}
 	else
@@ -123,13 +225,13 @@ void Mesh::enableBuffers(Shader* sh)
 	normal_location = -1;
 	if (normals.size() || spacing)
 	{
-		normal_location = sh->getAttribLocation("a_normal");
+		normal_location = sh->getAttribLocation(SHADER_VAR("a_normal"));
 		if (normal_location != -1)
 		{
 			glEnableVertexAttribArray(normal_location);
 			if (normals_vbo_id || interleaved_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
 				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
 			}
 			else
@@ -140,13 +242,13 @@ void Mesh::enableBuffers(Shader* sh)
 	uv_location = -1;
 	if (uvs.size() || spacing)
 	{
-		uv_location = sh->getAttribLocation("a_uv");
+		uv_location = sh->getAttribLocation(SHADER_VAR("a_uv"));
 		if (uv_location != -1)
 		{
 			glEnableVertexAttribArray(uv_location);
 			if (uvs_vbo_id || interleaved_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
 				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
 			}
 			else
@@ -157,13 +259,13 @@ void Mesh::enableBuffers(Shader* sh)
 	uv1_location = -1;
 	if (uvs1.size())
 	{
-		uv1_location = sh->getAttribLocation("a_uv1");
+		uv1_location = sh->getAttribLocation(SHADER_VAR("a_uv1"));
 		if (uv1_location != -1)
 		{
 			glEnableVertexAttribArray(uv1_location);
 			if (uvs1_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, uvs1_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, uvs1_vbo_id);
 				glVertexAttribPointer(uv1_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)NULL);
 			}
 			else
@@ -174,13 +276,13 @@ void Mesh::enableBuffers(Shader* sh)
 	color_location = -1;
 	if (colors.size())
 	{
-		color_location = sh->getAttribLocation("a_color");
+		color_location = sh->getAttribLocation(SHADER_VAR("a_color"));
 		if (color_location != -1)
 		{
 			glEnableVertexAttribArray(color_location);
 			if (colors_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
 				glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 			}
 			else
@@ -191,13 +293,13 @@ void Mesh::enableBuffers(Shader* sh)
 	bones_location = -1;
 	if (bones.size())
 	{
-		bones_location = sh->getAttribLocation("a_bones");
+		bones_location = sh->getAttribLocation(SHADER_VAR("a_bones"));
 		if (bones_location != -1)
 		{
 			glEnableVertexAttribArray(bones_location);
 			if (bones_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
 				glVertexAttribPointer(bones_location, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, NULL);
 			}
 			else
@@ -207,13 +309,13 @@ void Mesh::enableBuffers(Shader* sh)
 	weights_location = -1;
 	if (weights.size())
 	{
-		weights_location = sh->getAttribLocation("a_weights");
+		weights_location = sh->getAttribLocation(SHADER_VAR("a_weights"));
 		if (weights_location != -1)
 		{
 			glEnableVertexAttribArray(weights_location);
 			if (weights_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
+				GLState::bindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
 				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 			}
 			else
@@ -221,9 +323,12 @@ void Mesh::enableBuffers(Shader* sh)
 		}
 	}
 
+	//the index buffer binding is stored in the VAO too
+	if (record && indices_vbo_id)
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 }
 
-void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
+void Mesh::render(unsigned int primitive, int submesh_id, int num_instances, const Material* material)
 {
 	Shader* shader = Shader::current;
 	if (!shader || !shader->compiled)
@@ -239,24 +344,39 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 	//draw call
 	if (submesh_id == -1 && !materials.empty()) // if there's mesh mtl
 	{
+		Texture* last_texture = nullptr; //materials packed in the same array share the binding
 		for (int i = 0; i < submeshes.size(); ++i) {
 			sSubmeshInfo& submesh = submeshes[i];
 			for (uint32_t j = 0; j < submesh.num_draw_calls; ++j) {
 				const sSubmeshDrawCallInfo& dc = submesh.draw_calls[j];
 				if (materials.count(dc.material) > 0) {
-					shader->setUniform("u_Ka", materials[dc.material].Ka);
-					shader->setUniform("u_Kd", materials[dc.material].Kd);
-					shader->setUniform("u_Ks", materials[dc.material].Ks);
-
-					if (materials[dc.material].Kd_texture && materials[dc.material].Kd_texture->texture_id != 0) {
-						shader->setUniform("u_texture", materials[dc.material].Kd_texture, 0);
+					shader->setUniform(SHADER_VAR("u_Ka"), materials[dc.material].Ka);
+					shader->setUniform(SHADER_VAR("u_Kd"), materials[dc.material].Kd);
+					shader->setUniform(SHADER_VAR("u_Ks"), materials[dc.material].Ks);
+
+					Texture* texture = materials[dc.material].Kd_texture;
+					int layer = -1;
+					if (material && material->mesh_layers) {
+						auto it = material->mesh_layers->layers.find(dc.material);
+						if (it != material->mesh_layers->layers.end()) {
+							texture = it->second.texture;
+							layer = it->second.layer;
+						}
+					}
+					if (texture && texture->texture_id != 0) {
+						if (texture != last_texture)
+							shader->setUniform(SHADER_VAR("u_texture"), texture, 0);
+						if (layer != -1)
+							shader->setUniform(SHADER_VAR("u_texture_layer"), (float)layer);
+						last_texture = texture;
 					}
 					else {
-						glActiveTexture(GL_TEXTURE0);
-						glBindTexture(GL_TEXTURE_2D, 0);
+						GLState::activeTexture(GL_TEXTURE0);
+						GLState::bindTexture(GL_TEXTURE_2D, 0);
+						last_texture = nullptr;
 					}
 
-					shader->setUniform("u_maps", Vector2(!!materials[dc.material].Kd_texture, 0));
+					shader->setUniform(SHADER_VAR("u_maps"), Vector2(!!materials[dc.material].Kd_texture, 0));
 				}
 				drawCall(primitive, i, j, num_instances);
 			}
@@ -294,17 +414,21 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int draw_call_id, in
 		if (num_instances > 0)
 		{
 			assert(indices_vbo_id && "indices must be uploaded to the GPU");
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+			if (!bound_vertex_array)
+				GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 			glDrawElementsInstanced(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3)), num_instances);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			if (!bound_vertex_array)
+				GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		}
 		else
 		{
-			if (indices_vbo_id)
+			if (bound_vertex_array) //index buffer already in the VAO
+				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3)));
+			else if (indices_vbo_id)
 			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+				GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3)));
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+				GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 			}
 			else
 				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
@@ -324,6 +448,13 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int draw_call_id, in
 
 void Mesh::disableBuffers(Shader* shader)
 {
+	//the VAO stays bound, other meshes bind their own and the rest of the code binds 0 before touching attributes
+	if (bound_vertex_array)
+	{
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0); //client pointers after this would be read as offsets
+		return;
+	}
+
 	glDisableVertexAttribArray(vertex_location);
 	if (normal_location != -1) glDisableVertexAttribArray(normal_location);
 	if (uv_location != -1) glDisableVertexAttribArray(uv_location);
@@ -331,26 +462,27 @@ void Mesh::disableBuffers(Shader* shader)
 	if (color_location != -1) glDisableVertexAttribArray(color_location);
 	if (bones_location != -1) glDisableVertexAttribArray(bones_location);
 	if (weights_location != -1) glDisableVertexAttribArray(weights_location);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);    //if crashes here, COMMENT THIS LINE ****************************
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);    //if crashes here, COMMENT THIS LINE ****************************
 }
 
 GLuint instances_buffer_id = 0;
 
 //should be faster but in some system it is slower
-void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int num_instances)
+void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int num_instances, const Material* material)
 {
 	if (!num_instances)
 		return;
 
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
+	enableBuffers(shader); //the instanced attribs go to the VAO of the mesh (and are disabled after)
 
 	if (instances_buffer_id == 0)
 		glGenBuffersARB(1, &instances_buffer_id);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
+	GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
 	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(Matrix44), instanced_models, GL_STREAM_DRAW_ARB);
 
-	int attribLocation = shader->getAttribLocation("u_model");
+	int attribLocation = shader->getAttribLocation(SHADER_VAR("u_model"));
 	assert(attribLocation != -1 && "shader must have attribute mat4 u_model (not a uniform)");
 	if (attribLocation == -1)
 		return; //this shader doesnt support instanced model
@@ -366,7 +498,7 @@ void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_mod
 	}
 
 	//regular render
-	render(primitive, -1, num_instances);
+	render(primitive, -1, num_instances, material);
 
 	//disable instanced attribs
 	for (int k = 0; k < 4; ++k)
@@ -384,10 +516,11 @@ void Mesh::renderInstanced(unsigned int primitive, const std::vector<Vector3> po
 
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
+	enableBuffers(shader); //the instanced attribs go to the VAO of the mesh (and are disabled after)
 
 	if (instances_buffer_id == 0)
 		glGenBuffersARB(1, &instances_buffer_id);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
+	GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
 	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(Vector3), &positions[0], GL_STREAM_DRAW_ARB);
 
 	int attribLocation = shader->getAttribLocation(uniform_name);
@@ -413,6 +546,8 @@ void Mesh::renderFixedPipeline(int primitive)
 {
 	assert((vertices.size() || interleaved.size()) && "No vertices in this mesh");
 
+	GLState::bindVertexArray(0); //client arrays are part of the VAO state
+
 	int interleave_offset = interleaved.size() ? sizeof(tInterleaved) : 0;
 	int offset_normal = sizeof(Vector3);
 	int offset_uv = sizeof(Vector3) + sizeof(Vector3);
@@ -421,7 +556,7 @@ void Mesh::renderFixedPipeline(int primitive)
 
 	if (vertices_vbo_id || interleaved_vbo_id)
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, interleave_offset ? interleaved_vbo_id : vertices_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, interleave_offset ? interleaved_vbo_id : vertices_vbo_id);
 		glVertexPointer(3, GL_FLOAT, interleave_offset, 0);
 	}
 	else
@@ -432,7 +567,7 @@ void Mesh::renderFixedPipeline(int primitive)
 		glEnableClientState(GL_NORMAL_ARRAY);
 		if (normals_vbo_id || interleaved_vbo_id)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
 			glNormalPointer(GL_FLOAT, interleave_offset, (void*)offset_normal);
 		}
 		else
@@ -444,7 +579,7 @@ void Mesh::renderFixedPipeline(int primitive)
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 		if (uvs_vbo_id || interleaved_vbo_id)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
 			glTexCoordPointer(2, GL_FLOAT, interleave_offset, (void*)offset_uv);
 		}
 		else
@@ -456,7 +591,7 @@ void Mesh::renderFixedPipeline(int primitive)
 		glEnableClientState(GL_COLOR_ARRAY);
 		if (colors_vbo_id)
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
 			glColorPointer(4, GL_FLOAT, 0, NULL);
 		}
 		else
@@ -475,26 +610,79 @@ void Mesh::renderFixedPipeline(int primitive)
 		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 	if (colors.size())
 		glDisableClientState(GL_COLOR_ARRAY);
-	glBindBuffer(GL_ARRAY_BUFFER, 0); //if it crashes, comment this line
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0); //if it crashes, comment this line
 }
 
 void Mesh::renderAnimated(unsigned int primitive, Skeleton* skeleton)
 {
 	Shader* shader = Shader::current;
-	std::vector<Matrix44> bone_matrices;
+	static std::vector<Matrix44> bone_matrices; //reused to avoid allocating every draw
 	assert(bones.size());
-	int bones_loc = shader->getUniformLocation("u_bones");
+	int bones_loc = shader->getUniformLocation(SHADER_VAR("u_bones"));
 	if (bones_loc != -1)
 	{
 		skeleton->computeFinalBoneMatrices(bone_matrices, this);
-		shader->setUniform("u_bones", bone_matrices);
+		shader->setUniform(SHADER_VAR("u_bones"), bone_matrices);
 	}
 
 	render(primitive);
 }
 
+void Mesh::renderAnimated(unsigned int primitive, std::vector<Matrix44>& bone_matrices)
+{
+	Shader* shader = Shader::current;
+	assert(bones.size() && bone_matrices.size() == bones_info.size());
+	if (shader->getUniformLocation(SHADER_VAR("u_bones")) != -1)
+		shader->setUniform(SHADER_VAR("u_bones"), bone_matrices);
+
+	render(primitive);
+}
+
+void Mesh::renderAnimated(unsigned int primitive, int bones_offset)
+{
+	Shader* shader = Shader::current;
+	assert(bones.size() && bones_offset >= 0);
+	SkinningBuffer::Get()->bind(shader);
+	shader->setUniform(SHADER_VAR("u_bones_offset"), bones_offset);
+
+	render(primitive);
+}
+
+GLuint bones_offsets_buffer_id = 0;
+
+void Mesh::renderAnimatedInstanced(unsigned int primitive, const Matrix44* instanced_models, const float* bones_offsets, int num_instances)
+{
+	if (!num_instances)
+		return;
+
+	Shader* shader = Shader::current;
+	assert(shader && "shader must be enabled");
+	SkinningBuffer::Get()->bind(shader);
+	enableBuffers(shader);
+
+	int offsetLocation = shader->getAttribLocation(SHADER_VAR("a_bones_offset"));
+	assert(offsetLocation != -1 && "shader must have attribute float a_bones_offset");
+	if (offsetLocation == -1)
+		return;
+
+	if (bones_offsets_buffer_id == 0)
+		glGenBuffersARB(1, &bones_offsets_buffer_id);
+	GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, bones_offsets_buffer_id);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(float), bones_offsets, GL_STREAM_DRAW_ARB);
+	glEnableVertexAttribArray(offsetLocation);
+	glVertexAttribPointer(offsetLocation, 1, GL_FLOAT, false, sizeof(float), 0);
+	glVertexAttribDivisor(offsetLocation, 1);
+
+	//models and regular render
+	renderInstanced(primitive, instanced_models, num_instances);
+
+	glDisableVertexAttribArray(offsetLocation);
+	glVertexAttribDivisor(offsetLocation, 0);
+}
+
 void Mesh::uploadToVRAM()
 {
+	assert(GLState::isGLThread() && "mesh upload outside the GL thread");
 	assert(vertices.size() || interleaved.size());
 
 	if (glGenBuffersARB == 0)
@@ -503,12 +691,16 @@ void Mesh::uploadToVRAM()
 		exit(0);
 	}
 
+	//the streams may change, the VAOs are created again when rendering (and 0 is bound so the index buffer does not go into one)
+	clearVertexArrays();
+	GLState::bindVertexArray(0);
+
 	if (interleaved.size())
 	{
 		// Vertex,Normal,UV
 		if (interleaved_vbo_id == 0)
 			glGenBuffersARB(1, &interleaved_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, interleaved_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, interleaved_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, interleaved.size() * sizeof(tInterleaved), &interleaved[0], GL_STATIC_DRAW_ARB);
 	}
 	else
@@ -516,7 +708,7 @@ void Mesh::uploadToVRAM()
 		// Vertices
 		if (vertices_vbo_id == 0)
 			glGenBuffersARB(1, &vertices_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertices.size() * sizeof(Vector3), &vertices[0], GL_STATIC_DRAW_ARB);
 
 		// UVs
@@ -524,7 +716,7 @@ void Mesh::uploadToVRAM()
 		{
 			if (uvs_vbo_id == 0)
 				glGenBuffersARB(1, &uvs_vbo_id);
-			glBindBufferARB(GL_ARRAY_BUFFER_ARB, uvs_vbo_id);
+			GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, uvs_vbo_id);
 			glBufferDataARB(GL_ARRAY_BUFFER_ARB, uvs.size() * sizeof(Vector2), &uvs[0], GL_STATIC_DRAW_ARB);
 		}
 
@@ -533,7 +725,7 @@ void Mesh::uploadToVRAM()
 		{
 			if (normals_vbo_id == 0)
 				glGenBuffersARB(1, &normals_vbo_id);
-			glBindBufferARB(GL_ARRAY_BUFFER_ARB, normals_vbo_id);
+			GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, normals_vbo_id);
 			glBufferDataARB(GL_ARRAY_BUFFER_ARB, normals.size() * sizeof(Vector3), &normals[0], GL_STATIC_DRAW_ARB);
 		}
 	}
@@ -543,7 +735,7 @@ void Mesh::uploadToVRAM()
 	{
 		if (uvs1_vbo_id == 0)
 			glGenBuffersARB(1, &uvs1_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, uvs1_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, uvs1_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, uvs1.size() * sizeof(Vector2), &uvs1[0], GL_STATIC_DRAW_ARB);
 	}
 
@@ -552,7 +744,7 @@ void Mesh::uploadToVRAM()
 	{
 		if (colors_vbo_id == 0)
 			glGenBuffersARB(1, &colors_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, colors_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, colors_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, colors.size() * sizeof(Vector4), &colors[0], GL_STATIC_DRAW_ARB);
 	}
 
@@ -560,36 +752,44 @@ void Mesh::uploadToVRAM()
 	{
 		if (bones_vbo_id == 0)
 			glGenBuffersARB(1, &bones_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, bones_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, bones_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, bones.size() * sizeof(Vector4ub), &bones[0], GL_STATIC_DRAW_ARB);
 	}
 	if (weights.size())
 	{
 		if (weights_vbo_id == 0)
 			glGenBuffersARB(1, &weights_vbo_id);
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, weights_vbo_id);
+		GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, weights_vbo_id);
 		glBufferDataARB(GL_ARRAY_BUFFER_ARB, weights.size() * sizeof(Vector4), &weights[0], GL_STATIC_DRAW_ARB);
 	}
 
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER_ARB, 0);
 
 	// Indices
 	if (indices.size())
 	{
 		if (indices_vbo_id == 0)
 			glGenBuffersARB(1, &indices_vbo_id);
-		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
 		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(Vector3u), &indices[0], GL_STATIC_DRAW_ARB);
 	}
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 
 
 	checkGLErrors();
+	ResourceManager::updateSize(this); //the streams are in VRAM now
 
 	//clear buffers to save memory
 }
 
+size_t Mesh::getVertexBytes()
+{
+	return vertices.size() * sizeof(Vector3) + normals.size() * sizeof(Vector3) + uvs.size() * sizeof(Vector2) +
+		uvs1.size() * sizeof(Vector2) + colors.size() * sizeof(Vector4) + interleaved.size() * sizeof(tInterleaved) +
+		indices.size() * sizeof(Vector3u) + bones.size() * sizeof(Vector4ub) + weights.size() * sizeof(Vector4);
+}
+
 bool Mesh::createCollisionModel(bool is_static)
 {
 	if (collision_model)
@@ -1153,7 +1353,7 @@ bool Mesh::parseMTL(const char* filename)
 		else if (tokens[0] == "map_Kd")
 		{
 			std::filesystem::path mesh_path = std::filesystem::path(filename);
-			info.Kd_texture = Texture::Get((mesh_path.parent_path().string() + "/" + tokens[1]).c_str());
+			info.Kd_filename = mesh_path.parent_path().string() + "/" + tokens[1];
 		}
 		else if (tokens[0] == "newmtl") //material file
 		{
@@ -1720,9 +1920,24 @@ Mesh* Mesh::getQuad()
 Mesh* Mesh::Get(const char* filename)
 {
 	assert(filename);
-	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
-	if (it != sMeshesLoaded.end())
-		return it->second;
+	Mesh* m = (Mesh*)ResourceManager::find(RESOURCE_MESH, filename);
+	if (m)
+		return m;
+
+	PROFILE_SCOPE("Mesh::Get");
+	Profiler::setZoneDetail(filename);
+
+	m = Decode(filename);
+	if (!m)
+		return NULL;
+	return Upload(m);
+}
+
+Mesh* Mesh::Decode(const char* filename)
+{
+	assert(filename);
+	PROFILE_SCOPE("Mesh::Decode");
+	Profiler::setZoneDetail(filename);
 
 	Mesh* m = new Mesh();
 	std::string name = filename;
@@ -1742,12 +1957,12 @@ Mesh* Mesh::Get(const char* filename)
 	else
 	{
 		std::cerr << "Unknown mesh format: " << filename << std::endl;
+		delete m;
 		return NULL;
 	}
 
 	//stats
 	long time = getTime();
-	std::cout << " + Mesh loading: " << filename << " ... ";
 	std::string binfilename = filename;
 
 	if (file_format != FORMAT_MBIN)
@@ -1757,19 +1972,9 @@ Mesh* Mesh::Get(const char* filename)
 	if (use_binary && m->readBin(binfilename.c_str()))
 	{
 		if (interleave_meshes && m->interleaved.size() == 0)
-		{
-			std::cout << "[INTERL] ";
 			m->interleaveBuffers();
-		}
-
-		if (auto_upload_to_vram)
-		{
-			std::cout << "[VRAM] ";
-			m->uploadToVRAM();
-		}
 
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-		sMeshesLoaded[filename] = m;
+		std::cout << " + Mesh loaded: " << filename << " [OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 		return m;
 	}
 
@@ -1785,37 +1990,49 @@ Mesh* Mesh::Get(const char* filename)
 	if (!loaded)
 	{
 		delete m;
-		std::cout << "[ERROR]: Mesh not found" << std::endl;
+		std::cout << "[ERROR]: Mesh not found: " << filename << std::endl;
 		return NULL;
 	}
 
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
-	{
-		std::cout << "[INTERL] ";
 		m->interleaveBuffers();
-	}
-
-	//and upload them to VRAM
-	if (auto_upload_to_vram)
-	{
-		std::cout << "[VRAM] ";
-		m->uploadToVRAM();
-	}
 
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << " + Mesh loaded: " << filename << " [OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	if (use_binary)
-	{
-		std::cout << "\t\t Writing .BIN ... ";
 		m->writeBin(filename);
-		std::cout << "[OK]" << std::endl;
+	return m;
+}
+
+Mesh* Mesh::Upload(Mesh* m)
+{
+	assert(m);
+
+	//another load got there first
+	Mesh* registered = (Mesh*)ResourceManager::find(RESOURCE_MESH, m->name);
+	if (registered)
+	{
+		delete m;
+		return registered;
 	}
 
-	m->registerMesh(name);
+	PROFILE_SCOPE("Mesh::Upload");
+	Profiler::setZoneDetail(m->name);
+
+	//the textures of its materials are referenced by the mesh
+	ResourceManager::beginLoad();
+	for (auto& it : m->materials)
+		if (it.second.Kd_filename.size() && !it.second.Kd_texture)
+			it.second.Kd_texture = TextureStreamer::Get(it.second.Kd_filename.c_str(), true, true, true); //diffuse colors are sRGB
+
+	if (auto_upload_to_vram)
+		m->uploadToVRAM();
+
+	ResourceManager::add(RESOURCE_MESH, m->name, m, ResourceManager::endLoad());
 	return m;
 }
 
 void Mesh::registerMesh(std::string name)
 {
-	sMeshesLoaded[name] = this;
+	ResourceManager::add(RESOURCE_MESH, name, this);
 }
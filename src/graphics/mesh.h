@@ -5,16 +5,19 @@
 
 #include <map>
 #include <string>
+#include <mutex>
 
 class Shader; //for binding
 class Image; //for displace
 class Skeleton; //for skinned meshes
 class Texture;
+class Material;
 
 //version from 21/01/2024
 #define MESH_BIN_VERSION 12 //this is used to regenerate bins if the format changes
 
 #define MAX_SUBMESH_DRAW_CALLS 16
+#define MESH_NUM_ATTRIBS 7 //vertex streams bound by enableBuffers
 
 struct BoneInfo {
 	char name[32]; //max 32 chars per bone name
@@ -41,17 +44,18 @@ struct sMaterialInfo
 	Vector3 Kd;
 	Vector3 Ks;
 	Texture* Kd_texture = nullptr;
+	std::string Kd_filename; //map_Kd, the texture is requested when the mesh is uploaded (see Mesh::Upload)
 };
 
 class Mesh
 {
 public:
-	static std::map<std::string, Mesh*> sMeshesLoaded;
 	static bool use_binary; //always load the binary version of a mesh when possible
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
+	static bool use_vertex_arrays; //meshes in VRAM keep their attributes setup in VAOs
 
 	std::string name;
 
@@ -80,6 +84,18 @@ public:
 	std::vector< BoneInfo > bones_info; //tells 
 	Matrix44 bind_matrix;
 
+	//skeleton bone of every mesh bone and the bind matrices already multiplied, one per skeleton layout (computeFinalBoneMatrices)
+	struct sBoneRemap {
+		std::vector<int> bones; //-1 if the skeleton does not have it
+		std::vector<Matrix44> bind_matrices;
+		std::vector<std::string> skeleton_names; //bones of the skeleton it was built for, the layout_id is only a hash
+		std::vector<int> skeleton_parents;
+		bool matches(const Skeleton* skeleton) const;
+	};
+	std::multimap<uint32, sBoneRemap> bone_remaps; //by Skeleton::layout_id, the nodes do not move when others are added
+	std::mutex bone_remaps_mutex; //animators of different skeletons can ask from several jobs
+	const sBoneRemap& getBoneRemap(const Skeleton* skeleton); //cache the pointer, it locks
+
 	Vector3 aabb_min;
 	Vector3	aabb_max;
 	BoundingBox box;
@@ -97,17 +113,28 @@ public:
 	unsigned int weights_vbo_id;
 	unsigned int uvs1_vbo_id;
 
+	//one VAO for every layout of attribute locations (shaders with the same layout share it), created when rendering
+	struct sVertexArray {
+		int layout[MESH_NUM_ATTRIBS]; //location of every stream (a_vertex, a_normal, a_uv, a_uv1, a_color, a_bones, a_weights)
+		unsigned int vao;
+	};
+	std::vector<sVertexArray> vertex_arrays;
+	void clearVertexArrays();
+
 	Mesh();
 	~Mesh();
 
 	void clear();
 
-	void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0);
-	void renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int number);
+	void render(unsigned int primitive, int submesh_id = -1, int num_instances = 0, const Material* material = NULL); //material can replace the textures of the mesh materials
+	void renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int number, const Material* material = NULL);
 	void renderInstanced(unsigned int primitive, const std::vector<Vector3> positions, const char* uniform_name);
 	void renderBounding(const Matrix44& model, bool world_bounding = true);
 	void renderFixedPipeline(int primitive); //sloooooooow
 	void renderAnimated(unsigned int primitive, Skeleton* sk);
+	void renderAnimated(unsigned int primitive, std::vector<Matrix44>& bone_matrices); //bones already computed (Animator::getBoneMatrices)
+	void renderAnimated(unsigned int primitive, int bones_offset); //bones in the SkinningBuffer (shader with BONES_BUFFER)
+	void renderAnimatedInstanced(unsigned int primitive, const Matrix44* instanced_models, const float* bones_offsets, int num_instances); //shader with BONES_BUFFER and INSTANCED
 
 	void enableBuffers(Shader* shader);
 	void drawCall(unsigned int primitive, int submesh_id, int draw_call_id, int num_instances);
@@ -117,6 +144,7 @@ public:
 	bool writeBin(const char* filename);
 
 	unsigned int getNumSubmeshes() { return (unsigned int)submeshes.size(); }
+	size_t getVertexBytes(); //of every stream, what uploadToVRAM sends
 	unsigned int getNumVertices() { return (unsigned int)interleaved.size() ? (unsigned int)interleaved.size() : (unsigned int)vertices.size(); }
 
 	//collision testing
@@ -126,10 +154,16 @@ public:
 	bool testRayCollision(Matrix44 model, Vector3 ray_origin, Vector3 ray_direction, Vector3& collision, Vector3& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false);
 	bool testSphereCollision(Matrix44 model, Vector3 center, float radius, Vector3& collision, Vector3& normal);
 
-	//loader
+	//loader (cached in the ResourceManager), it is Decode and Upload in this thread
 	static Mesh* Get(const char* filename);
 	void registerMesh(std::string name);
 
+	//CPU part of Get: reads the .mbin (or parses the source and writes it) and interleaves, it can run in any thread
+	static Mesh* Decode(const char* filename);
+	//main thread: requests the textures, uploads to VRAM and registers it. If a mesh with that name was registered
+	//meanwhile the decoded one is deleted and the registered one returned
+	static Mesh* Upload(Mesh* mesh);
+
 	//create help meshes
 	void createQuad(float center_x, float center_y, float w, float h, bool flip_uvs);
 	void createPlane(float size);
@@ -147,6 +181,7 @@ public:
 	bool interleaveBuffers();
 
 private:
+	//parsers of the source formats, Decode picks one from the extension and caches the result as .mbin
 	bool loadASE(const char* filename);
 	bool loadOBJ(const char* filename);
 	bool parseMTL(const char* filename);
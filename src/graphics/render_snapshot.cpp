@@ -0,0 +1,60 @@
+#include "render_snapshot.h"
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+#include "framework/entities/entity.h"
+#include "framework/profiler.h"
+
+void RenderSnapshot::clear()
+{
+	items.clear();
+	instances.clear();
+}
+
+void RenderSnapshot::capture(Entity* root, Camera* camera)
+{
+	PROFILE_SCOPE("capture snapshot");
+	clear();
+	this->camera = *camera;
+	if (root)
+		root->addRenderItems(this);
+}
+
+void RenderSnapshot::add(Mesh* mesh, const Material& material, const Matrix44& model)
+{
+	items.push_back({ mesh, material, model, -1, 0 });
+}
+
+void RenderSnapshot::addInstanced(Mesh* mesh, const Material& material, const std::vector<Matrix44>& models)
+{
+	items.push_back({ mesh, material, Matrix44(), (int)instances.size(), (int)models.size() });
+	instances.insert(instances.end(), models.begin(), models.end());
+}
+
+//same as EntityMesh::render, but with the copies
+void RenderSnapshot::render()
+{
+	camera.enable();
+
+	for (sRenderItem& item : items)
+	{
+		Shader* shader = item.material.shader;
+		shader->enable();
+
+		shader->setUniform(SHADER_VAR("u_viewprojection"), camera.viewprojection_matrix);
+		shader->setUniform(SHADER_VAR("u_color"), item.material.color);
+
+		if (item.material.diffuse) {
+			shader->setUniform(SHADER_VAR("u_texture"), item.material.diffuse, 0);
+			if (item.material.diffuse_layer != -1)
+				shader->setUniform(SHADER_VAR("u_texture_layer"), (float)item.material.diffuse_layer);
+		}
+
+		if (item.first_instance != -1)
+			item.mesh->renderInstanced(GL_TRIANGLES, &instances[item.first_instance], item.num_instances, &item.material);
+		else {
+			shader->setUniform(SHADER_VAR("u_model"), item.model);
+			item.mesh->render(GL_TRIANGLES, -1, 0, &item.material);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+/*  RenderSnapshot
+	Copy of what the render needs from the scene (the camera and the mesh, material and transform of every entity),
+	so a frame can be rendered while the next one is being updated in another thread (see Game::pipelined).
+	The entities add themselves with Entity::addRenderItems, the vectors keep their memory between frames.
+*/
+
+#pragma once
+
+#include "framework/camera.h"
+#include "graphics/material.h"
+
+#include <vector>
+
+class Mesh;
+class Entity;
+
+struct sRenderItem {
+	Mesh* mesh;
+	Material material;
+	Matrix44 model;
+	int first_instance; //in RenderSnapshot::instances, -1 if it is not instanced
+	int num_instances;
+};
+
+class RenderSnapshot {
+public:
+	Camera camera;
+	std::vector<sRenderItem> items;
+	std::vector<Matrix44> instances;
+
+	void clear();
+
+	// Copies the camera and the render items of the whole tree, it must not run at the same time than the update
+	void capture(Entity* root, Camera* camera);
+
+	void add(Mesh* mesh, const Material& material, const Matrix44& model);
+	void addInstanced(Mesh* mesh, const Material& material, const std::vector<Matrix44>& models);
+
+	// Draws every item with the camera of the snapshot (GL thread)
+	void render();
+};
@@ -1,4 +1,5 @@
 #include "render_to_texture.h"
+#include "gl_state.h"
 #include <iostream>
 
 //typedef void (APIENTRY * glGenFramebuffers_func)(GLsizei n, GLuint *framebuffers); glGenFramebuffers_func glGenFramebuffersEXT = NULL;
@@ -47,7 +48,7 @@ bool RenderToTexture::create(int width, int height, bool generate_mipmaps)
 	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depthbuffer);
 
 	glGenTextures(1, &texture_id);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
+	GLState::bindTexture(GL_TEXTURE_2D, texture_id);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,  width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -84,7 +85,7 @@ void RenderToTexture::disable()
 	glBindFramebufferEXT( GL_FRAMEBUFFER_EXT, 0);
 	if (generate_mipmaps)
 	{
-		glBindTexture(GL_TEXTURE_2D, texture_id);
+		GLState::bindTexture(GL_TEXTURE_2D, texture_id);
 		this->generateMipmaps();
 		//glGenerateMipmapEXT(GL_TEXTURE_2D);
 	}
@@ -1,7 +1,13 @@
 #include "shader.h"
+#include "gl_state.h"
 #include <cassert>
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
 #include "framework/utils.h"
+#include "framework/profiler.h"
+#include "framework/resource_manager.h"
 #include <algorithm> 
 #include <functional> 
 #include <cctype>
@@ -53,9 +59,10 @@ REGISTER_GLEXT(void, glUniformMatrix4fv, GLint location, GLsizei count, GLboolea
 
 #endif
 
-std::map<std::string, Shader*> Shader::s_Shaders;
 bool Shader::s_ready = false;
 Shader* Shader::current = NULL;
+bool Shader::use_binary_cache = true;
+std::string Shader::binary_cache_folder = "data/shaders/cache/";
 
 Shader::Shader()
 {
@@ -63,10 +70,12 @@ Shader::Shader()
 		Shader::init();
 	compiled = false;
 	from_atlas = false;
+	binary_hash = 0;
 }
 
 Shader::~Shader()
 {
+	ResourceManager::remove(this);
 	release();
 }
 
@@ -117,24 +126,27 @@ Shader* Shader::Get(const char* vsf, const char* psf, const char* macros)
 		name = std::string(vsf) + "," + std::string(psf ? psf : "") + (macros ? macros : "");
 	else
 		name = vsf;
-	std::map<std::string, Shader*>::iterator it = s_Shaders.find(name);
-	if (it != s_Shaders.end())
-		return it->second;
+	Shader* loaded = (Shader*)ResourceManager::find(RESOURCE_SHADER, name);
+	if (loaded)
+		return loaded;
 
 	if (!psf)
 		return NULL;
 
+	PROFILE_SCOPE("Shader::Get");
+	Profiler::setZoneDetail(name);
+
 	Shader* sh = new Shader();
 	if (!sh->load(vsf, psf, macros))
 		return NULL;
-	s_Shaders[name] = sh;
+	ResourceManager::add(RESOURCE_SHADER, name, sh);
 	return sh;
 }
 
 void Shader::ReloadAll()
 {
-	for (std::map<std::string, Shader*>::iterator it = s_Shaders.begin(); it != s_Shaders.end(); it++)
-		it->second->recompile();
+	for (void* shader : ResourceManager::getAll(RESOURCE_SHADER))
+		((Shader*)shader)->recompile();
 	if (!s_shader_atlas_filename.empty())
 		LoadAtlas(s_shader_atlas_filename.c_str());
 	std::cout << "Shaders recompiled" << std::endl;
@@ -161,6 +173,7 @@ void Shader::setMacros(const char* macros)
 
 bool Shader::LoadAtlas(const char* filename)
 {
+	PROFILE_SCOPE("Shader::LoadAtlas");
 	std::string content;
 	if (!readFile(filename, content))
 	{
@@ -241,15 +254,12 @@ bool Shader::LoadAtlas(const char* filename)
 		vs_code = macros + "\n" + vs_code;
 		fs_code = macros + "\n" + fs_code;
 
-		Shader* shader = NULL;
-		auto it = s_Shaders.find(name);
-		if (it == s_Shaders.end())
+		Shader* shader = (Shader*)ResourceManager::find(RESOURCE_SHADER, name);
+		if (!shader)
 		{
 			shader = new Shader();
-			s_Shaders[name] = shader;
+			ResourceManager::add(RESOURCE_SHADER, name, shader);
 		}
-		else
-			shader = it->second;
 
 		if (!shader->compileFromMemory(vs_code, fs_code))
 		{
@@ -296,15 +306,39 @@ bool Shader::hasInfoLog() const
 
 bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 {
+	assert(GLState::isGLThread() && "shader compile outside the GL thread");
 	if (glCreateProgram == 0)
 	{
 		std::cout << "Error: your graphics cards dont support shaders. Sorry." << std::endl;
 		exit(0);
 	}
 
+	static bool cache_cleaned = false;
+	if (use_binary_cache && !cache_cleaned)
+	{
+		CleanBinaryCache();
+		cache_cleaned = true;
+	}
+	Uint64 hash = use_binary_cache ? computeBinaryHash(vsm, psm) : 0;
+	Uint64 old_hash = binary_hash;
+	binary_hash = hash;
+
+	//the code changed (ReloadAll): the old binary will not be loaded again unless another shader has the same code
+	if (old_hash && old_hash != hash && !isBinaryInUse(old_hash))
+		std::remove(getBinaryFilename(old_hash).c_str());
+
+	if (hash && loadBinary(hash))
+	{
+		compiled = true;
+		return true;
+	}
+
 	program = glCreateProgram();
 	assert(glGetError() == GL_NO_ERROR);
 
+	if (hash && glGetProgramBinary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	if (!createVertexShaderObject(vsm))
 	{
 		printf("Vertex shader compilation failed\n");
@@ -338,6 +372,184 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 
 	compiled = true;
 
+	if (hash)
+		saveBinary(hash);
+
+	return true;
+}
+
+const std::string& Shader::getDriverString()
+{
+	static std::string driver;
+	if (driver.empty())
+	{
+		const GLubyte* strings[] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+		for (const GLubyte* str : strings)
+			driver += str ? (const char*)str : "";
+	}
+	return driver;
+}
+
+//FNV-1a 64 of the strings (with their final zero so "ab"+"c" is not "a"+"bc")
+static Uint64 hashStrings(std::initializer_list<const std::string*> strings)
+{
+	Uint64 hash = 14695981039346656037ull;
+	for (const std::string* str : strings)
+		for (size_t i = 0; i <= str->size(); ++i)
+			hash = (hash ^ (unsigned char)str->c_str()[i]) * 1099511628211ull;
+	return hash ? hash : 1; //0 means no hash
+}
+
+//the driver is part of the key because the binaries only work with the same driver
+Uint64 Shader::computeBinaryHash(const std::string& vsm, const std::string& psm)
+{
+	return hashStrings({ &getDriverString(), &vsm, &psm });
+}
+
+bool Shader::isBinaryInUse(Uint64 hash)
+{
+	for (void* shader : ResourceManager::getAll(RESOURCE_SHADER))
+		if (((Shader*)shader)->binary_hash == hash)
+			return true;
+	return false;
+}
+
+std::string Shader::getBinaryFilename(Uint64 hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.pbin", (unsigned long long)hash);
+	return binary_cache_folder + name;
+}
+
+struct sProgramBinInfo
+{
+	int version = 0;
+	int header_bytes = 0;
+	Uint64 hash = 0; //to detect collisions in the filename
+	unsigned int format = 0; //given by the driver
+	unsigned int data_size = 0;
+	Uint64 driver_hash = 0; //the files of other drivers are deleted by CleanBinaryCache
+	char extra[24]; //unused
+};
+
+void Shader::CleanBinaryCache()
+{
+	Uint64 driver_hash = hashStrings({ &getDriverString() });
+	std::error_code error;
+	std::vector<std::string> stale;
+	for (const auto& entry : std::filesystem::directory_iterator(binary_cache_folder, error))
+	{
+		if (entry.path().extension() != ".pbin")
+			continue;
+		std::string filename = entry.path().string();
+		FILE* f = fopen(filename.c_str(), "rb");
+		if (!f)
+			continue;
+		char watermark[4];
+		sProgramBinInfo info;
+		bool valid = fread(watermark, 4, 1, f) == 1 && memcmp(watermark, "PBIN", 4) == 0 &&
+			fread(&info, sizeof(sProgramBinInfo), 1, f) == 1 &&
+			info.version == SHADER_BIN_VERSION && info.header_bytes == sizeof(sProgramBinInfo) && info.driver_hash == driver_hash;
+		fclose(f);
+		if (!valid)
+			stale.push_back(filename);
+	}
+
+	for (std::string& filename : stale)
+		std::remove(filename.c_str());
+	if (stale.size())
+		std::cout << " + Shader binary cache: " << stale.size() << " old binaries deleted" << std::endl;
+}
+
+bool Shader::loadBinary(Uint64 hash)
+{
+	if (!glProgramBinary)
+		return false;
+
+	std::string filename = getBinaryFilename(hash);
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+
+	char watermark[4];
+	sProgramBinInfo info;
+	std::vector<char> data;
+	bool valid = fread(watermark, 4, 1, f) == 1 && memcmp(watermark, "PBIN", 4) == 0 &&
+		fread(&info, sizeof(sProgramBinInfo), 1, f) == 1 &&
+		info.version == SHADER_BIN_VERSION && info.header_bytes == sizeof(sProgramBinInfo) && info.hash == hash && info.data_size;
+	if (valid)
+	{
+		data.resize(info.data_size);
+		valid = fread(&data[0], info.data_size, 1, f) == 1;
+	}
+	fclose(f);
+
+	if (!valid)
+	{
+		std::cout << "[WARN] loading PBIN: invalid or old version: " << filename << std::endl;
+		std::remove(filename.c_str());
+		return false;
+	}
+
+	program = glCreateProgram();
+	glProgramBinary(program, info.format, &data[0], info.data_size);
+
+	//the driver can reject it (updated or different GPU), then we compile from the code
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		GLState::deleteProgram(program);
+		program = 0;
+		glGetError(); //clear the error of glProgramBinary
+		std::remove(filename.c_str());
+		return false;
+	}
+
+	assert(glGetError() == GL_NO_ERROR);
+	return true;
+}
+
+bool Shader::saveBinary(Uint64 hash)
+{
+	if (!glGetProgramBinary)
+		return false;
+
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return false;
+
+	std::vector<char> data(size);
+	GLenum format = 0;
+	glGetProgramBinary(program, size, &size, &format, &data[0]);
+	if (glGetError() != GL_NO_ERROR || size <= 0)
+		return false;
+
+	std::error_code error;
+	std::filesystem::create_directories(binary_cache_folder, error);
+
+	std::string filename = getBinaryFilename(hash);
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (!f)
+	{
+		std::cout << "[ERROR] cannot write PBIN: " << filename << std::endl;
+		return false;
+	}
+
+	sProgramBinInfo info;
+	memset(&info, 0, sizeof(info));
+	info.version = SHADER_BIN_VERSION;
+	info.header_bytes = sizeof(sProgramBinInfo);
+	info.hash = hash;
+	info.format = format;
+	info.data_size = (unsigned int)size;
+	info.driver_hash = hashStrings({ &getDriverString() });
+
+	fwrite("PBIN", 4, 1, f);
+	fwrite(&info, sizeof(sProgramBinInfo), 1, f);
+	fwrite(&data[0], size, 1, f);
+	fclose(f);
 	return true;
 }
 
@@ -426,12 +638,14 @@ void Shader::release()
 
 	if (program)
 	{
-		glDeleteProgram(program);
+		GLState::deleteProgram(program);
 		assert(glGetError() == GL_NO_ERROR);
 		program = 0;
 	}
 
-	locations.clear();
+	uniform_locations.clear();
+	attrib_locations.clear();
+	uniform_values.clear();
 
 	compiled = false;
 }
@@ -444,7 +658,7 @@ void Shader::enable()
 
 	current = this;
 
-	glUseProgram(program);
+	GLState::useProgram(program);
 	GLuint err = glGetError();
 	assert(err == GL_NO_ERROR);
 
@@ -456,14 +670,15 @@ void Shader::disable()
 {
 	current = NULL;
 
-	glUseProgram(0);
+	GLState::useProgram(0);
 	//glActiveTexture(GL_TEXTURE0);
 	assert(glGetError() == GL_NO_ERROR);
 }
 
 void Shader::disableShaders()
 {
-	glUseProgram(0);
+	current = NULL;
+	GLState::useProgram(0);
 	assert(glGetError() == GL_NO_ERROR);
 }
 
@@ -510,63 +725,116 @@ void Shader::saveProgramInfoLog(GLuint obj)
 	}
 }
 
-GLint Shader::getLocation(const char* varname, loctable* table)
-{
-	if (varname == 0 || table == 0)
-		return 0;
-
-	GLint loc = 0;
-	loctable* locs = table;
+//global slots of the var names (by hash), shared by all the shaders
+static std::map<uint32, int> s_var_slots;
+static std::vector<std::string> s_var_names; //to detect collisions
 
-	loctable::iterator cur = locs->find(varname);
-
-	if (cur == locs->end()) //not found in the locations table
+sShaderVar Shader::registerVar(const char* name, uint32 hash)
+{
+	sShaderVar var;
+	var.name = name;
+	var.hash = hash;
+	auto it = s_var_slots.find(hash);
+	if (it != s_var_slots.end())
 	{
-		loc = glGetUniformLocation(program, varname);
-		if (loc == -1)
+		//two names sharing a slot would set each other uniforms, rename one of them
+		if (s_var_names[it->second] != name)
 		{
-			return -1;
+			std::cout << "[ERROR] Shader var names with the same hash: " << name << " and " << s_var_names[it->second] << std::endl;
+			exit(1);
 		}
-
-		//insert the new value
-		locs->insert(loctable::value_type(varname, loc));
-	}
-	else //found in the table
-	{
-		loc = (*cur).second;
+		var.slot = it->second;
+		return var;
 	}
-	return loc;
+	var.slot = (int)s_var_names.size();
+	s_var_slots[hash] = var.slot;
+	s_var_names.push_back(name);
+	return var;
 }
 
-int Shader::getAttribLocation(const char* varname)
+int Shader::getVarSlot(const char* varname)
 {
-	int loc = glGetAttribLocation(program, varname);
-	if (loc == -1)
-	{
-		return loc;
-	}
-	assert(glGetError() == GL_NO_ERROR);
+	uint32 hash = hashShaderVar(varname);
+	auto it = s_var_slots.find(hash);
+	if (it != s_var_slots.end() && strcmp(s_var_names[it->second].c_str(), varname) == 0)
+		return it->second;
+	return registerVar(varname, hash).slot; //fails on a collision
+}
 
+GLint Shader::resolveLocation(int slot, const char* varname, bool attribute)
+{
+	std::vector<GLint>& locations = attribute ? attrib_locations : uniform_locations;
+	if (slot >= (int)locations.size())
+		locations.resize(s_var_names.size(), SHADER_VAR_UNRESOLVED);
+
+	//missing vars are stored too (as -1) so we don't ask GL again
+	GLint loc = attribute ? glGetAttribLocation(program, varname) : glGetUniformLocation(program, varname);
+	assert(glGetError() == GL_NO_ERROR);
+	locations[slot] = loc;
 	return loc;
 }
 
+int Shader::getAttribLocation(const char* varname)
+{
+	if (varname == 0)
+		return -1;
+	int slot = getVarSlot(varname);
+	if (slot < (int)attrib_locations.size() && attrib_locations[slot] != SHADER_VAR_UNRESOLVED)
+		return attrib_locations[slot];
+	return resolveLocation(slot, varname, true);
+}
+
 int Shader::getUniformLocation(const char* varname)
 {
-	int loc = getLocation(varname, &locations);
-	if (loc == -1)
+	if (varname == 0)
+		return -1;
+	int slot = getVarSlot(varname);
+	if (slot < (int)uniform_locations.size() && uniform_locations[slot] != SHADER_VAR_UNRESOLVED)
+		return uniform_locations[slot];
+	return resolveLocation(slot, varname, false);
+}
+
+void Shader::setUniform(const sShaderVar& var, Texture* tex, int slot)
+{
+	assert(current == this);
+	GLState::activeTexture(GL_TEXTURE0 + slot);
+	GLState::bindTexture(tex->texture_type, tex->texture_id);
+	GLint loc = filterUniform(var, &slot, sizeof(slot));
+	if (loc != -1)
+		glUniform1i(loc, slot);
+}
+
+bool Shader::uniformChanged(int slot, const void* value, int size)
+{
+	assert(size <= (int)sizeof(sUniformValue::data));
+	if (slot >= (int)uniform_values.size())
+		uniform_values.resize(slot + 1);
+	sUniformValue& last = uniform_values[slot];
+	if (last.size == size && memcmp(last.data, value, size) == 0)
 	{
-		return loc;
+		GLState::countUniform(true);
+		return false;
 	}
-	assert(glGetError() == GL_NO_ERROR);
-	return loc;
+	last.size = size;
+	memcpy(last.data, value, size);
+	GLState::countUniform(false);
+	return true;
+}
+
+GLint Shader::filterUniform(const char* varname, const void* value, int size)
+{
+	if (varname == 0)
+		return -1;
+	int slot = getVarSlot(varname);
+	GLint loc = slot < (int)uniform_locations.size() && uniform_locations[slot] != SHADER_VAR_UNRESOLVED ? uniform_locations[slot] : resolveLocation(slot, varname, false);
+	return loc != -1 && uniformChanged(slot, value, size) ? loc : -1;
 }
 
 void Shader::setTexture(const char* varname, Texture* tex, int slot)
 {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(tex->texture_type, tex->texture_id);
+	GLState::activeTexture(GL_TEXTURE0 + slot);
+	GLState::bindTexture(tex->texture_type, tex->texture_id);
 	setUniform1(varname, slot);
-	glActiveTexture(GL_TEXTURE0 + slot);
 }
 
 /*
@@ -582,7 +850,8 @@ void Shader::setTexture(const char* varname, unsigned int tex)
 
 void Shader::setUniform1(const char* varname, bool input1)
 {
-	GLint loc = getLocation(varname, &locations);
+	int value = input1;
+	GLint loc = filterUniform(varname, &value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1i(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -590,7 +859,7 @@ void Shader::setUniform1(const char* varname, bool input1)
 
 void Shader::setUniform1(const char* varname, int input1)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = filterUniform(varname, &input1, sizeof(input1));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1i(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -598,7 +867,8 @@ void Shader::setUniform1(const char* varname, int input1)
 
 void Shader::setUniform2(const char* varname, int input1, int input2)
 {
-	GLint loc = getLocation(varname, &locations);
+	int value[2] = { input1, input2 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2i(loc, input1, input2);
 	assert(glGetError() == GL_NO_ERROR);
@@ -606,7 +876,8 @@ void Shader::setUniform2(const char* varname, int input1, int input2)
 
 void Shader::setUniform3(const char* varname, int input1, int input2, int input3)
 {
-	GLint loc = getLocation(varname, &locations);
+	int value[3] = { input1, input2, input3 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3i(loc, input1, input2, input3);
 	assert(glGetError() == GL_NO_ERROR);
@@ -614,7 +885,8 @@ void Shader::setUniform3(const char* varname, int input1, int input2, int input3
 
 void Shader::setUniform4(const char* varname, const int input1, const int input2, const int input3, const int input4)
 {
-	GLint loc = getLocation(varname, &locations);
+	int value[4] = { input1, input2, input3, input4 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4i(loc, input1, input2, input3, input4);
 	assert(glGetError() == GL_NO_ERROR);
@@ -622,7 +894,7 @@ void Shader::setUniform4(const char* varname, const int input1, const int input2
 
 void Shader::setUniform1Array(const char* varname, const int* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -630,7 +902,7 @@ void Shader::setUniform1Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform2Array(const char* varname, const int* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -638,7 +910,7 @@ void Shader::setUniform2Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform3Array(const char* varname, const int* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -646,7 +918,7 @@ void Shader::setUniform3Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform4Array(const char* varname, const int* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4iv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -654,7 +926,7 @@ void Shader::setUniform4Array(const char* varname, const int* input, const int c
 
 void Shader::setUniform1(const char* varname, const float input1)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = filterUniform(varname, &input1, sizeof(input1));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1f(loc, input1);
 	assert(glGetError() == GL_NO_ERROR);
@@ -662,7 +934,8 @@ void Shader::setUniform1(const char* varname, const float input1)
 
 void Shader::setUniform2(const char* varname, const float input1, const float input2)
 {
-	GLint loc = getLocation(varname, &locations);
+	float value[2] = { input1, input2 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2f(loc, input1, input2);
 	assert(glGetError() == GL_NO_ERROR);
@@ -670,7 +943,8 @@ void Shader::setUniform2(const char* varname, const float input1, const float in
 
 void Shader::setUniform3(const char* varname, const float input1, const float input2, const float input3)
 {
-	GLint loc = getLocation(varname, &locations);
+	float value[3] = { input1, input2, input3 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3f(loc, input1, input2, input3);
 	assert(glGetError() == GL_NO_ERROR);
@@ -678,7 +952,8 @@ void Shader::setUniform3(const char* varname, const float input1, const float in
 
 void Shader::setUniform4(const char* varname, const float input1, const float input2, const float input3, const float input4)
 {
-	GLint loc = getLocation(varname, &locations);
+	float value[4] = { input1, input2, input3, input4 };
+	GLint loc = filterUniform(varname, value, sizeof(value));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4f(loc, input1, input2, input3, input4);
 	checkGLErrors();
@@ -686,7 +961,7 @@ void Shader::setUniform4(const char* varname, const float input1, const float in
 
 void Shader::setUniform1Array(const char* varname, const float* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform1fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -694,7 +969,7 @@ void Shader::setUniform1Array(const char* varname, const float* input, const int
 
 void Shader::setUniform2Array(const char* varname, const float* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform2fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -702,7 +977,7 @@ void Shader::setUniform2Array(const char* varname, const float* input, const int
 
 void Shader::setUniform3Array(const char* varname, const float* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform3fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -710,7 +985,7 @@ void Shader::setUniform3Array(const char* varname, const float* input, const int
 
 void Shader::setUniform4Array(const char* varname, const float* input, const int count)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniform4fv(loc, count, input);
 	assert(glGetError() == GL_NO_ERROR);
@@ -718,7 +993,7 @@ void Shader::setUniform4Array(const char* varname, const float* input, const int
 
 void Shader::setMatrix44(const char* varname, const float* m)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = filterUniform(varname, m, sizeof(float) * 16);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m);
 	assert(glGetError() == GL_NO_ERROR);
@@ -726,7 +1001,7 @@ void Shader::setMatrix44(const char* varname, const float* m)
 
 void Shader::setMatrix44(const char* varname, const Matrix44& m)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = filterUniform(varname, m.m, sizeof(m.m));
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, 1, GL_FALSE, m.m);
 	assert(glGetError() == GL_NO_ERROR);
@@ -734,7 +1009,7 @@ void Shader::setMatrix44(const char* varname, const Matrix44& m)
 
 void Shader::setMatrix44Array(const char* varname, Matrix44* m_array, int num)
 {
-	GLint loc = getLocation(varname, &locations);
+	GLint loc = getUniformLocation(varname);
 	CHECK_SHADER_VAR(loc, varname);
 	glUniformMatrix4fv(loc, num, GL_FALSE, (GLfloat*)m_array);
 	assert(glGetError() == GL_NO_ERROR);
@@ -787,9 +1062,9 @@ void Shader::init()
 
 Shader* Shader::getDefaultShader(std::string name)
 {
-	auto it = s_Shaders.find(name);
-	if (it != s_Shaders.end())
-		return it->second;
+	Shader* loaded = (Shader*)ResourceManager::find(RESOURCE_SHADER, name);
+	if (loaded)
+		return loaded;
 
 	std::string vs = "";
 	std::string fs = "";
@@ -947,6 +1222,6 @@ Shader* Shader::getDefaultShader(std::string name)
 	sh->setUniform4("u_color", Vector4(1, 1, 1, 1));
 	sh->disable();
 
-	s_Shaders[name] = sh;
+	ResourceManager::add(RESOURCE_SHADER, name, sh);
 	return sh;
 }
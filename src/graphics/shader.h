@@ -7,6 +7,7 @@
 #include "framework/includes.h"
 #include <string>
 #include <map>
+#include <vector>
 #include "framework/framework.h"
 #include <cassert>
 
@@ -17,8 +18,29 @@
 #define CHECK_SHADER_VAR(a,b) if (a == -1) return
 #endif
 
+#define SHADER_BIN_VERSION 2 //this is used to discard the cached program binaries if the format changes
+
+#define SHADER_VAR_UNRESOLVED -2 //location not asked yet to GL (-1 means it is not in the shader)
+
 class Texture;
 
+//FNV-1a, constexpr so the names of the shader vars are hashed at compile time
+constexpr uint32 hashShaderVar(const char* name)
+{
+	uint32 hash = 2166136261u;
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	return hash;
+}
+
+//Handle to a uniform or attribute name. Every name gets a global slot and every shader caches the location
+//of the slot in a flat array, so using it is just an index. Create them with SHADER_VAR("u_model")
+struct sShaderVar {
+	const char* name;
+	uint32 hash;
+	int slot;
+};
+
 class Shader
 {
 	int last_slot;
@@ -101,6 +123,24 @@ public:
 	virtual int getAttribLocation(const char* varname);
 	virtual int getUniformLocation(const char* varname);
 
+	//same using handles, skips the name lookup
+	GLint getUniformLocation(const sShaderVar& var) { return var.slot < (int)uniform_locations.size() && uniform_locations[var.slot] != SHADER_VAR_UNRESOLVED ? uniform_locations[var.slot] : resolveLocation(var.slot, var.name, false); }
+	GLint getAttribLocation(const sShaderVar& var) { return var.slot < (int)attrib_locations.size() && attrib_locations[var.slot] != SHADER_VAR_UNRESOLVED ? attrib_locations[var.slot] : resolveLocation(var.slot, var.name, true); }
+
+	//values equal to the last ones sent to the uniform are skipped (see GLState stats)
+	void setUniform(const sShaderVar& var, bool input) { setUniform(var, (int)input); }
+	void setUniform(const sShaderVar& var, int input) { assert(current == this); GLint loc = filterUniform(var, &input, sizeof(input)); if (loc != -1) glUniform1i(loc, input); }
+	void setUniform(const sShaderVar& var, float input) { assert(current == this); GLint loc = filterUniform(var, &input, sizeof(input)); if (loc != -1) glUniform1f(loc, input); }
+	void setUniform(const sShaderVar& var, const Vector2& input) { assert(current == this); GLint loc = filterUniform(var, &input, sizeof(input)); if (loc != -1) glUniform2f(loc, input.x, input.y); }
+	void setUniform(const sShaderVar& var, const Vector3& input) { assert(current == this); GLint loc = filterUniform(var, &input, sizeof(input)); if (loc != -1) glUniform3f(loc, input.x, input.y, input.z); }
+	void setUniform(const sShaderVar& var, const Vector4& input) { assert(current == this); GLint loc = filterUniform(var, &input, sizeof(input)); if (loc != -1) glUniform4f(loc, input.x, input.y, input.z, input.w); }
+	void setUniform(const sShaderVar& var, const Matrix44& input) { assert(current == this); GLint loc = filterUniform(var, input.m, sizeof(input.m)); if (loc != -1) glUniformMatrix4fv(loc, 1, GL_FALSE, input.m); }
+	void setUniform(const sShaderVar& var, std::vector<Matrix44>& m_vector) { assert(current == this && m_vector.size()); GLint loc = getUniformLocation(var); if (loc != -1) glUniformMatrix4fv(loc, (GLsizei)m_vector.size(), GL_FALSE, m_vector[0].m); } //arrays are not filtered
+	void setUniform(const sShaderVar& var, Texture* texture, int slot);
+
+	//global slots of the names, used by SHADER_VAR (exits if two names have the same hash)
+	static sShaderVar registerVar(const char* name, uint32 hash);
+
 	std::string getInfoLog() const;
 	bool hasInfoLog() const;
 	bool compiled;
@@ -108,8 +148,7 @@ public:
 	void setMacros(const char* macros);
 
 	static Shader* Get(const char* vsf, const char* psf = NULL, const char* macros = NULL);
-	static void ReloadAll();
-	static std::map<std::string, Shader*> s_Shaders;
+	static void ReloadAll(); //every shader in the ResourceManager
 
 	const std::string& getVSName() { return vs_filename; }
 	const std::string& getFSName() { return ps_filename; }
@@ -122,6 +161,13 @@ public:
 
 	static Shader* getDefaultShader(std::string name);
 
+	//linked programs are stored in the cache folder (keyed by the code with the macros and the driver) and loaded instead of compiling
+	static bool use_binary_cache;
+	static std::string binary_cache_folder;
+	//deletes the binaries of other versions or drivers, called before the first compile that uses the cache.
+	//The binary of the old code of a shader is deleted when it is recompiled with other code (ReloadAll) and no other shader uses it
+	static void CleanBinaryCache();
+
 protected:
 
 	std::string info_log;
@@ -138,24 +184,47 @@ protected:
 
 	bool validate();
 
+	//program binary cache
+	Uint64 binary_hash; //hash of the code compiled the last time, 0 if none
+	static const std::string& getDriverString();
+	static Uint64 computeBinaryHash(const std::string& vsm, const std::string& psm);
+	static std::string getBinaryFilename(Uint64 hash);
+	static bool isBinaryInUse(Uint64 hash); //some registered shader was compiled from that code
+	bool loadBinary(Uint64 hash);
+	bool saveBinary(Uint64 hash);
+
 	GLuint vs;
 	GLuint fs;
 	GLuint program;
 	std::string log;
 
-	//this is a hack to speed up shader usage (save info locally)
-private:
+	//locations by slot (see sShaderVar), cleared when the program is released
+	std::vector<GLint> uniform_locations;
+	std::vector<GLint> attrib_locations;
+	GLint resolveLocation(int slot, const char* varname, bool attribute);
 
-	struct ltstr
-	{
-		bool operator()(const char* s1, const char* s2) const
-		{
-			return strcmp(s1, s2) < 0;
-		}
+	//last value sent to every uniform (by slot), GL keeps them per program so they stay valid until it is released
+	struct sUniformValue {
+		int size = 0;
+		float data[16];
 	};
-	typedef std::map<const char*, int, ltstr> loctable;
-
-public:
-	GLint getLocation(const char* varname, loctable* table);
-	loctable locations;
-};
\ No newline at end of file
+	std::vector<sUniformValue> uniform_values;
+	bool uniformChanged(int slot, const void* value, int size); //stores the value if it is different
+	GLint filterUniform(const sShaderVar& var, const void* value, int size) { GLint loc = getUniformLocation(var); return loc != -1 && uniformChanged(var.slot, value, size) ? loc : -1; } //-1 if missing or equal
+	GLint filterUniform(const char* varname, const void* value, int size);
+
+	static int getVarSlot(const char* varname); //slot of a name given at runtime
+};
+
+template<size_t N> struct ShaderVarName {
+	char value[N];
+	constexpr ShaderVarName(const char(&str)[N]) { for (size_t i = 0; i < N; ++i) value[i] = str[i]; }
+};
+
+//one handle per name, registered the first time it is used
+template<ShaderVarName name> struct ShaderVar {
+	static constexpr uint32 hash = hashShaderVar(name.value);
+	static const sShaderVar& get() { static const sShaderVar var = Shader::registerVar(name.value, hash); return var; }
+};
+
+#define SHADER_VAR(name) ShaderVar<name>::get()
\ No newline at end of file
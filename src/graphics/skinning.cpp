@@ -0,0 +1,100 @@
+#include "skinning.h"
+#include "mesh.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "framework/animation.h"
+
+#include <cassert>
+
+SkinningBuffer::SkinningBuffer()
+{
+	num_matrices = 0;
+	buffer_id = 0;
+	texture_id = 0;
+	capacity = 0;
+}
+
+SkinningBuffer::~SkinningBuffer()
+{
+	if (texture_id)
+		GLState::deleteTextures(1, &texture_id);
+	if (buffer_id)
+		GLState::deleteBuffers(1, &buffer_id);
+}
+
+void SkinningBuffer::clear()
+{
+	num_matrices = 0;
+}
+
+int SkinningBuffer::add(const Matrix44* bones, int num)
+{
+	int offset = num_matrices;
+	num_matrices += num;
+	if ((int)matrices.size() < num_matrices)
+		matrices.resize(num_matrices);
+	memcpy(&matrices[offset], bones, sizeof(Matrix44) * num);
+	return offset;
+}
+
+int SkinningBuffer::add(Skeleton* skeleton, Mesh* mesh)
+{
+	int offset = num_matrices;
+	num_matrices += (int)mesh->bones_info.size();
+	if ((int)matrices.size() < num_matrices)
+		matrices.resize(num_matrices);
+	skeleton->computeFinalBoneMatrices(&matrices[offset], mesh);
+	return offset;
+}
+
+void SkinningBuffer::addAnimators(const std::vector<Animator*>& animators)
+{
+	for (Animator* animator : animators)
+	{
+		std::vector<Matrix44>& bones = animator->getBoneMatrices();
+		animator->setBonesOffset(bones.size() ? add(&bones[0], (int)bones.size()) : -1);
+	}
+}
+
+void SkinningBuffer::upload()
+{
+	if (!num_matrices)
+		return;
+
+	if (!buffer_id)
+	{
+		glGenBuffers(1, &buffer_id);
+		glGenTextures(1, &texture_id);
+	}
+
+	GLState::bindBuffer(GL_TEXTURE_BUFFER, buffer_id);
+	if (capacity < num_matrices)
+	{
+		capacity = (int)matrices.size();
+		glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(Matrix44), NULL, GL_STREAM_DRAW);
+		GLState::bindTexture(GL_TEXTURE_BUFFER, texture_id);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer_id); //every matrix is 4 texels
+		GLState::bindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	else //orphan the old data so we don't wait for the draws of the previous frame
+		glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(Matrix44), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, num_matrices * sizeof(Matrix44), &matrices[0]);
+	GLState::bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void SkinningBuffer::bind(Shader* shader, int slot)
+{
+	assert(shader && texture_id && "upload the skinning buffer before rendering");
+	GLState::activeTexture(GL_TEXTURE0 + slot);
+	GLState::bindTexture(GL_TEXTURE_BUFFER, texture_id);
+	shader->setUniform(SHADER_VAR("u_bones_buffer"), slot);
+	GLState::activeTexture(GL_TEXTURE0);
+}
+
+SkinningBuffer* SkinningBuffer::Get()
+{
+	static SkinningBuffer* buffer = NULL;
+	if (!buffer)
+		buffer = new SkinningBuffer();
+	return buffer;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "framework/includes.h"
+#include "framework/framework.h"
+#include <vector>
+
+class Mesh;
+class Shader;
+class Skeleton;
+class Animator;
+
+#define BONES_BUFFER_SLOT 15 //texture slot used to bind the bones buffer in the shader
+
+//SkinningBuffer
+//stores the bone matrices of every skinned mesh of the frame in a single texture buffer (uploaded once per frame),
+//every draw (or instance) only needs the offset of its bones. Shaders must be compiled with the BONES_BUFFER macro
+
+class SkinningBuffer {
+public:
+	std::vector<Matrix44> matrices; //bones of this frame, it never shrinks so there are no allocations per frame
+	int num_matrices;
+
+	GLuint buffer_id;
+	GLuint texture_id;
+	int capacity; //in matrices, size of the buffer in the GPU
+
+	SkinningBuffer();
+	~SkinningBuffer();
+
+	void clear(); //call it at the beginning of the frame
+	int add(const Matrix44* bones, int num); //copies the bones and returns their offset
+	int add(Skeleton* skeleton, Mesh* mesh); //computes the bones of the mesh straight into the buffer, returns their offset
+	void addAnimators(const std::vector<Animator*>& animators); //adds every animator with a mesh and stores its offset
+	void upload(); //sends all the bones to the GPU
+	void bind(Shader* shader, int slot = BONES_BUFFER_SLOT); //sets the buffer as u_bones_buffer in the current shader
+
+	static SkinningBuffer* Get(); //buffer shared by the whole frame
+};
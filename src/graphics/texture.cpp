@@ -7,7 +7,12 @@
 
 #include "mesh.h"
 #include "shader.h"
-#include "framework/extra/picopng.h"
+#include "gl_state.h"
+#include "framework/extra/stb_image.h"
+#include "texture_compression.h"
+#include "image_ops.h"
+#include "framework/profiler.h"
+#include <sys/stat.h>
 #include <cassert>
 
 //bilinear interpolation
@@ -40,10 +45,11 @@ Vector4 Image::getPixelInterpolatedHigh(float x, float y, bool repeat) {
 };
 
 
-std::map<std::string, Texture*> Texture::sTexturesLoaded;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
 FBO* Texture::global_fbo = NULL;
+bool Texture::use_binary = true;
+bool Texture::compress_binary = false;
 
 Texture::Texture()
 {
@@ -74,14 +80,18 @@ Texture::Texture(Image* img)
 
 Texture::~Texture()
 {
+	ResourceManager::remove(this);
 	clear();
 }
 
 void Texture::clear()
 {
-	glDeleteTextures(1, &texture_id);
-	glBindTexture(this->texture_type, 0);
+	if (!shared_id)
+		GLState::deleteTextures(1, &texture_id);
+	GLState::bindTexture(this->texture_type, 0);
 	texture_id = 0;
+	shared_id = false;
+	is_view = false;
 }
 
 void Texture::create(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format)
@@ -154,22 +164,68 @@ void Texture::createCubemap(unsigned int width, unsigned int height, Uint8** dat
 	if (texture_id == 0)
 		glGenTextures(1, &texture_id); //we need to create an unique ID for the texture
 
-	glBindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
+	GLState::bindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
 	uploadCubemap(format, type, mipmaps, data, internal_format);
 }
 
-Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
+void Texture::create(sTextureBin& bin, bool wrap, bool from_pixel_buffer)
+{
+	assert(GLState::isGLThread() && "texture upload outside the GL thread");
+	assert(bin.width && bin.height && bin.levels.size() && "texture bin is empty");
+
+	this->width = (float)bin.width;
+	this->height = (float)bin.height;
+	this->depth = 0;
+	this->format = bin.format;
+	this->internal_format = bin.format;
+	this->type = GL_UNSIGNED_BYTE;
+	this->mipmaps = bin.levels.size() > 1;
+
+	if (this->texture_id != 0)
+		clear();
+
+	this->texture_type = GL_TEXTURE_2D;
+	glGenTextures(1, &texture_id);
+	GLState::bindTexture(this->texture_type, texture_id);
+
+	//small levels of RGB textures are not aligned to 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < (int)bin.levels.size(); ++i)
+	{
+		int w, h;
+		bin.getLevelDimensions(i, w, h);
+		//with a pixel buffer bound the pointer is an offset inside it
+		const void* pixels = from_pixel_buffer ? (const void*)(uintptr_t)bin.levels[i] : (const void*)&bin.data[bin.levels[i]];
+		if (bin.isCompressed())
+			glCompressedTexImage2D(this->texture_type, i, bin.format, w, h, 0, bin.getLevelSize(i), pixels);
+		else
+			glTexImage2D(this->texture_type, i, bin.format, w, h, 0, bin.format, GL_UNSIGNED_BYTE, pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(this->texture_type, GL_TEXTURE_MAX_LEVEL, (int)bin.levels.size() - 1);
+	glTexParameteri(this->texture_type, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(this->texture_type, GL_TEXTURE_MIN_FILTER, this->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_S, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_T, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+
+	GLState::bindTexture(this->texture_type, 0);
+	assert(checkGLErrors() && "Error uploading texture bin");
+	ResourceManager::updateSize(this);
+}
+
+Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap, bool srgb)
 {
 	assert(filename);
 
 	//check if loaded
-	auto it = sTexturesLoaded.find(filename);
-	if (it != sTexturesLoaded.end())
-		return it->second;
+	Texture* texture = (Texture*)ResourceManager::find(RESOURCE_TEXTURE, filename);
+	if (texture)
+		return texture;
 
 	//load it
-	Texture* texture = new Texture();
-	if (!texture->load(filename, mipmaps, wrap))
+	texture = new Texture();
+	if (!texture->load(filename, mipmaps, wrap, GL_UNSIGNED_BYTE, srgb))
 	{
 		texture = Texture::Get("data/textures/missing.tga");
 	}
@@ -177,50 +233,60 @@ Texture* Texture::Get(const char* filename, bool mipmaps, bool wrap)
 	return texture;
 }
 
-bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type)
+bool Texture::load(const char* filename, bool mipmaps, bool wrap, unsigned int type, bool srgb)
 {
-	std::string str = filename;
-	std::string ext = str.substr(str.size() - 4, 4);
-	Image* image = NULL;
+	PROFILE_SCOPE("Texture::load");
+	Profiler::setZoneDetail(filename);
 	long time = getTime();
 
 	std::cout << " + Texture loading: " << filename << " ... ";
 
-	image = new Image();
-	bool found = false;
-
-	if (ext == ".tga" || ext == ".TGA")
-		found = image->loadTGA(filename);
-	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename, true);
-	else
+	//try loading the binary version (already has the mipmaps)
+	bool binary = use_binary && type == GL_UNSIGNED_BYTE;
+	std::string binfilename = std::string(filename) + ".tbin";
+	sTextureBin bin;
+	if (binary && bin.read(binfilename.c_str(), filename, mipmaps, srgb))
 	{
-		std::cout << "[ERROR]: unsupported format" << std::endl;
-		return false; //unsupported file type
+		this->filename = filename;
+		create(bin, wrap);
+		std::cout << "[OK BIN] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		setName(filename);
+		return true;
 	}
 
-	if (!found) //file not found
+	Image image;
+	if (!image.load(filename))
 	{
-		std::cout << " [ERROR]: Texture not found " << std::endl;
+		std::cout << " [ERROR]: Texture not found or unsupported format " << std::endl;
 		return false;
 	}
 
 	this->filename = filename;
 
+	if (binary)
+	{
+		//mipmaps are built in the CPU once and stored for the next time
+		bin.build(&image, mipmaps, compress_binary && isCompressionSupported(), srgb);
+		create(bin, wrap);
+		bin.write(binfilename.c_str(), filename);
+		std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+		setName(filename);
+		return true;
+	}
+
 	unsigned int internal_format = 0;
 
 	if (type == GL_FLOAT)
-		internal_format = (image->bytes_per_pixel == 3 ? GL_RGB32F : GL_RGBA32F);
+		internal_format = (image.bytes_per_pixel == 3 ? GL_RGB32F : GL_RGBA32F);
 
 	//upload to VRAM
-	create(image->width, image->height, (image->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA), type, mipmaps, image->data, 0);
+	create(image.width, image.height, (image.bytes_per_pixel == 3 ? GL_RGB : GL_RGBA), type, mipmaps, image.data, 0);
 
 	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_S, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
 	glTexParameteri(this->texture_type, GL_TEXTURE_WRAP_T, this->mipmaps && wrap ? GL_REPEAT : GL_CLAMP_TO_EDGE);
 	if (mipmaps)
 		generateMipmaps();
 
-	this->image.clear();
 	std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	setName(filename);
 	return true;
@@ -289,10 +355,11 @@ void Texture::upload(Image* img)
 //uploads the bytes of a texture to the VRAM
 void Texture::upload(unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format)
 {
+	assert(GLState::isGLThread() && "texture upload outside the GL thread");
 	assert(texture_id && "Must create texture before uploading data.");
 	assert(texture_type == GL_TEXTURE_2D && "Texture type does not match.");
 
-	glBindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
+	GLState::bindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
 
 	glTexImage2D(this->texture_type, 0, internal_format == 0 ? format : internal_format, width, height, 0, format, type, data);
 
@@ -305,15 +372,17 @@ void Texture::upload(unsigned int format, unsigned int type, bool mipmaps, Uint8
 	if (data && this->mipmaps)
 		generateMipmaps(); //glGenerateMipmapEXT(GL_TEXTURE_2D); 
 
-	glBindTexture(this->texture_type, 0);
+	GLState::bindTexture(this->texture_type, 0);
 	assert(checkGLErrors() && "Error uploading texture");
+	ResourceManager::updateSize(this);
 }
 
 void Texture::upload3D(unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format) {
+	assert(GLState::isGLThread() && "texture upload outside the GL thread");
 	assert(texture_id && "Must create texture before uploading data.");
 	assert(texture_type == GL_TEXTURE_3D && "Texture type does not match.");
 
-	glBindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
+	GLState::bindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
 
 	glTexImage3D(this->texture_type, 0, internal_format == 0 ? format : internal_format, width, height, depth, 0, format, type, data);
 
@@ -326,16 +395,18 @@ void Texture::upload3D(unsigned int format, unsigned int type, bool mipmaps, Uin
 	if (data && this->mipmaps)
 		generateMipmaps(); //glGenerateMipmapEXT(GL_TEXTURE_2D); 
 
-	glBindTexture(this->texture_type, 0);
+	GLState::bindTexture(this->texture_type, 0);
 	assert(checkGLErrors() && "Error uploading texture");
+	ResourceManager::updateSize(this);
 }
 
 void Texture::uploadCubemap(unsigned int format, unsigned int type, bool mipmaps, Uint8** data, unsigned int internal_format) {
+	assert(GLState::isGLThread() && "texture upload outside the GL thread");
 
 	assert(texture_id && "Must create texture before uploading data.");
 	assert(texture_type == GL_TEXTURE_CUBE_MAP && "Texture type does not match.");
 
-	glBindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
+	GLState::bindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
 
 	for (int i = 0; i < 6; i++)
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internal_format == 0 ? format : internal_format, width, height, 0, format, type, data ? data[i] : NULL);
@@ -348,13 +419,15 @@ void Texture::uploadCubemap(unsigned int format, unsigned int type, bool mipmaps
 	if (data && this->mipmaps)
 		generateMipmaps();
 
-	glBindTexture(this->texture_type, 0);
+	GLState::bindTexture(this->texture_type, 0);
 	assert(glGetError() == GL_NO_ERROR && "Error creating texture");
+	ResourceManager::updateSize(this);
 }
 
 //special function to upload texture arrays, a special type of texture that has layers
-void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
+void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps, bool immutable)
 {
+	assert(GLState::isGLThread() && "texture upload outside the GL thread");
 	assert((image.height % texture_size) == 0); //size doesnt match
 	assert(image.data);//no image in memory
 	int num_columns = image.width / texture_size;
@@ -405,8 +478,19 @@ void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
 	assert(glGetError() == GL_NO_ERROR);
 	if (texture_id == 0)
 		glGenTextures(1, &texture_id); //we need to create an unique ID for the texture
-	glBindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
-	glTexImage3D(this->texture_type, 0, format, width, height, num_textures, 0, dataFormat, type, data);
+	GLState::bindTexture(this->texture_type, texture_id);	//we activate this id to tell opengl we are going to use this texture
+	if (immutable)
+	{
+		//every level is allocated now, generateMipmaps fills them
+		int num_levels = 1;
+		if (this->mipmaps)
+			while ((width >> num_levels) > 0)
+				num_levels++;
+		glTexStorage3D(this->texture_type, num_levels, format, width, height, num_textures);
+		glTexSubImage3D(this->texture_type, 0, 0, 0, 0, width, height, num_textures, dataFormat, type, data);
+	}
+	else
+		glTexImage3D(this->texture_type, 0, format, width, height, num_textures, 0, dataFormat, type, data);
 	assert(glGetError() == GL_NO_ERROR);
 
 	glTexParameteri(this->texture_type, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);	//set the min filter
@@ -421,18 +505,73 @@ void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
 
 	if (num_columns > 1)
 		delete[] data;
+	ResourceManager::updateSize(this);
+}
+
+bool Texture::createView(Texture* array, int layer)
+{
+	assert(GLState::isGLThread() && "texture view outside the GL thread");
+	assert(array && array->texture_type == GL_TEXTURE_2D_ARRAY);
+	if (!isViewSupported())
+		return false;
+
+	GLint num_levels = 0;
+	GLState::bindTexture(GL_TEXTURE_2D_ARRAY, array->texture_id);
+	glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_IMMUTABLE_LEVELS, &num_levels);
+	if (num_levels == 0)
+		return false; //not created with glTexStorage, it cannot have views
+
+	GLuint view_id = 0;
+	glGenTextures(1, &view_id);
+	glTextureView(view_id, GL_TEXTURE_2D, array->texture_id, array->format, 0, num_levels, layer, 1);
+	if (glGetError() != GL_NO_ERROR)
+	{
+		glDeleteTextures(1, &view_id);
+		return false;
+	}
+
+	//keeps the wrapping it was created with
+	GLint wrap_s = GL_REPEAT, wrap_t = GL_REPEAT;
+	if (texture_id && texture_type == GL_TEXTURE_2D)
+	{
+		GLState::bindTexture(GL_TEXTURE_2D, texture_id);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &wrap_s);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &wrap_t);
+	}
+
+	//frees the old storage, the pixels are now in the array
+	clear();
+	texture_id = view_id;
+	is_view = true;
+	texture_type = GL_TEXTURE_2D;
+	width = array->width;
+	height = array->height;
+	depth = 0;
+	format = (array->format == GL_RGB8 ? GL_RGB : GL_RGBA);
+	type = GL_UNSIGNED_BYTE;
+	mipmaps = array->mipmaps;
+
+	//a view starts with the default sampling of GL
+	GLState::bindTexture(GL_TEXTURE_2D, texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+	assert(glGetError() == GL_NO_ERROR);
+	ResourceManager::updateSize(this); //no VRAM of its own now
+	return true;
 }
 
 void Texture::bind()
 {
 	//glEnable(this->texture_type); //enable the textures 
-	glBindTexture(this->texture_type, texture_id);	//enable the id of the texture we are going to use
+	GLState::bindTexture(this->texture_type, texture_id);	//enable the id of the texture we are going to use
 }
 
 void Texture::unbind()
 {
 	//glDisable(this->texture_type); //disable the textures 
-	glBindTexture(this->texture_type, 0);	//disable the id of the texture we are going to use
+	GLState::bindTexture(this->texture_type, 0);	//disable the id of the texture we are going to use
 }
 
 void Texture::UnbindAll()
@@ -440,9 +579,9 @@ void Texture::UnbindAll()
 	glDisable(GL_TEXTURE_CUBE_MAP);
 	glDisable(GL_TEXTURE_2D);
 	glDisable(GL_TEXTURE_3D);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-	glBindTexture(GL_TEXTURE_3D, 0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLState::bindTexture(GL_TEXTURE_3D, 0);
 }
 
 void Texture::generateMipmaps()
@@ -450,7 +589,7 @@ void Texture::generateMipmaps()
 	if (!glGenerateMipmapEXT)
 		return;
 
-	glBindTexture(this->texture_type, texture_id);	//enable the id of the texture we are going to use
+	GLState::bindTexture(this->texture_type, texture_id);	//enable the id of the texture we are going to use
 	glTexParameteri(this->texture_type, GL_TEXTURE_MIN_FILTER, Texture::default_min_filter); //set the mag filter
 	glGenerateMipmapEXT(this->texture_type);
 }
@@ -485,6 +624,28 @@ Texture* Texture::getBlackTexture()
 	return black;
 }
 
+bool Texture::isViewSupported()
+{
+	static int supported = -1;
+	if (supported == -1)
+	{
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		supported = extensions && strstr(extensions, "GL_ARB_texture_view") && strstr(extensions, "GL_ARB_texture_storage") ? 1 : 0;
+	}
+	return supported == 1;
+}
+
+bool Texture::isCompressionSupported()
+{
+	static int supported = -1;
+	if (supported == -1)
+	{
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		supported = extensions && strstr(extensions, "GL_EXT_texture_compression_s3tc") ? 1 : 0;
+	}
+	return supported == 1;
+}
+
 Texture* Texture::getWhiteTexture()
 {
 	static Texture* white = NULL;
@@ -497,19 +658,19 @@ Texture* Texture::getWhiteTexture()
 
 void Texture::copyTo(Texture* destination, Shader* shader)
 {
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
+	GLState::disable(GL_DEPTH_TEST);
+	GLState::disable(GL_BLEND);
 	FBO* fbo = getGlobalFBO(destination);
 	fbo->bind();
 	if (!shader && format == GL_DEPTH_COMPONENT)
 	{
 		shader = Shader::getDefaultShader("screen_depth");
 		glDepthFunc(GL_ALWAYS);
-		glEnable(GL_DEPTH_TEST);
+		GLState::enable(GL_DEPTH_TEST);
 	}
 	toViewport(shader);
 	fbo->unbind();
-	glDisable(GL_DEPTH_TEST);
+	GLState::disable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 }
 
@@ -545,6 +706,20 @@ void Image::fromTexture(Texture* texture)
 	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 }
 
+bool Image::load(const char* filename)
+{
+	std::string str = filename;
+	std::string ext = str.size() > 4 ? str.substr(str.size() - 4, 4) : "";
+
+	if (ext == ".tga" || ext == ".TGA")
+		return loadTGA(filename);
+	if (ext == ".png" || ext == ".PNG")
+		return loadPNG(filename, true);
+	if (ext == ".jpg" || ext == ".JPG" || ext == "jpeg" || ext == "JPEG")
+		return loadJPG(filename, true);
+	return false; //unsupported file type
+}
+
 //TGA format from: http://www.paulbourke.net/dataformats/tga/
 //also on https://gshaw.ca/closecombat/formats/tga.html
 bool Image::loadTGA(const char* filename)
@@ -624,43 +799,32 @@ bool Image::loadTGA(const char* filename)
 #include <iostream>
 #include <fstream>
 
-bool Image::loadPNG(const char* filename, bool flip_y)
+//decodes straight into the final buffer (stb_image allocates with new[], see stb_image.cpp), safe to call from any thread
+static bool loadWithSTBI(Image* image, const char* filename, bool flip_y)
 {
-	std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
-
-	//get filesize
-	std::streamsize size = 0;
-	if (file.seekg(0, std::ios::end).good()) size = file.tellg();
-	if (file.seekg(0, std::ios::beg).good()) size -= file.tellg();
-
-	if (!size)
-		return false;
-
-	std::vector<unsigned char> buffer;
-
-	//read contents of the file into the vector
-	if (size > 0)
-	{
-		buffer.resize((size_t)size);
-		file.read((char*)(&buffer[0]), size);
-	}
-	else
-		buffer.clear();
-
-	std::vector<unsigned char> out_image;
-
-	if (decodePNG(out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0)
+	int w, h, channels;
+	stbi_set_flip_vertically_on_load_thread(flip_y ? 1 : 0);
+	Uint8* pixels = stbi_load(filename, &w, &h, &channels, 4); //always RGBA
+	if (!pixels)
 		return false;
 
-	data = new Uint8[out_image.size()];
-	memcpy(data, &out_image[0], out_image.size());
-	bytes_per_pixel = 4;
+	if (image->data)
+		delete[] image->data;
+	image->data = pixels;
+	image->width = w;
+	image->height = h;
+	image->bytes_per_pixel = 4;
+	return true;
+}
 
-	//flip pixels in Y
-	if (flip_y)
-		flipY();
+bool Image::loadPNG(const char* filename, bool flip_y)
+{
+	return loadWithSTBI(this, filename, flip_y);
+}
 
-	return true;
+bool Image::loadJPG(const char* filename, bool flip_y)
+{
+	return loadWithSTBI(this, filename, flip_y);
 }
 
 // Saves the image to a TGA file
@@ -707,18 +871,263 @@ bool Image::saveTGA(const char* filename, bool flip_y)
 void Image::flipY()
 {
 	assert(data);
-	int row_size = 4 * width;
-	uint8* temp_row = new uint8[row_size];
-#pragma omp simd
-	for (int y = 0; y < height * 0.5; y += 1)
+	flipRows(data, width, height, bytes_per_pixel);
+}
+
+void Image::downsample(Image& result, bool srgb)
+{
+	assert(data);
+	result.resize(std::max((int)width / 2, 1), std::max((int)height / 2, 1), bytes_per_pixel);
+	downsampleBox(data, width, height, bytes_per_pixel, result.data, srgb);
+}
+
+void Image::resample(Image& result, int new_width, int new_height, bool srgb)
+{
+	assert(data && &result != this);
+	if ((int)result.width != new_width || (int)result.height != new_height || result.bytes_per_pixel != bytes_per_pixel || !result.data)
+		result.resize(new_width, new_height, bytes_per_pixel);
+	resampleBilinear(data, width, height, bytes_per_pixel, result.data, new_width, new_height, srgb);
+}
+
+#define TEXTURE_BIN_SRGB 1
+
+struct sTextureBinInfo
+{
+	int version = 0;
+	int header_bytes = 0;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int format = 0;
+	unsigned int num_levels = 0;
+	unsigned int data_size = 0;
+	Uint64 source_size = 0; //to know if the source image changed
+	Uint64 source_time = 0;
+	unsigned int flags = 0; //TEXTURE_BIN_SRGB
+	char extra[28]; //unused
+};
+
+bool sTextureBin::isCompressed()
+{
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+void sTextureBin::getLevelDimensions(int level, int& w, int& h)
+{
+	w = std::max((int)width >> level, 1);
+	h = std::max((int)height >> level, 1);
+}
+
+int sTextureBin::getLevelSize(int level)
+{
+	unsigned int end = level + 1 < (int)levels.size() ? levels[level + 1] : (unsigned int)data.size();
+	return end - levels[level];
+}
+
+int sTextureBin::getExpectedLevelSize(int level)
+{
+	int w, h;
+	getLevelDimensions(level, w, h);
+	if (isCompressed())
+		return getBCSize(w, h, format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	return w * h * (format == GL_RGB ? 3 : 4);
+}
+
+int sTextureBin::getNumLevels(unsigned int width, unsigned int height, bool mipmaps)
+{
+	int num_levels = 1;
+	if (mipmaps && isPowerOfTwo(width) && isPowerOfTwo(height))
+		while ((width >> num_levels) || (height >> num_levels))
+			num_levels++;
+	return num_levels;
+}
+
+bool sTextureBin::build(Image* image, bool mipmaps, bool compress, bool srgb)
+{
+	assert(image && image->data);
+	width = image->width;
+	height = image->height;
+	this->srgb = srgb;
+	levels.clear();
+	data.clear();
+
+	bool alpha = image->bytes_per_pixel == 4;
+	if (compress && alpha) //use BC1 if the alpha is not used
+	{
+		alpha = false;
+		for (unsigned int i = 3; i < width * height * 4 && !alpha; i += 4)
+			alpha = image->data[i] != 255;
+	}
+
+	if (compress)
+		format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else
+		format = image->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA;
+
+	int num_levels = getNumLevels(width, height, mipmaps);
+
+	Image rgba; //the compressors need 4 channels
+	Image mip;
+	Image* level = image;
+	for (int i = 0; i < num_levels; ++i)
+	{
+		if (i > 0)
+		{
+			Image next;
+			level->downsample(next, srgb); //sRGB colors are converted to linear to be averaged
+			std::swap(mip.data, next.data);
+			mip.width = next.width;
+			mip.height = next.height;
+			mip.bytes_per_pixel = next.bytes_per_pixel;
+			level = &mip;
+		}
+
+		levels.push_back((unsigned int)data.size());
+		if (!compress)
+		{
+			int size = level->width * level->height * level->bytes_per_pixel;
+			data.insert(data.end(), level->data, level->data + size);
+			continue;
+		}
+
+		const Uint8* pixels = level->data;
+		if (level->bytes_per_pixel == 3)
+		{
+			rgba.resize(level->width, level->height, 4);
+			expandRGBToRGBA(level->data, rgba.data, level->width * level->height);
+			pixels = rgba.data;
+		}
+
+		size_t offset = data.size();
+		data.resize(offset + getBCSize(level->width, level->height, alpha));
+		if (alpha)
+			compressBC3(pixels, level->width, level->height, &data[offset]);
+		else
+			compressBC1(pixels, level->width, level->height, &data[offset]);
+	}
+
+	return true;
+}
+
+bool sTextureBin::read(const char* filename, const char* source, bool mipmaps, bool srgb)
+{
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL)
+		return false;
+
+	char watermark[4];
+	sTextureBinInfo info;
+	if (fread(watermark, 4, 1, f) != 1 || memcmp(watermark, "TBIN", 4) != 0 ||
+		fread(&info, sizeof(sTextureBinInfo), 1, f) != 1)
+	{
+		std::cout << "[ERROR] loading TBIN: invalid content: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+
+	if (info.version != TEXTURE_BIN_VERSION || info.header_bytes != sizeof(sTextureBinInfo))
+	{
+		std::cout << "[WARN] loading TBIN: old version: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+
+	//if the source is not there we trust the bin
+	struct stat stbuffer;
+	if (source && stat(source, &stbuffer) == 0 &&
+		(info.source_size != (Uint64)stbuffer.st_size || info.source_time != (Uint64)stbuffer.st_mtime))
+	{
+		fclose(f);
+		return false; //stale, the image changed
+	}
+
+	if (((info.flags & TEXTURE_BIN_SRGB) != 0) != srgb)
+	{
+		fclose(f);
+		return false; //the mips were built for the other color space
+	}
+
+	width = info.width;
+	height = info.height;
+	format = info.format;
+	this->srgb = srgb;
+
+	//the header is checked before allocating anything with its sizes
+	long header_end = ftell(f);
+	fseek(f, 0, SEEK_END);
+	long file_size = ftell(f);
+	fseek(f, header_end, SEEK_SET);
+	bool known_format = format == GL_RGB || format == GL_RGBA || isCompressed();
+	if (!known_format || !width || !height || width > 16384 || height > 16384 ||
+		info.num_levels != (unsigned int)getNumLevels(width, height, mipmaps) || //built with other mipmaps option
+		(Uint64)header_end + sizeof(unsigned int) * info.num_levels + info.data_size != (Uint64)file_size)
+	{
+		std::cout << "[WARN] loading TBIN: invalid sizes or other mipmaps: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+
+	levels.resize(info.num_levels);
+	data.resize(info.data_size);
+	bool ok = fread(&levels[0], sizeof(unsigned int) * info.num_levels, 1, f) == 1 &&
+		fread(&data[0], info.data_size, 1, f) == 1;
+	fclose(f);
+
+	//every level must be where the next one starts and have the bytes its dimensions need, GL reads that many
+	unsigned int offset = 0;
+	for (int i = 0; ok && i < (int)levels.size(); ++i)
+	{
+		ok = levels[i] == offset && (Uint64)offset + getExpectedLevelSize(i) <= info.data_size;
+		offset += getExpectedLevelSize(i);
+	}
+	ok = ok && offset == info.data_size;
+	if (!ok)
+	{
+		std::cout << "[WARN] loading TBIN: corrupted levels: " << filename << std::endl;
+		return false;
+	}
+
+	//the GPU must be able to read it (Texture::isCompressionSupported is called from the main thread before)
+	if (isCompressed() && !Texture::isCompressionSupported())
+		return false;
+	return true;
+}
+
+bool sTextureBin::write(const char* filename, const char* source)
+{
+	assert(levels.size() && data.size());
+
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
 	{
-		uint8* pos = data + y * row_size;
-		memcpy(temp_row, pos, row_size);
-		uint8* pos2 = data + (height - y - 1) * row_size;
-		memcpy(pos, pos2, row_size);
-		memcpy(pos2, temp_row, row_size);
+		std::cout << "[ERROR] cannot write texture BIN: " << filename << std::endl;
+		return false;
 	}
-	delete[] temp_row;
+
+	sTextureBinInfo info;
+	memset(&info, 0, sizeof(info));
+	info.version = TEXTURE_BIN_VERSION;
+	info.header_bytes = sizeof(sTextureBinInfo);
+	info.width = width;
+	info.height = height;
+	info.format = format;
+	info.num_levels = (unsigned int)levels.size();
+	info.data_size = (unsigned int)data.size();
+	info.flags = srgb ? TEXTURE_BIN_SRGB : 0;
+
+	struct stat stbuffer;
+	if (source && stat(source, &stbuffer) == 0)
+	{
+		info.source_size = (Uint64)stbuffer.st_size;
+		info.source_time = (Uint64)stbuffer.st_mtime;
+	}
+
+	//watermark
+	fwrite("TBIN", sizeof(char), 4, f);
+	fwrite(&info, sizeof(sTextureBinInfo), 1, f);
+	fwrite(&levels[0], sizeof(unsigned int) * levels.size(), 1, f);
+	fwrite(&data[0], data.size(), 1, f);
+	fclose(f);
+	return true;
 }
 
 bool isPowerOfTwo(int n)
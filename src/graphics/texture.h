@@ -5,9 +5,13 @@
 
 #include "framework/includes.h"
 #include "framework/framework.h"
+#include "framework/resource_manager.h"
 #include <map>
 #include <string>
 #include <cassert>
+#include <vector>
+
+#define TEXTURE_BIN_VERSION 3 //this is used to regenerate the .tbin files if the format changes
 
 class Shader;
 class FBO;
@@ -30,6 +34,8 @@ public:
 	void resize(int w, int h, int bytes_per_pixel = 3) { if (data) delete[] data; width = w; height = h; this->bytes_per_pixel = bytes_per_pixel; data = new uint8[w * h * bytes_per_pixel]; memset(data, 0, w * h * bytes_per_pixel); }
 	void clear() { if (data) delete[]data; data = NULL; width = height = 0; }
 	void flipY();
+	void downsample(Image& result, bool srgb = false); //half the size averaging 2x2 pixels (box filter), used to build mip levels
+	void resample(Image& result, int new_width, int new_height, bool srgb = false); //bilinear, result is only reallocated if its size changes
 
 	Color getPixel(int x, int y) {
 		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "reading of memory");
@@ -48,12 +54,38 @@ public:
 	void fromTexture(Texture* texture);
 	void fromScreen(int width, int height);
 
+	bool load(const char* filename); //chooses the loader from the extension (PNGs and JPGs are flipped like the TGAs), can be called from any thread
 	bool loadTGA(const char* filename);
 	bool loadPNG(const char* filename, bool flip_y = false);
+	bool loadJPG(const char* filename, bool flip_y = false);
 	bool saveTGA(const char* filename, bool flip_y = true);
 };
 
 
+//GPU ready content of a texture: every mip level (maybe block compressed) one after the other.
+//It is cached in a .tbin file next to the source image so we skip the decoding and the mipmap generation
+struct sTextureBin
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int format = 0; //GL_RGB, GL_RGBA or GL_COMPRESSED_*_S3TC_DXT*_EXT
+	bool srgb = false; //the mips were averaged as sRGB colors (linear for normal maps, masks and other data)
+	std::vector<unsigned int> levels; //offset of every level inside data
+	std::vector<Uint8> data;
+
+	bool isCompressed();
+	int getLevelSize(int level);
+	int getExpectedLevelSize(int level); //from the dimensions and the format
+	static int getNumLevels(unsigned int width, unsigned int height, bool mipmaps); //same rule than Texture::create
+	void getLevelDimensions(int level, int& w, int& h);
+
+	//CPU only, they can be called from any thread
+	bool build(Image* image, bool mipmaps = true, bool compress = false, bool srgb = false);
+	//fails if it is older than the source image, was built with other options (mipmaps, color space) or is corrupted
+	bool read(const char* filename, const char* source = NULL, bool mipmaps = true, bool srgb = false);
+	bool write(const char* filename, const char* source = NULL);
+};
+
 // TEXTURE CLASS
 class Texture
 {
@@ -61,12 +93,11 @@ public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static bool use_binary; //load the .tbin version of a texture when possible (and create it when not)
+	static bool compress_binary; //new .tbin files are stored as BC1/BC3 if the GPU supports them
 
 	//a general struct to store all the information about a TGA file
 
-	//textures manager
-	static std::map<std::string, Texture*> sTexturesLoaded;
-
 	GLuint texture_id = 0; // GL id to identify the texture in opengl, every texture must have its own id
 	float width;
 	float height;
@@ -82,6 +113,9 @@ public:
 	unsigned int wrapS = GL_CLAMP_TO_EDGE;
 	unsigned int wrapT = GL_CLAMP_TO_EDGE;
 
+	bool shared_id = false; //texture_id belongs to another texture (placeholder while streaming), it is not deleted
+	bool is_view = false; //texture_id is a view of a layer of an array (see createView), it has no storage of its own
+
 	//original data info
 	Image image;
 
@@ -94,13 +128,17 @@ public:
 
 	void create(unsigned int width, unsigned int height, unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
 	void create3D(unsigned int width, unsigned int height, unsigned int depth, unsigned int format = GL_RED, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
+	void create(sTextureBin& bin, bool wrap = true, bool from_pixel_buffer = false); //uploads every level, the data can come from a bound GL_PIXEL_UNPACK_BUFFER
 	void createCubemap(unsigned int width, unsigned int height, Uint8** data = NULL, unsigned int format = GL_RGBA, unsigned int type = GL_FLOAT, bool mipmaps = true, unsigned int internal_format = GL_RGBA32F);
 
 	void upload(Image* img);
 	void upload(unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
 	void upload3D(unsigned int format = GL_RED, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
 	void uploadCubemap(unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8** data = NULL, unsigned int internal_format = 0);
-	void uploadAsArray(unsigned int texture_size, bool mipmaps = true);
+	void uploadAsArray(unsigned int texture_size, bool mipmaps = true, bool immutable = false); //immutable uses glTexStorage3D, needed to create views of the layers
+
+	//turns this texture into a view of a layer of an immutable array (its own storage is freed), false if not supported
+	bool createView(Texture* array, int layer);
 
 	void bind();
 	void unbind();
@@ -110,12 +148,12 @@ public:
 	void operator = (const Texture& tex) { assert("textures cannot be cloned like this!"); }
 
 	//load without using the manager
-	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
+	bool load(const char* filename, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE, bool srgb = false); //srgb for color images, it changes how the mips are averaged
 	bool loadCubemap(const char* name, std::vector<std::string> faces, bool mipmaps = true, bool wrap = true, unsigned int type = GL_UNSIGNED_BYTE);
 
 	//load using the manager (caching loaded ones to avoid reloading them)
-	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true);
-	void setName(const char* name) { sTexturesLoaded[name] = this; }
+	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true, bool srgb = false);
+	void setName(const char* name) { ResourceManager::add(RESOURCE_TEXTURE, name, this); }
 
 	void generateMipmaps();
 
@@ -127,6 +165,8 @@ public:
 	static FBO* getGlobalFBO(Texture* texture);
 	static Texture* getBlackTexture();
 	static Texture* getWhiteTexture();
+	static bool isCompressionSupported(); //S3TC, call it first from the main thread
+	static bool isViewSupported(); //ARB_texture_view and ARB_texture_storage
 };
 
 bool isPowerOfTwo(int n);
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "texture_array.h"
+#include "texture.h"
+#include "gl_state.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+//FNV-1a of the pixels, used to find duplicated images with different names
+static uint32 hashPixels(Image* image)
+{
+	uint32 hash = 2166136261u;
+	int size = image->width * image->height * image->bytes_per_pixel;
+	for (int i = 0; i < size; ++i)
+		hash = (hash ^ image->data[i]) * 16777619u;
+	return hash;
+}
+
+TextureArrayPacker::~TextureArrayPacker()
+{
+	for (sPackedImage& packed : images)
+		delete packed.image;
+}
+
+bool TextureArrayPacker::add(Texture* texture)
+{
+	assert(texture);
+	if (images_by_texture.find(texture) != images_by_texture.end())
+		return true;
+
+	//packing a compressed texture would take more VRAM than the source
+	if (!texture->texture_id || texture->shared_id || texture->is_view || texture->texture_type != GL_TEXTURE_2D ||
+		(texture->format != GL_RGB && texture->format != GL_RGBA) || texture->type != GL_UNSIGNED_BYTE || texture->width != texture->height)
+		return false;
+
+	//read back the first level instead of decoding the file again
+	Image* image = new Image((int)texture->width, (int)texture->height, texture->format == GL_RGB ? 3 : 4);
+	GLState::bindTexture(GL_TEXTURE_2D, texture->texture_id);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, texture->format, GL_UNSIGNED_BYTE, image->data);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	if (glGetError() != GL_NO_ERROR)
+	{
+		delete image;
+		return false;
+	}
+
+	uint32 hash = hashPixels(image);
+	int size = image->width * image->height * image->bytes_per_pixel;
+	for (int i = 0; i < (int)images.size(); ++i)
+	{
+		Image* other = images[i].image;
+		if (!other || images[i].hash != hash || other->width != image->width || other->bytes_per_pixel != image->bytes_per_pixel)
+			continue;
+		if (memcmp(other->data, image->data, size) != 0)
+			continue;
+		images_by_texture[texture] = i; //same pixels, share the layer
+		delete image;
+		return true;
+	}
+
+	//find an array with the same size and format
+	int max_layers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	int array = -1;
+	for (int i = 0; i < (int)arrays.size() && array == -1; ++i)
+		if (arrays[i].size == (int)image->width && arrays[i].bytes_per_pixel == (int)image->bytes_per_pixel && arrays[i].num_layers < max_layers && !arrays[i].texture)
+			array = i;
+	if (array == -1)
+	{
+		sArray new_array;
+		new_array.size = image->width;
+		new_array.bytes_per_pixel = image->bytes_per_pixel;
+		new_array.num_layers = 0;
+		array = (int)arrays.size();
+		arrays.push_back(new_array);
+	}
+
+	sPackedImage packed;
+	packed.image = image;
+	packed.hash = hash;
+	packed.array = array;
+	packed.layer = arrays[array].num_layers++;
+	images_by_texture[texture] = (int)images.size();
+	images.push_back(packed);
+	return true;
+}
+
+void TextureArrayPacker::build(bool mipmaps)
+{
+	bool views = Texture::isViewSupported();
+
+	for (int i = 0; i < (int)arrays.size(); ++i)
+	{
+		sArray& array = arrays[i];
+		if (array.texture)
+			continue; //already built
+
+		//uploadAsArray expects the layers one on top of the other in the image of the texture
+		Texture* texture = new Texture();
+		int layer_bytes = array.size * array.size * array.bytes_per_pixel;
+		texture->image.resize(array.size, array.size * array.num_layers, array.bytes_per_pixel);
+		for (sPackedImage& packed : images)
+			if (packed.array == i)
+				memcpy(texture->image.data + packed.layer * layer_bytes, packed.image->data, layer_bytes);
+
+		texture->uploadAsArray(array.size, mipmaps, views);
+		texture->image.clear();
+
+		//registered inside a load so it is not pinned, the handles decide when it can be freed
+		static int num_arrays = 0;
+		texture->filename = "@array_" + std::to_string(array.size) + "_" + std::to_string(num_arrays++);
+		ResourceManager::beginLoad();
+		texture->setName(texture->filename.c_str());
+		array.texture = TextureHandle(texture);
+		ResourceManager::endLoad();
+
+		std::cout << " + Texture array: " << array.num_layers << " layers of " << array.size << "x" << array.size << std::endl;
+	}
+
+	//the sources read the same pixels from the array, their own VRAM is freed
+	if (views)
+		for (auto& it : images_by_texture)
+		{
+			sPackedImage& packed = images[it.second];
+			if (!it.first->is_view)
+				it.first->createView(arrays[packed.array].texture.get(), packed.layer);
+		}
+
+	for (sPackedImage& packed : images)
+	{
+		delete packed.image;
+		packed.image = NULL;
+	}
+}
+
+sTextureLayer TextureArrayPacker::getLayer(Texture* texture)
+{
+	sTextureLayer result;
+	auto it = images_by_texture.find(texture);
+	if (it == images_by_texture.end())
+		return result;
+	sPackedImage& packed = images[it->second];
+	result.texture = arrays[packed.array].texture.get();
+	result.layer = result.texture ? packed.layer : -1;
+	return result;
+}
+
+std::vector<TextureHandle> TextureArrayPacker::getArrays()
+{
+	std::vector<TextureHandle> result;
+	for (sArray& array : arrays)
+		if (array.texture)
+			result.push_back(array.texture);
+	return result;
+}
@@ -0,0 +1,69 @@
+/*  TextureArrayPacker
+	Collects loaded textures and packs the square ones with the same size and format in the layers of a
+	GL_TEXTURE_2D_ARRAY (built with Texture::uploadAsArray). Identical images share the same layer.
+	The pixels are read back from VRAM (no second decode), and when texture views are supported every source
+	becomes a view of its layer, so its own storage is freed and the old pointers keep working.
+	Entity materials then store the array and the layer (Material::mesh_layers), so meshes with different textures
+	are drawn with one binding (shaders must be compiled with the TEXTURE_ARRAY macro and read u_texture_layer).
+	The arrays are registered in the ResourceManager without pinning them: the packer and the sMeshTextureLayers of
+	the materials hold them, they can be evicted once the entities are gone.
+*/
+
+#pragma once
+
+#include "framework/includes.h"
+#include "framework/framework.h"
+#include "framework/resource_manager.h"
+
+#include <map>
+#include <vector>
+
+class Image;
+class Texture;
+
+struct sTextureLayer {
+	Texture* texture = nullptr; //GL_TEXTURE_2D_ARRAY, NULL if the image could not be packed
+	int layer = -1;
+};
+
+//the layers that replace the textures of the materials of a mesh (by name), keeps the arrays loaded
+struct sMeshTextureLayers {
+	std::map<std::string, sTextureLayer, std::less<>> layers;
+	std::vector<TextureHandle> arrays; //every array the layers (and the diffuse of the entities) point to
+};
+
+class TextureArrayPacker {
+public:
+	~TextureArrayPacker();
+
+	// Reads the pixels of an uploaded texture, returns false if it cannot be packed (still streaming, compressed or not square)
+	bool add(Texture* texture);
+
+	// Creates the arrays and turns the sources into views of their layers when supported, the images are freed after the upload
+	void build(bool mipmaps = true);
+
+	sTextureLayer getLayer(Texture* texture);
+
+	int getNumArrays() { return (int)arrays.size(); }
+	std::vector<TextureHandle> getArrays(); //the ones built
+	int getNumImages() { return (int)images.size(); } //different images packed (after removing duplicates)
+
+private:
+	struct sPackedImage {
+		Image* image;
+		uint32 hash;
+		int array; //index in arrays
+		int layer;
+	};
+
+	struct sArray {
+		int size;
+		int bytes_per_pixel;
+		int num_layers;
+		TextureHandle texture;
+	};
+
+	std::vector<sPackedImage> images;
+	std::vector<sArray> arrays;
+	std::map<Texture*, int> images_by_texture; //index in images
+};
@@ -0,0 +1,199 @@
+#include "texture_compression.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+int getBCSize(int width, int height, bool alpha)
+{
+	int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (alpha ? 16 : 8);
+}
+
+//copies a 4x4 block clamping the coordinates on the borders
+static void fetchBlock(const Uint8* rgba, int width, int height, int bx, int by, Uint8* block)
+{
+	for (int y = 0; y < 4; ++y)
+	{
+		int sy = std::min(by * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x)
+		{
+			int sx = std::min(bx * 4 + x, width - 1);
+			memcpy(block + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+static Uint16 packRGB565(const float* c)
+{
+	int r = (int)std::round(std::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f);
+	int g = (int)std::round(std::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f);
+	int b = (int)std::round(std::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f);
+	return (Uint16)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(Uint16 v, int* c)
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+//color part of the block: endpoints on the principal axis of the colors, always in 4 colors mode
+static void compressColorBlock(const Uint8* block, Uint8* out)
+{
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+		for (int j = 0; j < 3; ++j)
+			mean[j] += block[i * 4 + j];
+	for (int j = 0; j < 3; ++j)
+		mean[j] /= 16.0f;
+
+	float cov[6] = { 0, 0, 0, 0, 0, 0 }; //rr rg rb gg gb bb
+	for (int i = 0; i < 16; ++i)
+	{
+		float r = block[i * 4] - mean[0];
+		float g = block[i * 4 + 1] - mean[1];
+		float b = block[i * 4 + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	//power iteration to find the principal axis
+	float axis[3] = { 1, 1, 1 };
+	for (int it = 0; it < 8; ++it)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if (len < 1e-6f)
+			break;
+		axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+	}
+
+	float min_d = 1e10f, max_d = -1e10f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float d = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+		min_d = std::min(min_d, d);
+		max_d = std::max(max_d, d);
+	}
+
+	float axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	if (axis_len2 < 1e-6f)
+		axis_len2 = 1.0f;
+	float c0[3], c1[3];
+	for (int j = 0; j < 3; ++j)
+	{
+		c0[j] = mean[j] + axis[j] * max_d / axis_len2;
+		c1[j] = mean[j] + axis[j] * min_d / axis_len2;
+	}
+
+	Uint16 e0 = packRGB565(c0);
+	Uint16 e1 = packRGB565(c1);
+	if (e0 < e1)
+		std::swap(e0, e1); //e0 > e1 selects the 4 colors mode
+
+	Uint32 indices = 0;
+	if (e0 != e1)
+	{
+		int palette[4][3];
+		unpackRGB565(e0, palette[0]);
+		unpackRGB565(e1, palette[1]);
+		for (int j = 0; j < 3; ++j)
+		{
+			palette[2][j] = (2 * palette[0][j] + palette[1][j]) / 3;
+			palette[3][j] = (palette[0][j] + 2 * palette[1][j]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0, best_dist = 1 << 30;
+			for (int p = 0; p < 4; ++p)
+			{
+				int dr = block[i * 4] - palette[p][0];
+				int dg = block[i * 4 + 1] - palette[p][1];
+				int db = block[i * 4 + 2] - palette[p][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < best_dist)
+				{
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	out[0] = e0 & 255; out[1] = e0 >> 8;
+	out[2] = e1 & 255; out[3] = e1 >> 8;
+	memcpy(out + 4, &indices, 4); //little endian
+}
+
+//alpha part of the BC3 block: min/max endpoints with the 8 values mode
+static void compressAlphaBlock(const Uint8* block, Uint8* out)
+{
+	int a_min = 255, a_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		a_min = std::min(a_min, (int)block[i * 4 + 3]);
+		a_max = std::max(a_max, (int)block[i * 4 + 3]);
+	}
+
+	out[0] = (Uint8)a_max;
+	out[1] = (Uint8)a_min;
+	Uint64 indices = 0;
+	if (a_max != a_min)
+	{
+		int palette[8];
+		palette[0] = a_max;
+		palette[1] = a_min;
+		for (int p = 1; p < 7; ++p)
+			palette[p + 1] = ((7 - p) * a_max + p * a_min) / 7;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int a = block[i * 4 + 3];
+			int best = 0, best_dist = 1 << 30;
+			for (int p = 0; p < 8; ++p)
+			{
+				int dist = std::abs(a - palette[p]);
+				if (dist < best_dist)
+				{
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= (Uint64)best << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (Uint8)(indices >> (i * 8));
+}
+
+void compressBC1(const Uint8* rgba, int width, int height, Uint8* out)
+{
+	Uint8 block[64];
+	for (int by = 0; by < (height + 3) / 4; ++by)
+		for (int bx = 0; bx < (width + 3) / 4; ++bx)
+		{
+			fetchBlock(rgba, width, height, bx, by, block);
+			compressColorBlock(block, out);
+			out += 8;
+		}
+}
+
+void compressBC3(const Uint8* rgba, int width, int height, Uint8* out)
+{
+	Uint8 block[64];
+	for (int by = 0; by < (height + 3) / 4; ++by)
+		for (int bx = 0; bx < (width + 3) / 4; ++bx)
+		{
+			fetchBlock(rgba, width, height, bx, by, block);
+			compressAlphaBlock(block, out);
+			compressColorBlock(block, out + 8);
+			out += 16;
+		}
+}
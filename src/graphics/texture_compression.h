@@ -0,0 +1,14 @@
+/*  Software block compression (S3TC / DXT) used when baking the texture bins.
+	BC1 stores RGB in 8 bytes per 4x4 block, BC3 adds an interpolated alpha block (16 bytes per block).
+	The input is always RGBA8 (rows from bottom to top like the Image class), blocks on the borders are clamped.
+*/
+
+#pragma once
+
+#include "framework/includes.h"
+
+//bytes used by a compressed image
+int getBCSize(int width, int height, bool alpha);
+
+void compressBC1(const Uint8* rgba, int width, int height, Uint8* out);
+void compressBC3(const Uint8* rgba, int width, int height, Uint8* out);
@@ -0,0 +1,263 @@
+#include "texture_streamer.h"
+#include "texture.h"
+#include "gl_state.h"
+#include "framework/utils.h"
+#include "framework/profiler.h"
+#include "framework/job_system.h"
+#include "framework/resource_manager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#define NUM_STAGING_BUFFERS 3 //pixel buffers reused in round robin so we don't write one the driver is still reading
+#define MAX_FREE_BINS 8 //decoded bins kept to be reused, their vectors keep the memory of the biggest textures
+
+struct sTextureRequest {
+	Texture* texture;
+	std::string filename;
+	bool mipmaps;
+	bool wrap;
+	bool srgb;
+	sTextureBin* bin; //NULL if the file could not be loaded
+};
+
+//state shared with the decoding jobs
+static struct sTextureWorkers {
+	std::mutex mutex;
+	JobCounter jobs; //decoding
+	std::deque<sTextureRequest> decoded; //waiting to be uploaded
+	std::unordered_set<Texture*> loading; //requested but not uploaded yet
+	std::vector<sTextureBin*> free_bins; //already uploaded, reused by the next decodes
+	int pending = 0; //requested but not uploaded yet
+	bool initialized = false;
+	bool quit = false;
+
+	GLuint staging_buffers[NUM_STAGING_BUFFERS] = {};
+	int staging_sizes[NUM_STAGING_BUFFERS] = {};
+	int next_staging = 0;
+
+	~sTextureWorkers() { TextureStreamer::Destroy(); }
+} workers;
+
+void TextureStreamer::Init()
+{
+	if (workers.initialized)
+		return;
+	workers.initialized = true;
+	workers.quit = false;
+
+	Texture::isCompressionSupported(); //queries GL, the jobs can only read the cached answer
+}
+
+void TextureStreamer::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		workers.quit = true;
+	}
+	JobSystem::wait(&workers.jobs); //the ones not started yet return straight away
+
+	for (sTextureRequest& request : workers.decoded)
+		delete request.bin;
+	workers.decoded.clear();
+	for (sTextureBin* bin : workers.free_bins)
+		delete bin;
+	workers.free_bins.clear();
+	workers.loading.clear();
+	workers.pending = 0;
+	workers.initialized = false;
+	//the staging buffers are not deleted, the GL context may be gone at exit
+}
+
+//the bins are recycled so decoding a level does not allocate the pixels of every texture again
+static sTextureBin* allocBin()
+{
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	if (workers.free_bins.empty())
+		return new sTextureBin();
+	sTextureBin* bin = workers.free_bins.back();
+	workers.free_bins.pop_back();
+	return bin;
+}
+
+static void freeBin(sTextureBin* bin)
+{
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	if (workers.free_bins.size() < MAX_FREE_BINS)
+		workers.free_bins.push_back(bin); //build and read clear it, the capacity is kept
+	else
+		delete bin;
+}
+
+//runs in a job, the result is uploaded by the main thread
+static void decodeRequest(sTextureRequest request)
+{
+	{
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		if (workers.quit)
+			return;
+	}
+
+	PROFILE_SCOPE("decode texture");
+	Profiler::setZoneDetail(request.filename);
+
+	//the bin already has the mipmaps, if it is not there (or it is old) build it from the image and store it
+	sTextureBin* bin = allocBin();
+	std::string binfilename = request.filename + ".tbin";
+	if (!Texture::use_binary || !bin->read(binfilename.c_str(), request.filename.c_str(), request.mipmaps, request.srgb))
+	{
+		Image image;
+		if (image.load(request.filename.c_str()))
+		{
+			bin->build(&image, request.mipmaps, Texture::compress_binary && Texture::isCompressionSupported(), request.srgb);
+			if (Texture::use_binary)
+				bin->write(binfilename.c_str(), request.filename.c_str());
+		}
+		else
+		{
+			freeBin(bin);
+			bin = NULL;
+		}
+	}
+	request.bin = bin;
+
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	workers.decoded.push_back(request);
+}
+
+Texture* TextureStreamer::Get(const char* filename, bool mipmaps, bool wrap, bool srgb)
+{
+	assert(filename);
+
+	//check if loaded (or being loaded)
+	Texture* loaded = (Texture*)ResourceManager::find(RESOURCE_TEXTURE, filename);
+	if (loaded)
+		return loaded;
+
+	if (!workers.initialized)
+		Init();
+
+	//placeholder until the pixels arrive
+	Texture* white = Texture::getWhiteTexture();
+	Texture* texture = new Texture();
+	texture->texture_id = white->texture_id;
+	texture->shared_id = true;
+	texture->width = white->width;
+	texture->height = white->height;
+	texture->format = white->format;
+	texture->type = white->type;
+	texture->mipmaps = false;
+	texture->filename = filename;
+	texture->setName(filename);
+
+	{
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		workers.pending++;
+		workers.loading.insert(texture);
+	}
+	sTextureRequest request = { texture, filename, mipmaps, wrap, srgb, NULL };
+	JobSystem::runBackground([request] { decodeRequest(request); }, &workers.jobs);
+	return texture;
+}
+
+void TextureStreamer::Update(int max_bytes_per_frame)
+{
+	assert(GLState::isGLThread() && "texture streaming outside the GL thread");
+	if (!workers.initialized)
+		return;
+
+	int budget = max_bytes_per_frame;
+	bool first = true;
+	while (budget > 0 || first)
+	{
+		if (!uploadNext(budget))
+			break;
+		first = false;
+	}
+}
+
+void TextureStreamer::Flush()
+{
+	JobSystem::wait(&workers.jobs); //decodes in this thread when there are no workers
+	while (getPendingCount())
+		Update(1 << 30);
+}
+
+bool TextureStreamer::isLoading(Texture* texture)
+{
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	return workers.loading.count(texture) != 0;
+}
+
+int TextureStreamer::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	return workers.pending;
+}
+
+bool TextureStreamer::uploadNext(int& budget)
+{
+	sTextureRequest request;
+	{
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		if (workers.decoded.empty())
+			return false;
+		request = workers.decoded.front();
+		workers.decoded.pop_front();
+	}
+
+	Texture* texture = request.texture;
+	sTextureBin* bin = request.bin;
+
+	if (!bin)
+	{
+		std::cout << " + Texture streaming: " << request.filename << " [ERROR]: Texture not found or unsupported format " << std::endl;
+		//keep sharing the missing texture, the pointer may already be in use
+		Texture* missing = Texture::Get("data/textures/missing.tga");
+		texture->texture_id = missing->texture_id;
+		texture->width = missing->width;
+		texture->height = missing->height;
+	}
+	else
+	{
+		int size = (int)bin->data.size();
+
+		//copy every level to a pixel buffer so the driver can do the transfer asynchronously
+		int index = workers.next_staging;
+		workers.next_staging = (workers.next_staging + 1) % NUM_STAGING_BUFFERS;
+		if (!workers.staging_buffers[index])
+			glGenBuffers(1, &workers.staging_buffers[index]);
+		GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, workers.staging_buffers[index]);
+		//orphan the storage (grows when needed), the previous upload may still be reading it
+		workers.staging_sizes[index] = std::max(workers.staging_sizes[index], size);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, workers.staging_sizes[index], NULL, GL_STREAM_DRAW);
+		void* dst = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		bool from_pixel_buffer = dst != NULL;
+		if (dst)
+		{
+			memcpy(dst, &bin->data[0], size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else
+			GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		//stop sharing the placeholder id so create allocates a new one
+		texture->texture_id = 0;
+		texture->shared_id = false;
+		texture->create(*bin, request.wrap, from_pixel_buffer);
+		GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		budget -= size;
+		freeBin(bin);
+	}
+
+	std::lock_guard<std::mutex> lock(workers.mutex);
+	workers.pending--;
+	workers.loading.erase(texture);
+	return true;
+}
@@ -0,0 +1,39 @@
+/*  TextureStreamer
+	Loads textures in the background. Get returns the texture straight away using the white texture as placeholder,
+	the file is decoded in a background job of the JobSystem and the main thread uploads the pixels (through a pixel buffer) in Update,
+	limiting the bytes sent to the GPU every frame so loading a level does not stall the rendering.
+*/
+
+#pragma once
+
+#include <string>
+
+class Texture;
+
+class TextureStreamer {
+public:
+
+	// Called automatically on the first Get
+	static void Init();
+
+	// Waits for the jobs already running, pending requests are discarded
+	static void Destroy();
+
+	// Like Texture::Get but the texture is filled later, the returned pointer is always valid (and managed)
+	static Texture* Get(const char* filename, bool mipmaps = true, bool wrap = true, bool srgb = false); //srgb for color images (see Texture::load)
+
+	// Uploads decoded textures (call it every frame from the main thread), at least one texture is uploaded per call
+	static void Update(int max_bytes_per_frame = 4 * 1024 * 1024);
+
+	// Blocks until every requested texture is uploaded (useful before taking screenshots or benchmarking)
+	static void Flush();
+
+	// Textures requested but not uploaded yet
+	static int getPendingCount();
+
+	// True while the texture is waiting for its pixels, it must not be deleted until then
+	static bool isLoading(Texture* texture);
+
+private:
+	static bool uploadNext(int& budget);
+};
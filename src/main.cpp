@@ -11,10 +11,18 @@
 
 #include "framework/framework.h"
 #include "graphics/mesh.h"
+#include "graphics/gl_state.h"
 #include "framework/camera.h"
 #include "framework/utils.h"
 #include "framework/input.h"
+#include "framework/animation.h"
+#include "framework/profiler.h"
+#include "framework/job_system.h"
+#include "graphics/texture_streamer.h"
 #include "game/game.h"
+#include "game/benchmark.h"
+#include "scene_parser/scene_parser.h"
+#include "scene_parser/world_partition.h"
 
 #include <iostream> //to output
 
@@ -25,9 +33,9 @@ SDL_GLContext glcontext;
 
 // *********************************
 //create a window using SDL
-SDL_Window* createWindow(const char* caption, int width, int height, bool fullscreen = false)
+SDL_Window* createWindow(const char* caption, int width, int height, bool fullscreen = false, bool hidden = false)
 {
-    int multisample = 4;
+    int multisample = hidden ? 0 : 4; //the hidden window is never shown, it renders to a FBO
     bool retina = true; //change this to use a retina display
 
 	//set attributes
@@ -43,7 +51,7 @@ SDL_Window* createWindow(const char* caption, int width, int height, bool fullsc
 	//SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
 	//antialiasing (disable this lines if it goes too slow)
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, multisample ? 1 : 0);
 	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, multisample ); //increase to have smoother polygons
 
 	// Initialize the joystick subsystem
@@ -52,7 +60,8 @@ SDL_Window* createWindow(const char* caption, int width, int height, bool fullsc
 	//create the window
 	SDL_Window *window = SDL_CreateWindow(caption, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL|SDL_WINDOW_RESIZABLE|
                                           (retina ? SDL_WINDOW_ALLOW_HIGHDPI:0) |
-                                          (fullscreen?SDL_WINDOW_FULLSCREEN_DESKTOP:0) );
+                                          (fullscreen?SDL_WINDOW_FULLSCREEN_DESKTOP:0) |
+                                          (hidden?SDL_WINDOW_HIDDEN:0) );
 	if(!window)
 	{
 		fprintf(stderr, "Window creation error: %s\n", SDL_GetError());
@@ -61,6 +70,7 @@ SDL_Window* createWindow(const char* caption, int width, int height, bool fullsc
   
 	// Create an OpenGL context associated with the window.
 	glcontext = SDL_GL_CreateContext(window);
+	GLState::setGLThread();
 
 	//in case of exit, call SDL_Quit()
 	atexit(SDL_Quit);
@@ -92,6 +102,9 @@ void mainLoop()
 
 	while (!game->must_exit)
 	{
+		Profiler::beginFrame();
+		Profiler::beginZone("events");
+
 		Input::update();
 
 		//update events
@@ -141,6 +154,8 @@ void mainLoop()
 			}
 		}
 
+		Profiler::endZone();
+
 		// Compute delta time
 		long last_time = now;
 		now = SDL_GetTicks();
@@ -156,16 +171,15 @@ void mainLoop()
 			frames_this_second = 0;
 		}
 
-		// Update game logic
-		game->update(elapsed_time);
-
-		// Render frame
-		game->render();
+		// Update game logic and render frame
+		game->step(elapsed_time);
 
 		// Check errors in opengl only when working in debug
 		#ifdef _DEBUG
 			checkGLErrors();
 		#endif
+
+		Profiler::endFrame();
 	}
 
 	SDL_GL_DeleteContext(glcontext);
@@ -177,19 +191,57 @@ void mainLoop()
 
 int main(int argc, char **argv)
 {
+	//offline conversion of animations to compressed .abin: TJE_Framework --convert-anim file1.skanim file2.abin ...
+	if (argc > 1 && strcmp(argv[1], "--convert-anim") == 0)
+	{
+		int failed = 0;
+		for (int i = 2; i < argc; ++i)
+			if (!Animation::convertToABIN(argv[i]))
+				failed++;
+		return failed;
+	}
+
+	//offline conversion of text scenes to .sbin: TJE_Framework --convert-scene level.scene [level.sbin]
+	if (argc > 2 && strcmp(argv[1], "--convert-scene") == 0)
+		return SceneParser::convert(argv[2], argc > 3 ? argv[3] : NULL) ? 0 : 1;
+
+	//offline split of a scene in cells for the WorldPartition: TJE_Framework --partition-scene level.scene [cell_size]
+	if (argc > 2 && strcmp(argv[1], "--partition-scene") == 0)
+		return WorldPartition::build(argv[2], argc > 3 ? (float)atof(argv[3]) : 64.0f) ? 0 : 1;
+
+	//stream a scene by cells around the camera: TJE_Framework --world level.scene
+	for (int i = 1; i + 1 < argc; ++i)
+		if (strcmp(argv[i], "--world") == 0)
+			Game::world_scene = argv[i + 1];
+
+	//headless run with a fixed dt that writes a report: TJE_Framework --bench 600 benchmark.json
+	bool benchmark = Benchmark::parseArgs(argc, argv);
+
 	std::cout << "Initiating game..." << std::endl;
 
 	//prepare SDL
+	if (benchmark)
+		Benchmark::setupVideoDriver();
 	SDL_Init(SDL_INIT_EVERYTHING);
+	if (benchmark && !SDL_WasInit(SDL_INIT_VIDEO))
+	{
+		std::cout << "[ERROR] Benchmark cannot start the video (it needs a display or SDL with EGL): " << SDL_GetError() << std::endl;
+		return 1;
+	}
 
 	bool fullscreen = false; //change this to go fullscreen
 	Vector2 size(800,600);
 
 	if(fullscreen)
 		size = getDesktopSize(0);
+	if (benchmark)
+	{
+		fullscreen = false;
+		size.set((float)Benchmark::settings.width, (float)Benchmark::settings.height);
+	}
 
 	//create the game window (WINDOW_WIDTH and WINDOW_HEIGHT are two macros defined in includes.h)
-	SDL_Window* window = createWindow("TJE", (int)size.x, (int)size.y, fullscreen );
+	SDL_Window* window = createWindow("TJE", (int)size.x, (int)size.y, fullscreen, benchmark );
 	if (!window)
 		return 0;
 	int window_width, window_height;
@@ -198,12 +250,36 @@ int main(int argc, char **argv)
 	Input::init(window);
 
 	//launch the game (game is a global variable)
+	double load_start = Profiler::getTime();
 	game = new Game(window_width, window_height, window);
 
+	//update the next frame while rendering this one: TJE_Framework --pipelined
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--pipelined") == 0)
+			game->setPipelined(true);
+
+	if (benchmark)
+	{
+		int result = Benchmark::run(game, Profiler::getTime() - load_start);
+		TextureStreamer::Destroy();
+		JobSystem::Destroy();
+		SDL_GL_DeleteContext(glcontext);
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		return result;
+	}
+
+	//capture the first frames to a Chrome trace: TJE_Framework --trace 300 [trace.json]
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			Profiler::startCapture(atoi(argv[i + 1]), (i + 2 < argc && argv[i + 2][0] != '-') ? argv[i + 2] : "trace.json");
+
 	//main loop, application gets inside here till user closes it
 	mainLoop();
 
 	//save state and free memory
+	TextureStreamer::Destroy(); //before the pool, so the pending decodes are discarded instead of run
+	JobSystem::Destroy();
 
 	return 0;
 }
@@ -4,15 +4,72 @@
 #include "graphics/mesh.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
+#include "graphics/texture_array.h"
+#include "graphics/texture_streamer.h"
 
 #include "framework/utils.h"
+#include "framework/profiler.h"
 
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <sys/stat.h>
 
-bool SceneParser::parse(const char* filename, Entity* root)
+struct sSceneBinInfo
 {
-	std::cout << " + Scene loading: " << filename << "..." << std::endl;
+	int version = 0;
+	int header_bytes = 0;
+	unsigned int num_materials = 0;
+	unsigned int num_meshes = 0;
+	unsigned int num_instances = 0;
+	unsigned int strings_size = 0; //names, every one ends with a 0
+	Uint64 source_size = 0; //to know if the source scene changed
+	Uint64 source_time = 0;
+	char extra[32]; //unused
+};
+
+struct sSceneBinMaterialInfo {
+	Vector4 color;
+	int diffuse; //offset in the strings, -1 if none
+};
+
+struct sSceneBinMeshInfo {
+	int name; //offset in the strings
+	int material;
+	unsigned int num_instances;
+};
+
+int sSceneBin::getNumInstances()
+{
+	int num = 0;
+	for (sSceneBinMesh& mesh : meshes)
+		num += (int)mesh.models.size();
+	return num;
+}
+
+bool sSceneBin::load(const char* filename, bool use_binary)
+{
+	if (std::string(filename).find(".sbin") != std::string::npos)
+	{
+		if (read(filename))
+			return true;
+		std::cerr << "Scene [ERROR]" << " File not found or invalid!" << std::endl;
+		return false;
+	}
+
+	std::string binfilename = std::string(filename) + ".sbin";
+	if (use_binary && read(binfilename.c_str(), filename))
+		return true;
+	if (!parseText(filename))
+		return false;
+	if (use_binary)
+		write(binfilename.c_str(), filename);
+	return true;
+}
 
+bool sSceneBin::parseText(const char* filename)
+{
 	std::ifstream file(filename);
 
 	if (!file.good()) {
@@ -22,7 +79,9 @@ bool SceneParser::parse(const char* filename, Entity* root)
 
 	std::string scene_info, mesh_name, model_data;
 	file >> scene_info; file >> scene_info;
-	int mesh_count = 0;
+
+	// Instances of the same mesh together (sorted by name, like the entities were always created)
+	std::map<std::string, std::vector<Matrix44>> instances;
 
 	// Read file line by line and store mesh path and model info in separated variables
 	while (file >> mesh_name >> model_data)
@@ -30,40 +89,250 @@ bool SceneParser::parse(const char* filename, Entity* root)
 		if (mesh_name[0] == '#')
 			continue;
 
-		// Get all 16 matrix floats
-		std::vector<std::string> tokens = tokenize(model_data, ",");
-
-		// Fill matrix converting chars to floats
+		// Fill matrix with the 16 floats separated by commas
 		Matrix44 model;
-		for (int t = 0; t < tokens.size(); ++t) {
-			model.m[t] = (float)atof(tokens[t].c_str());
+		const char* pos = model_data.c_str();
+		for (int t = 0; t < 16; ++t) {
+			char* end;
+			model.m[t] = strtof(pos, &end);
+			if (end == pos)
+				break;
+			pos = *end == ',' ? end + 1 : end;
 		}
 
 		// Add model to mesh list (might be instanced!)
-		sRenderData& render_data = meshes_to_load[mesh_name];
-		render_data.models.push_back(model);
-		mesh_count++;
+		instances[mesh_name].push_back(model);
+	}
+
+	// The text format has no materials, every mesh uses the ones in its file
+	materials.resize(1);
+	meshes.clear();
+	meshes.reserve(instances.size());
+	for (auto& it : instances) {
+		sSceneBinMesh mesh;
+		mesh.name = it.first;
+		mesh.models.swap(it.second);
+		meshes.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+bool sSceneBin::read(const char* filename, const char* source)
+{
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL)
+		return false;
+
+	char watermark[4];
+	sSceneBinInfo info;
+	if (fread(watermark, 4, 1, f) != 1 || memcmp(watermark, "SBIN", 4) != 0 ||
+		fread(&info, sizeof(sSceneBinInfo), 1, f) != 1)
+	{
+		std::cout << "[ERROR] loading SBIN: invalid content: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+
+	if (info.version != SCENE_BIN_VERSION || info.header_bytes != sizeof(sSceneBinInfo))
+	{
+		std::cout << "[WARN] loading SBIN: old version: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+
+	//if the source is not there we trust the bin
+	struct stat stbuffer;
+	if (source && stat(source, &stbuffer) == 0 &&
+		(info.source_size != (Uint64)stbuffer.st_size || info.source_time != (Uint64)stbuffer.st_mtime))
+	{
+		fclose(f);
+		return false; //stale, the scene changed
+	}
+
+	//the sizes in the header and the tables are checked against what is left in the file before allocating with them
+	long header_end = ftell(f);
+	fseek(f, 0, SEEK_END);
+	Uint64 remaining = (Uint64)(ftell(f) - header_end);
+	fseek(f, header_end, SEEK_SET);
+
+	//the tables and the names in a single read
+	Uint64 tables_size = (Uint64)info.num_materials * sizeof(sSceneBinMaterialInfo) + (Uint64)info.num_meshes * sizeof(sSceneBinMeshInfo) + info.strings_size;
+	if (tables_size > remaining)
+	{
+		std::cout << "[ERROR] loading SBIN: file too short: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+	remaining -= tables_size;
+	std::vector<char> tables(tables_size + 1);
+	if (tables_size && fread(&tables[0], tables_size, 1, f) != 1)
+	{
+		std::cout << "[ERROR] loading SBIN: file too short: " << filename << std::endl;
+		fclose(f);
+		return false;
+	}
+	sSceneBinMaterialInfo* material_infos = (sSceneBinMaterialInfo*)&tables[0];
+	sSceneBinMeshInfo* mesh_infos = (sSceneBinMeshInfo*)(material_infos + info.num_materials);
+	const char* strings = (const char*)(mesh_infos + info.num_meshes);
+	tables[tables_size] = 0; //a broken file cannot make us read out of the buffer
+
+	materials.resize(info.num_materials);
+	for (unsigned int i = 0; i < info.num_materials; ++i)
+	{
+		materials[i].color = material_infos[i].color;
+		materials[i].diffuse = material_infos[i].diffuse >= 0 && material_infos[i].diffuse < (int)info.strings_size ? strings + material_infos[i].diffuse : "";
+	}
+
+	//the transforms go straight to the vector of every mesh, the entities take them without copying
+	meshes.resize(info.num_meshes);
+	bool ok = true;
+	for (unsigned int i = 0; i < info.num_meshes && ok; ++i)
+	{
+		sSceneBinMeshInfo& mesh_info = mesh_infos[i];
+		sSceneBinMesh& mesh = meshes[i];
+		mesh.name = mesh_info.name >= 0 && mesh_info.name < (int)info.strings_size ? strings + mesh_info.name : "";
+		mesh.material = mesh_info.material >= 0 && mesh_info.material < (int)info.num_materials ? mesh_info.material : 0;
+		Uint64 models_size = (Uint64)mesh_info.num_instances * sizeof(Matrix44);
+		if (models_size > remaining)
+		{
+			ok = false;
+			break;
+		}
+		remaining -= models_size;
+		mesh.models.resize(mesh_info.num_instances);
+		if (mesh_info.num_instances)
+			ok = fread(&mesh.models[0], sizeof(Matrix44) * mesh_info.num_instances, 1, f) == 1;
+	}
+	fclose(f);
+
+	if (!ok || materials.empty())
+	{
+		std::cout << "[ERROR] loading SBIN: file too short: " << filename << std::endl;
+		meshes.clear();
+		materials.clear();
+		return false;
 	}
+	return true;
+}
+
+bool sSceneBin::write(const char* filename, const char* source)
+{
+	FILE* f = fopen(filename, "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write scene BIN: " << filename << std::endl;
+		return false;
+	}
+
+	std::string strings;
+	std::vector<sSceneBinMaterialInfo> material_infos(materials.size());
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		material_infos[i].color = materials[i].color;
+		material_infos[i].diffuse = -1;
+		if (materials[i].diffuse.size())
+		{
+			material_infos[i].diffuse = (int)strings.size();
+			strings.append(materials[i].diffuse.c_str(), materials[i].diffuse.size() + 1);
+		}
+	}
+
+	std::vector<sSceneBinMeshInfo> mesh_infos(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		mesh_infos[i].name = (int)strings.size();
+		mesh_infos[i].material = meshes[i].material;
+		mesh_infos[i].num_instances = (unsigned int)meshes[i].models.size();
+		strings.append(meshes[i].name.c_str(), meshes[i].name.size() + 1);
+	}
+
+	sSceneBinInfo info;
+	memset(&info, 0, sizeof(info));
+	info.version = SCENE_BIN_VERSION;
+	info.header_bytes = sizeof(sSceneBinInfo);
+	info.num_materials = (unsigned int)materials.size();
+	info.num_meshes = (unsigned int)meshes.size();
+	info.num_instances = getNumInstances();
+	info.strings_size = (unsigned int)strings.size();
 
+	struct stat stbuffer;
+	if (source && stat(source, &stbuffer) == 0)
+	{
+		info.source_size = (Uint64)stbuffer.st_size;
+		info.source_time = (Uint64)stbuffer.st_mtime;
+	}
+
+	//watermark
+	fwrite("SBIN", sizeof(char), 4, f);
+	fwrite(&info, sizeof(sSceneBinInfo), 1, f);
+	if (material_infos.size())
+		fwrite(&material_infos[0], sizeof(sSceneBinMaterialInfo) * material_infos.size(), 1, f);
+	if (mesh_infos.size())
+		fwrite(&mesh_infos[0], sizeof(sSceneBinMeshInfo) * mesh_infos.size(), 1, f);
+	fwrite(strings.data(), strings.size(), 1, f);
+	for (sSceneBinMesh& mesh : meshes)
+		if (mesh.models.size())
+			fwrite(&mesh.models[0], sizeof(Matrix44) * mesh.models.size(), 1, f);
+	fclose(f);
+	return true;
+}
+
+bool SceneParser::convert(const char* filename, const char* output)
+{
+	sSceneBin scene;
+	if (!scene.parseText(filename))
+		return false;
+	std::string binfilename = output ? output : std::string(filename) + ".sbin";
+	if (!scene.write(binfilename.c_str(), filename))
+		return false;
+	std::cout << " + Scene converted: " << binfilename << " (" << scene.meshes.size() << " meshes, " << scene.getNumInstances() << " instances)" << std::endl;
+	return true;
+}
+
+bool SceneParser::parse(const char* filename, Entity* root)
+{
+	std::cout << " + Scene loading: " << filename << "..." << std::endl;
+	PROFILE_SCOPE("SceneParser::parse");
+	Profiler::setZoneDetail(filename);
+
+	sSceneBin scene;
+	if (!scene.load(filename, use_binary))
+		return false;
+
+	int mesh_count = scene.getNumInstances();
+	createEntities(scene, root);
+
+	std::cout << "Scene [OK]" << " Meshes added: " << mesh_count << std::endl;
+	return true;
+}
+
+void SceneParser::createEntities(sSceneBin& scene, Entity* root)
+{
 	// Get default shader for scene meshes
 	Shader* default_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs");
 
+	// Scene meshes with their textures packed in arrays, they are fixed once all the meshes are loaded
+	std::vector<EntityMesh*> scene_entities;
+
 	// Iterate through meshes loaded and create corresponding entities
-	for (auto data : meshes_to_load) {
+	for (sSceneBinMesh& data : scene.meshes) {
 
-		mesh_name = "data/" + data.first;
-		sRenderData& render_data = data.second;
+		std::string mesh_name = "data/" + data.name;
 
 		// No transforms, nothing to do here
-		if (render_data.models.empty())
+		if (data.models.empty())
 			continue;
 
-		Material mat = render_data.material;
+		sSceneBinMaterial& material = scene.materials[data.material];
+		Material mat;
 		mat.shader = default_shader;
+		mat.color = material.color;
+		if (material.diffuse.size())
+			mat.diffuse = TextureStreamer::Get(("data/" + material.diffuse).c_str(), true, true, true);
 
 		EntityCollider* new_entity = nullptr;
 
-		size_t tag = data.first.find("@tag");
+		size_t tag = data.name.find("@tag");
 
 		if (tag != std::string::npos) {
 			Mesh* mesh = Mesh::Get("...");
@@ -71,40 +340,98 @@ bool SceneParser::parse(const char* filename, Entity* root)
 			// new_entity = new ...
 		}
 		else {
-			Mesh* mesh = Mesh::Get(mesh_name.c_str());
+			//with a handle, so the entities are the ones keeping it loaded
+			MeshHandle mesh = ResourceManager::load<Mesh>(mesh_name.c_str());
 
 			// Load texture from mesh materials if available
-			if (!mesh->materials.empty()) {
+			if (!mat.diffuse && !mesh->materials.empty()) {
 				auto it = mesh->materials.begin();
 				if (it->second.Kd_texture) {
 					mat.diffuse = it->second.Kd_texture;
 				}
 			}
 
-			new_entity = new EntityCollider(mesh, mat);
+			new_entity = new EntityCollider(mesh.get(), mat);
 			new_entity->setupCollision(true);  // Static collision model
+			if (pack_textures)
+				scene_entities.push_back(new_entity);
 		}
 
 		if (!new_entity) {
 			continue;
 		}
 
-		new_entity->name = data.first;
+		new_entity->name = data.name;
 
 		// Create instanced entity
-		if (render_data.models.size() > 1) {
+		if (data.models.size() > 1) {
 			new_entity->isInstanced = true;
-			new_entity->models = render_data.models; // Add all instances
+			new_entity->models.swap(data.models); // Add all instances
 		}
 		// Create normal entity
 		else {
-			new_entity->model = render_data.models[0];
+			new_entity->model = data.models[0];
 		}
 
 		// Add entity to scene root
 		root->addChild(new_entity);
 	}
 
-	std::cout << "Scene [OK]" << " Meshes added: " << mesh_count << std::endl;
-	return true;
+	if (pack_textures)
+		packTextures(scene_entities);
+}
+
+void SceneParser::packTextures(std::vector<EntityMesh*>& entities)
+{
+	// The packer reads the pixels from VRAM, so the textures must be uploaded
+	TextureStreamer::Flush();
+
+	TextureArrayPacker packer;
+
+	for (EntityMesh* entity : entities)
+		for (auto& it : entity->mesh->materials)
+			if (it.second.Kd_texture)
+				packer.add(it.second.Kd_texture);
+
+	if (!packer.getNumImages())
+		return;
+	packer.build();
+
+	// Same shader reading the layer of the array
+	Shader* array_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs", "#define TEXTURE_ARRAY\n");
+
+	// Entities of the same mesh share the layers, the cached mesh is not changed as others may use it with the plain shader
+	// and keep the arrays loaded while they exist
+	std::map<Mesh*, std::shared_ptr<sMeshTextureLayers>> layers_by_mesh;
+	std::vector<TextureHandle> arrays = packer.getArrays();
+
+	for (EntityMesh* entity : entities)
+	{
+		auto& mesh_layers = layers_by_mesh[entity->mesh.get()];
+		if (!mesh_layers)
+		{
+			mesh_layers = std::make_shared<sMeshTextureLayers>();
+			mesh_layers->arrays = arrays;
+			for (auto& it : entity->mesh->materials)
+			{
+				if (!it.second.Kd_texture)
+					continue;
+				sTextureLayer layer = packer.getLayer(it.second.Kd_texture);
+				if (layer.texture)
+					mesh_layers->layers[it.first] = layer;
+			}
+		}
+		if (mesh_layers->layers.empty())
+			continue;
+
+		//the diffuse of the entity comes from the first material
+		sTextureLayer layer = entity->material.diffuse ? packer.getLayer(entity->material.diffuse) : sTextureLayer();
+		if (layer.texture)
+		{
+			entity->material.diffuse = layer.texture;
+			entity->material.diffuse_layer = layer.layer;
+		}
+		entity->material.mesh_layers = mesh_layers;
+		entity->material.shader = array_shader;
+	}
 }
\ No newline at end of file
@@ -4,12 +4,52 @@
 
 #include "graphics/material.h"
 
-#include <map>
+#include <string>
+#include <vector>
+
+#define SCENE_BIN_VERSION 1 //this is used to regenerate the .sbin files if the format changes
+
+struct sSceneBinMaterial {
+	Vector4 color = Vector4(1.f);
+	std::string diffuse; //texture file relative to data/, empty to use the one in the materials of the mesh
+};
+
+struct sSceneBinMesh {
+	std::string name; //relative to data/
+	int material = 0; //in sSceneBin::materials
+	std::vector<Matrix44> models; //every instance, moved to EntityMesh::models when loading
+};
+
+//compact version of a .scene: a table of meshes and materials with the transforms of all the instances of every mesh
+//one after the other. It is cached in a .sbin file next to the text scene (or converted with --convert-scene), so
+//loading a level is a few reads instead of parsing every matrix
+struct sSceneBin
+{
+	std::vector<sSceneBinMaterial> materials;
+	std::vector<sSceneBinMesh> meshes;
+
+	int getNumInstances();
+
+	bool load(const char* filename, bool use_binary = true); //.sbin, or .scene using (and creating) its .sbin
+	bool parseText(const char* filename); //the .scene text format, the converter input
+	bool read(const char* filename, const char* source = NULL); //fails if it is older than the source scene
+	bool write(const char* filename, const char* source = NULL);
+};
 
 class SceneParser {
 
-	std::map<std::string, sRenderData> meshes_to_load;
+	// Puts the textures of the meshes in texture arrays so the scene uses a single binding
+	void packTextures(std::vector<EntityMesh*>& entities);
 
 public:
-	bool parse(const char* filename, Entity* root);
-};
\ No newline at end of file
+	bool pack_textures = true;
+	bool use_binary = true; //load the .sbin version of a .scene when possible (and create it when not)
+
+	bool parse(const char* filename, Entity* root); //.scene or .sbin
+
+	// Creates the entities of the meshes as children of root (the transforms are moved out of the scene)
+	void createEntities(sSceneBin& scene, Entity* root);
+
+	// Offline conversion of a .scene to .sbin (by default next to it)
+	static bool convert(const char* filename, const char* output = NULL);
+};
@@ -0,0 +1,443 @@
+#include "world_partition.h"
+#include "scene_parser.h"
+
+#include "framework/entities/entity.h"
+#include "framework/profiler.h"
+#include "graphics/mesh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+
+struct sWorldPartitionInfo
+{
+	int version = 0;
+	int header_bytes = 0;
+	float cell_size = 0;
+	unsigned int num_cells = 0;
+	Uint64 source_size = 0; //to know if the source scene changed
+	Uint64 source_time = 0;
+	char extra[32]; //unused
+};
+
+struct sWorldCellInfo {
+	int x, z;
+	unsigned int num_instances;
+};
+
+//the entities do not delete their children
+static void deleteEntity(Entity* entity)
+{
+	for (Entity* child : entity->children)
+		deleteEntity(child);
+	delete entity;
+}
+
+WorldPartition::WorldPartition()
+{
+}
+
+WorldPartition::~WorldPartition()
+{
+	unloadAll();
+}
+
+std::string WorldPartition::getCellFilename(const std::string& folder, int x, int z)
+{
+	return folder + "/" + std::to_string(x) + "_" + std::to_string(z) + ".sbin";
+}
+
+//same file SceneParser::createEntities loads, false for the tagged ones (they are not meshes of the scene)
+bool WorldPartition::getMeshFilename(const std::string& name, std::string& filename)
+{
+	if (name.find("@tag") != std::string::npos)
+		return false;
+	filename = "data/" + name;
+	return true;
+}
+
+bool WorldPartition::build(const char* filename, float cell_size)
+{
+	assert(cell_size > 0);
+	sSceneBin scene;
+	if (!scene.load(filename))
+		return false;
+
+	//the instances of every mesh in the cell where their origin is
+	struct sBuildCell {
+		sSceneBin scene;
+		std::map<int, int> slots; //mesh in the scene -> mesh in the cell
+	};
+	std::map<std::pair<int, int>, sBuildCell> grid;
+
+	for (int i = 0; i < (int)scene.meshes.size(); ++i)
+	{
+		sSceneBinMesh& mesh = scene.meshes[i];
+		for (Matrix44& model : mesh.models)
+		{
+			Vector3 pos = model.getTranslation();
+			std::pair<int, int> key((int)floor(pos.x / cell_size), (int)floor(pos.z / cell_size));
+			sBuildCell& cell = grid[key];
+			if (cell.scene.materials.empty())
+				cell.scene.materials = scene.materials;
+			auto it = cell.slots.find(i);
+			if (it == cell.slots.end())
+			{
+				it = cell.slots.insert(std::make_pair(i, (int)cell.scene.meshes.size())).first;
+				sSceneBinMesh cell_mesh;
+				cell_mesh.name = mesh.name;
+				cell_mesh.material = mesh.material;
+				cell.scene.meshes.push_back(cell_mesh);
+			}
+			cell.scene.meshes[it->second].models.push_back(model);
+		}
+	}
+
+	std::string folder = std::string(filename) + ".cells";
+	std::error_code error;
+	std::filesystem::create_directories(folder, error);
+
+	std::vector<sWorldCellInfo> cell_infos;
+	for (auto& it : grid)
+	{
+		sWorldCellInfo cell_info;
+		cell_info.x = it.first.first;
+		cell_info.z = it.first.second;
+		cell_info.num_instances = it.second.scene.getNumInstances();
+		if (!it.second.scene.write(getCellFilename(folder, cell_info.x, cell_info.z).c_str()))
+			return false;
+		cell_infos.push_back(cell_info);
+	}
+
+	std::string indexfilename = std::string(filename) + ".wpart";
+	FILE* f = fopen(indexfilename.c_str(), "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write world partition: " << indexfilename << std::endl;
+		return false;
+	}
+
+	sWorldPartitionInfo info;
+	memset(&info, 0, sizeof(info));
+	info.version = WORLD_PARTITION_VERSION;
+	info.header_bytes = sizeof(sWorldPartitionInfo);
+	info.cell_size = cell_size;
+	info.num_cells = (unsigned int)cell_infos.size();
+
+	struct stat stbuffer;
+	if (stat(filename, &stbuffer) == 0)
+	{
+		info.source_size = (Uint64)stbuffer.st_size;
+		info.source_time = (Uint64)stbuffer.st_mtime;
+	}
+
+	//watermark
+	fwrite("WPRT", sizeof(char), 4, f);
+	fwrite(&info, sizeof(sWorldPartitionInfo), 1, f);
+	if (cell_infos.size())
+		fwrite(&cell_infos[0], sizeof(sWorldCellInfo) * cell_infos.size(), 1, f);
+	fclose(f);
+
+	std::cout << " + World partition built: " << indexfilename << " (" << cell_infos.size() << " cells of " << cell_size << ")" << std::endl;
+	return true;
+}
+
+bool WorldPartition::load(const char* filename, Entity* root, float cell_size)
+{
+	assert(root);
+	unloadAll();
+	cells.clear();
+	this->root = root;
+	folder = std::string(filename) + ".cells";
+
+	std::string indexfilename = std::string(filename) + ".wpart";
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		FILE* f = fopen(indexfilename.c_str(), "rb");
+		char watermark[4];
+		sWorldPartitionInfo info;
+		bool valid = f && fread(watermark, 4, 1, f) == 1 && memcmp(watermark, "WPRT", 4) == 0 &&
+			fread(&info, sizeof(sWorldPartitionInfo), 1, f) == 1 &&
+			info.version == WORLD_PARTITION_VERSION && info.header_bytes == sizeof(sWorldPartitionInfo);
+
+		//if the source is not there we trust the index
+		struct stat stbuffer;
+		if (valid && stat(filename, &stbuffer) == 0 &&
+			(info.source_size != (Uint64)stbuffer.st_size || info.source_time != (Uint64)stbuffer.st_mtime))
+			valid = false;
+
+		std::vector<sWorldCellInfo> cell_infos;
+		if (valid)
+		{
+			cell_infos.resize(info.num_cells);
+			valid = !info.num_cells || fread(&cell_infos[0], sizeof(sWorldCellInfo) * info.num_cells, 1, f) == 1;
+		}
+		if (f)
+			fclose(f);
+
+		if (valid)
+		{
+			this->cell_size = info.cell_size;
+			cells.resize(cell_infos.size());
+			for (size_t i = 0; i < cell_infos.size(); ++i)
+			{
+				cells[i].x = cell_infos[i].x;
+				cells[i].z = cell_infos[i].z;
+				cells[i].num_instances = cell_infos[i].num_instances;
+			}
+			std::cout << " + World partition: " << filename << " (" << cells.size() << " cells)" << std::endl;
+			return true;
+		}
+
+		if (attempt || !build(filename, cell_size))
+			break;
+	}
+
+	std::cout << "[ERROR] World partition cannot be loaded: " << filename << std::endl;
+	return false;
+}
+
+float WorldPartition::getDistance(const sWorldCell& cell, const Vector3& eye)
+{
+	float min_x = cell.x * cell_size;
+	float min_z = cell.z * cell_size;
+	float dx = std::max(std::max(min_x - eye.x, eye.x - (min_x + cell_size)), 0.0f);
+	float dz = std::max(std::max(min_z - eye.z, eye.z - (min_z + cell_size)), 0.0f);
+	return sqrtf(dx * dx + dz * dz);
+}
+
+void WorldPartition::update(const Vector3& eye)
+{
+	PROFILE_SCOPE("world partition");
+
+	//upload the meshes and create the entities of the cells already read, the first one even if it goes over the budget
+	int budget = max_upload_bytes_per_frame;
+	bool created = false;
+	std::vector<int> waiting;
+	while (budget > 0 || !created)
+	{
+		int index;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ready.empty())
+				break;
+			index = ready.front();
+			ready.pop_front();
+		}
+		sWorldCell& cell = cells[index];
+		if (cell.cancelled)
+		{
+			deleteCellData(cell);
+			cell.cancelled = false;
+			cell.state = CELL_UNLOADED;
+			continue;
+		}
+		if (isWaitingForMeshes(cell))
+		{
+			waiting.push_back(index);
+			continue;
+		}
+		for (Mesh* mesh : cell.meshes)
+			budget -= (int)mesh->getVertexBytes();
+		createCell(cell);
+		created = true;
+	}
+	if (waiting.size())
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.insert(ready.end(), waiting.begin(), waiting.end());
+	}
+
+	//closest first
+	std::vector<std::pair<float, int>> to_load;
+	for (int i = 0; i < (int)cells.size(); ++i)
+	{
+		sWorldCell& cell = cells[i];
+		float distance = getDistance(cell, eye);
+		switch (cell.state)
+		{
+		case CELL_UNLOADED:
+			if (distance < load_distance)
+				to_load.push_back(std::make_pair(distance, i));
+			break;
+		case CELL_LOADING:
+			cell.cancelled = distance > unload_distance;
+			break;
+		case CELL_LOADED:
+			if (distance > unload_distance)
+				unloadCell(cell);
+			break;
+		}
+	}
+	std::sort(to_load.begin(), to_load.end());
+	for (auto& it : to_load)
+		requestCell(it.second);
+
+	Profiler::addCounter("loaded cells", getNumLoadedCells());
+}
+
+void WorldPartition::requestCell(int index)
+{
+	sWorldCell& cell = cells[index];
+	cell.state = CELL_LOADING;
+	cell.cancelled = false;
+	std::string filename = getCellFilename(folder, cell.x, cell.z);
+	JobSystem::runBackground([this, index, filename] {
+		PROFILE_SCOPE("read cell");
+		Profiler::setZoneDetail(filename);
+		sSceneBin* data = new sSceneBin();
+		if (!data->read(filename.c_str()))
+		{
+			std::cout << "[ERROR] World partition cell not found: " << filename << std::endl;
+			delete data;
+			data = nullptr;
+		}
+
+		//decode the meshes nobody has loaded (or is decoding), the main thread only uploads them
+		std::vector<Mesh*> meshes;
+		for (int i = 0; data && i < (int)data->meshes.size(); ++i)
+		{
+			std::string mesh_filename;
+			if (data->meshes[i].models.empty() || !getMeshFilename(data->meshes[i].name, mesh_filename))
+				continue;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (ResourceManager::contains(RESOURCE_MESH, mesh_filename) || !decoding.insert(mesh_filename).second)
+					continue;
+			}
+			Mesh* mesh = Mesh::Decode(mesh_filename.c_str());
+			if (mesh)
+			{
+				mesh->createCollisionModel(true); //static, like EntityCollider::setupCollision(true)
+				meshes.push_back(mesh);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				decoding.erase(mesh_filename);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		cells[index].data = data;
+		cells[index].meshes.swap(meshes);
+		ready.push_back(index);
+	}, &jobs);
+}
+
+//a mesh of the cell is being decoded by the job of another cell, creating it now would load it again in this thread
+bool WorldPartition::isWaitingForMeshes(sWorldCell& cell)
+{
+	if (!cell.data)
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (sSceneBinMesh& data : cell.data->meshes)
+	{
+		std::string mesh_filename;
+		if (!getMeshFilename(data.name, mesh_filename) || !decoding.count(mesh_filename))
+			continue;
+		bool own = false;
+		for (Mesh* mesh : cell.meshes)
+			own = own || mesh->name == mesh_filename;
+		if (!own)
+			return true;
+	}
+	return false;
+}
+
+void WorldPartition::createCell(sWorldCell& cell)
+{
+	PROFILE_SCOPE("create cell");
+	cell.state = CELL_LOADED;
+	if (!cell.data)
+		return; //stays loaded (empty) so it is not read every frame
+
+	cell.entity = new Entity();
+	cell.entity->name = "cell " + std::to_string(cell.x) + "," + std::to_string(cell.z);
+	root->addChild(cell.entity);
+
+	//hold the meshes and textures of the cell (the new ones can be evicted once it is unloaded)
+	SceneParser parser;
+	parser.pack_textures = false; //the arrays would be rebuilt with every cell
+	ResourceManager::beginLoad();
+	for (Mesh* mesh : cell.meshes)
+	{
+		std::string mesh_filename = mesh->name;
+		Mesh::Upload(mesh); //createEntities finds it registered
+		std::lock_guard<std::mutex> lock(mutex);
+		decoding.erase(mesh_filename);
+	}
+	cell.meshes.clear();
+	parser.createEntities(*cell.data, cell.entity);
+	cell.resources = ResourceManager::endLoad();
+	deleteCellData(cell);
+}
+
+void WorldPartition::deleteCellData(sWorldCell& cell)
+{
+	delete cell.data;
+	cell.data = nullptr;
+
+	//decoded but never uploaded
+	std::lock_guard<std::mutex> lock(mutex);
+	for (Mesh* mesh : cell.meshes)
+	{
+		decoding.erase(mesh->name);
+		delete mesh;
+	}
+	cell.meshes.clear();
+}
+
+void WorldPartition::unloadCell(sWorldCell& cell)
+{
+	PROFILE_SCOPE("unload cell");
+	if (cell.entity)
+	{
+		root->removeChild(cell.entity);
+		deleteEntity(cell.entity);
+		cell.entity = nullptr;
+	}
+
+	//evicted by the ResourceManager once no other cell uses them
+	cell.resources.clear();
+	cell.state = CELL_UNLOADED;
+}
+
+void WorldPartition::unloadAll()
+{
+	JobSystem::wait(&jobs);
+	for (int index : ready)
+		deleteCellData(cells[index]);
+	ready.clear();
+
+	for (sWorldCell& cell : cells)
+	{
+		if (cell.state == CELL_LOADED)
+			unloadCell(cell);
+		cell.state = CELL_UNLOADED;
+		cell.cancelled = false;
+	}
+}
+
+int WorldPartition::getNumLoadedCells()
+{
+	int num = 0;
+	for (sWorldCell& cell : cells)
+		if (cell.state == CELL_LOADED)
+			num++;
+	return num;
+}
+
+int WorldPartition::getNumLoadedInstances()
+{
+	int num = 0;
+	for (sWorldCell& cell : cells)
+		if (cell.state == CELL_LOADED)
+			num += cell.num_instances;
+	return num;
+}
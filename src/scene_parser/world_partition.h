@@ -0,0 +1,94 @@
+/*  WorldPartition
+	Streams a big scene by cells: the instances are split in a grid (in XZ) and every cell is stored in its own .sbin,
+	only the cells close to the camera are loaded. The files are read and the new meshes decoded (with their collision
+	models) in background jobs, the main thread only uploads them under a budget per frame and creates the entities.
+	Every cell holds references to the resources it used (see ResourceManager), so they can be evicted once no loaded
+	cell needs them.
+
+		TJE_Framework --partition-scene level.scene [cell_size]	//optional, load builds it if it is missing or old
+
+	The index is stored in level.scene.wpart and the cells in the folder level.scene.cells. The resources loaded by the
+	partition are not pinned, entities created outside should hold a handle to the ones they use.
+*/
+
+#pragma once
+
+#include "framework/framework.h"
+#include "framework/job_system.h"
+#include "framework/resource_manager.h"
+
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#define WORLD_PARTITION_VERSION 1 //this is used to rebuild the partition if the format changes
+
+class Entity;
+class Mesh;
+struct sSceneBin;
+
+enum eWorldCellState {
+	CELL_UNLOADED,
+	CELL_LOADING, //the file is being read and its meshes decoded in a job
+	CELL_LOADED
+};
+
+struct sWorldCell {
+	int x, z; //in the grid, the cell covers from (x, z) * cell_size to (x + 1, z + 1) * cell_size
+	unsigned int num_instances;
+	eWorldCellState state = CELL_UNLOADED;
+	bool cancelled = false; //went out of range while loading
+	sSceneBin* data = nullptr; //read by the job, waiting to create the entities
+	std::vector<Mesh*> meshes; //decoded by the job (not registered yet), uploaded before creating the entities
+	Entity* entity = nullptr; //parent of the entities of the cell
+	std::vector<ResourceRef> resources; //used by the cell, referenced while it is loaded
+};
+
+class WorldPartition {
+public:
+	float load_distance = 150.0f; //cells closer than this to the camera (in XZ) are loaded
+	float unload_distance = 200.0f; //and the ones farther unloaded, the gap avoids reloading at the border
+	int max_upload_bytes_per_frame = 8 * 1024 * 1024; //of the new meshes uploaded per frame, at least one cell is created
+
+	WorldPartition();
+	~WorldPartition();
+
+	// Reads the index of a partitioned scene (.scene or .sbin), it is built first if it is missing or old
+	bool load(const char* filename, Entity* root, float cell_size = 64.0f);
+
+	// Loads and unloads the cells around the eye, once per frame in the main thread while the update is stopped
+	void update(const Vector3& eye);
+
+	void unloadAll();
+
+	float getCellSize() { return cell_size; }
+	int getNumCells() { return (int)cells.size(); }
+	int getNumLoadedCells();
+	int getNumLoadedInstances();
+
+	// Splits the instances of the scene in cells and writes the index and the cell files
+	static bool build(const char* filename, float cell_size = 64.0f);
+
+private:
+	float cell_size = 64.0f;
+	std::string folder; //of the cell files
+	Entity* root = nullptr;
+	std::vector<sWorldCell> cells;
+
+	std::mutex mutex;
+	std::deque<int> ready; //cells read by the jobs
+	std::set<std::string> decoding; //meshes decoded by a job and not uploaded yet, so two cells do not decode the same one
+	JobCounter jobs;
+
+	float getDistance(const sWorldCell& cell, const Vector3& eye);
+	void requestCell(int index);
+	bool isWaitingForMeshes(sWorldCell& cell);
+	void createCell(sWorldCell& cell);
+	void deleteCellData(sWorldCell& cell);
+	void unloadCell(sWorldCell& cell);
+
+	static std::string getCellFilename(const std::string& folder, int x, int z);
+	static bool getMeshFilename(const std::string& name, std::string& filename);
+};